@@ -0,0 +1,521 @@
+#ifndef BSP_TREE_H
+#define BSP_TREE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <Geometry.hpp>
+#include <Hash.hpp>
+
+/* Binary space partitioning tree for static geometry.
+ *
+ * Built once: every node stores a splitting plane and the triangles lying in
+ * it, triangles crossing the plane are cut in two. At render time the tree
+ * is walked relative to the eye - far side of each plane first, then the
+ * node's own triangles, then the near side - which yields a correct
+ * back-to-front order in O(n) without sorting anything.
+ *
+ * The splitter of every node is picked among a few sampled candidates by
+ * the score  splitWeight * splits + (1 - splitWeight) * |front - back|,
+ * i.e. by trading the number of extra triangles against tree depth.
+ */
+struct BspBuildOptions
+{
+    unsigned int candidates;   // splitters sampled per node
+    float splitWeight;         // 1 = only avoid splits, 0 = only balance
+
+    BspBuildOptions() : candidates(16), splitWeight(0.8f) {}
+};
+
+struct BspStats
+{
+    size_t nodes;
+    size_t splits;        // triangles cut while building
+    size_t triangles;     // triangles in the tree (after splitting)
+    size_t depth;
+    double buildMs;
+    double traverseMs;    // last traverse() call
+
+    BspStats() : nodes(0), splits(0), triangles(0), depth(0), buildMs(0.0), traverseMs(0.0) {}
+};
+
+class BspTree
+{
+public:
+    BspTree() : root(-1), sourceHash(0) {}
+
+    // build the tree over all triangles of `source`
+    // ------------------------------------------------------------------------
+    void build(const Geometry& source, const BspBuildOptions& options = BspBuildOptions())
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+
+        treeStats = BspStats();
+        geometry.stride = source.stride;
+        geometry.vertices = source.vertices;
+        geometry.indices.clear();
+        nodes.clear();
+        sourceHash = hashOf(source);
+
+        std::vector<Triangle> triangles(source.triangleCount());
+        for (size_t i = 0; i < triangles.size(); ++i)
+            triangles[i] = Triangle(&source.indices[i * 3]);
+
+        // explicit stack instead of recursion - degenerate inputs can go deep
+        std::vector<BuildTask> stack(1);
+        stack.back().triangles.swap(triangles);
+        root = -1;
+
+        while (!stack.empty())
+        {
+            BuildTask task;
+            task.triangles.swap(stack.back().triangles);
+            task.parent = stack.back().parent;
+            task.front = stack.back().front;
+            task.depth = stack.back().depth;
+            stack.pop_back();
+            if (task.triangles.empty())
+                continue;
+
+            int32_t index = (int32_t)nodes.size();
+            if (task.parent < 0)
+                root = index;
+            else if (task.front)
+                nodes[task.parent].front = index;
+            else
+                nodes[task.parent].back = index;
+            treeStats.depth = std::max(treeStats.depth, task.depth);
+
+            Node node;
+            node.front = node.back = -1;
+
+            // triangles without a plane of their own stay at this node and
+            // are never splitters; the splitter always lands in its own
+            // plane, so every node takes at least one triangle
+            std::vector<Triangle> front, back;
+            std::vector<Triangle> coplanar;
+            std::vector<Triangle>::iterator flat =
+                std::partition(task.triangles.begin(), task.triangles.end(),
+                               [this](const Triangle& tri) { return hasPlane(tri); });
+            coplanar.assign(flat, task.triangles.end());
+            task.triangles.erase(flat, task.triangles.end());
+            node.plane = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+            if (!task.triangles.empty())
+                node.plane = planeOf(chooseSplitter(task.triangles, options));
+            for (const Triangle& tri : task.triangles)
+                classify(tri, node.plane, coplanar, front, back);
+
+            node.firstIndex = (uint32_t)geometry.indices.size();
+            node.indexCount = (uint32_t)coplanar.size() * 3;
+            for (const Triangle& tri : coplanar)
+                geometry.indices.insert(geometry.indices.end(), tri.v, tri.v + 3);
+            nodes.push_back(node);
+
+            // children link themselves into their parent once they exist
+            for (int child = 0; child < 2; ++child)
+            {
+                stack.push_back(BuildTask());
+                stack.back().triangles.swap(child == 0 ? front : back);
+                stack.back().parent = index;
+                stack.back().front = child == 0;
+                stack.back().depth = task.depth + 1;
+            }
+        }
+
+        treeStats.nodes = nodes.size();
+        treeStats.triangles = geometry.triangleCount();
+        treeStats.buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        geometry.changed();
+    }
+
+    // write the back-to-front index order for an eye at `modelView`'s origin
+    // ------------------------------------------------------------------------
+    void traverse(const glm::mat4& modelView, std::vector<unsigned int>& outIndices)
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+
+        // eye position in the tree's (model) space
+        glm::vec4 eye = glm::inverse(modelView) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        glm::vec3 eyePosition(eye.x / eye.w, eye.y / eye.w, eye.z / eye.w);
+
+        outIndices.resize(geometry.indices.size());
+        size_t written = 0;
+        // an entry is a node to expand, or (negative) a node whose triangles to emit
+        traversal.clear();
+        if (root >= 0)
+            traversal.push_back(root + 1);
+        while (!traversal.empty())
+        {
+            int32_t entry = traversal.back();
+            traversal.pop_back();
+            if (entry < 0)
+            {
+                const Node& node = nodes[-entry - 1];
+                const unsigned int* src = &geometry.indices[node.firstIndex];
+                std::copy(src, src + node.indexCount, outIndices.begin() + written);
+                written += node.indexCount;
+                continue;
+            }
+            const Node& node = nodes[entry - 1];
+            float side = glm::dot(glm::vec3(node.plane.x, node.plane.y, node.plane.z), eyePosition) + node.plane.w;
+            int32_t nearChild = side >= 0.0f ? node.front : node.back;
+            int32_t farChild = side >= 0.0f ? node.back : node.front;
+            // stack - push in reverse drawing order
+            if (nearChild >= 0)
+                traversal.push_back(nearChild + 1);
+            traversal.push_back(-entry);
+            if (farChild >= 0)
+                traversal.push_back(farChild + 1);
+        }
+
+        treeStats.traverseMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // vertices (including the ones created by splits) and the tree's triangles
+    const Geometry& splitGeometry() const
+    {
+        return geometry;
+    }
+
+    const BspStats& stats() const
+    {
+        return treeStats;
+    }
+
+    // true if the tree was built from exactly this geometry
+    bool builtFrom(const Geometry& source) const
+    {
+        return root >= 0 && sourceHash == hashOf(source);
+    }
+
+    // binary file: header, vertices, indices, nodes
+    // ------------------------------------------------------------------------
+    bool save(const char* path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::BSP::FILE_NOT_SUCCESSFULLY_WRITTEN: " << path << std::endl;
+            return false;
+        }
+        FileHeader header;
+        std::copy(magic(), magic() + 4, header.magic);
+        header.version = VERSION;
+        header.stride = geometry.stride;
+        header.vertexFloats = (uint32_t)geometry.vertices.size();
+        header.indexCount = (uint32_t)geometry.indices.size();
+        header.nodeCount = (uint32_t)nodes.size();
+        header.root = root;
+        header.sourceHash = sourceHash;
+        header.splits = (uint32_t)treeStats.splits;
+        header.depth = (uint32_t)treeStats.depth;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(geometry.vertices.data()), geometry.vertices.size() * sizeof(float));
+        file.write(reinterpret_cast<const char*>(geometry.indices.data()), geometry.indices.size() * sizeof(unsigned int));
+        file.write(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(Node));
+        return (bool)file;
+    }
+
+    bool load(const char* path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        root = -1;
+        FileHeader header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            !std::equal(magic(), magic() + 4, header.magic) || header.version != VERSION || header.stride < 3 ||
+            header.vertexFloats % header.stride != 0 || header.indexCount % 3 != 0)
+        {
+            std::cout << "ERROR::BSP::UNSUPPORTED_FILE: " << path << std::endl;
+            return false;
+        }
+        // the counts size the arrays, so they are held against the file
+        // before anything is allocated
+        file.seekg(0, std::ios::end);
+        uint64_t expected = sizeof(header) + (uint64_t)header.vertexFloats * sizeof(float) +
+                            (uint64_t)header.indexCount * sizeof(unsigned int) + (uint64_t)header.nodeCount * sizeof(Node);
+        if ((uint64_t)file.tellg() != expected)
+        {
+            std::cout << "ERROR::BSP::FILE_TRUNCATED: " << path << std::endl;
+            return false;
+        }
+        file.seekg(sizeof(header));
+        geometry.stride = header.stride;
+        geometry.vertices.resize(header.vertexFloats);
+        geometry.indices.resize(header.indexCount);
+        nodes.resize(header.nodeCount);
+        file.read(reinterpret_cast<char*>(geometry.vertices.data()), geometry.vertices.size() * sizeof(float));
+        file.read(reinterpret_cast<char*>(geometry.indices.data()), geometry.indices.size() * sizeof(unsigned int));
+        file.read(reinterpret_cast<char*>(nodes.data()), nodes.size() * sizeof(Node));
+        if (!file)
+        {
+            std::cout << "ERROR::BSP::FILE_TRUNCATED: " << path << std::endl;
+            return false;
+        }
+        if (!validate(header.root))
+        {
+            std::cout << "ERROR::BSP::BAD_TREE: " << path << std::endl;
+            nodes.clear();
+            geometry.indices.clear();
+            return false;
+        }
+        root = header.root;
+        sourceHash = header.sourceHash;
+        treeStats = BspStats();
+        treeStats.nodes = nodes.size();
+        treeStats.triangles = geometry.triangleCount();
+        treeStats.splits = header.splits;
+        treeStats.depth = header.depth;
+        geometry.changed();
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        glm::vec4 plane;
+        int32_t front;
+        int32_t back;
+        uint32_t firstIndex;    // this node's coplanar triangles in geometry.indices
+        uint32_t indexCount;
+    };
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t stride;
+        uint32_t vertexFloats;
+        uint32_t indexCount;
+        uint32_t nodeCount;
+        int32_t root;
+        uint32_t splits;
+        uint32_t depth;
+        uint32_t reserved;
+        uint64_t sourceHash;
+    };
+
+    struct Triangle
+    {
+        unsigned int v[3];
+
+        explicit Triangle(const unsigned int* indices = nullptr)
+        {
+            for (int i = 0; i < 3; ++i)
+                v[i] = indices ? indices[i] : 0;
+        }
+
+        Triangle(unsigned int a, unsigned int b, unsigned int c)
+        {
+            v[0] = a;
+            v[1] = b;
+            v[2] = c;
+        }
+    };
+
+    struct BuildTask
+    {
+        std::vector<Triangle> triangles;
+        int32_t parent;   // -1 for the root
+        bool front;       // which child of the parent this is
+        size_t depth;
+
+        BuildTask() : parent(-1), front(false), depth(1) {}
+    };
+
+    static const uint32_t VERSION = 1;
+
+    Geometry geometry;
+    std::vector<Node> nodes;
+    int32_t root;
+    uint64_t sourceHash;
+    BspStats treeStats;
+    std::vector<int32_t> traversal;
+
+    // everything traverse() relies on: build() numbers children after their
+    // parent, so a child index above its parent's and at most one parent per
+    // node make a tree; every node's triangles lie in the index buffer, no two
+    // nodes emit more than it holds, and every index names a vertex
+    bool validate(int32_t rootNode) const
+    {
+        if (nodes.empty())
+            return rootNode == -1;
+        if (rootNode != 0)
+            return false;
+        const size_t vertexCount = geometry.vertexCount();
+        for (unsigned int index : geometry.indices)
+        {
+            if (index >= vertexCount)
+                return false;
+        }
+        std::vector<unsigned char> referenced(nodes.size(), 0);
+        uint64_t emitted = 0;
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            const Node& node = nodes[i];
+            if (node.indexCount % 3 != 0 || (uint64_t)node.firstIndex + node.indexCount > geometry.indices.size())
+                return false;
+            emitted += node.indexCount;
+            const int32_t children[2] = { node.front, node.back };
+            for (int32_t child : children)
+            {
+                if (child == -1)
+                    continue;
+                if (child <= (int32_t)i || (size_t)child >= nodes.size() || referenced[child]++)
+                    return false;
+            }
+        }
+        return emitted <= geometry.indices.size();
+    }
+
+    static float epsilon()
+    {
+        return 1e-5f;
+    }
+
+    static const char* magic()
+    {
+        return "BSPT";
+    }
+
+    static uint64_t hashOf(const Geometry& source)
+    {
+        uint64_t hash = fnv1a64(&source.stride, sizeof(source.stride));
+        hash = fnv1a64(source.vertices.data(), source.vertices.size() * sizeof(float), hash);
+        return fnv1a64(source.indices.data(), source.indices.size() * sizeof(unsigned int), hash);
+    }
+
+    glm::vec4 planeOf(const Triangle& tri) const
+    {
+        glm::vec3 a = geometry.position(tri.v[0]);
+        glm::vec3 normal = glm::cross(geometry.position(tri.v[1]) - a, geometry.position(tri.v[2]) - a);
+        float length = glm::length(normal);
+        normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        return glm::vec4(normal, -glm::dot(normal, a));
+    }
+
+    // false for a triangle without area, or one so thin that its corners do
+    // not lie in the plane computed from them (planeOf() falls back to +z
+    // through the first corner): sent to either side of any plane, it would
+    // come back to the next node unchanged
+    bool hasPlane(const Triangle& tri) const
+    {
+        glm::vec3 a = geometry.position(tri.v[0]);
+        glm::vec3 normal = glm::cross(geometry.position(tri.v[1]) - a, geometry.position(tri.v[2]) - a);
+        return glm::length(normal) > 0.0f && side(tri, planeOf(tri)) == 0;
+    }
+
+    float distance(const glm::vec4& plane, unsigned int vertex) const
+    {
+        const float* p = &geometry.vertices[(size_t)vertex * geometry.stride];
+        return plane.x * p[0] + plane.y * p[1] + plane.z * p[2] + plane.w;
+    }
+
+    // -1 back, 1 front, 0 coplanar, 2 spanning
+    int side(const Triangle& tri, const glm::vec4& plane) const
+    {
+        bool front = false, back = false;
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            float d = distance(plane, tri.v[corner]);
+            front = front || d > epsilon();
+            back = back || d < -epsilon();
+        }
+        if (front && back)
+            return 2;
+        return front ? 1 : (back ? -1 : 0);
+    }
+
+    Triangle chooseSplitter(const std::vector<Triangle>& triangles, const BspBuildOptions& options) const
+    {
+        size_t count = triangles.size();
+        size_t candidates = std::min<size_t>(std::max(1u, options.candidates), count);
+        size_t best = 0;
+        float bestScore = 0.0f;
+        for (size_t c = 0; c < candidates; ++c)
+        {
+            // evenly spaced samples; stable from build to build
+            size_t pick = c * count / candidates;
+            glm::vec4 plane = planeOf(triangles[pick]);
+            size_t front = 0, back = 0, splits = 0;
+            for (const Triangle& tri : triangles)
+            {
+                switch (side(tri, plane))
+                {
+                case 1:  ++front; break;
+                case -1: ++back; break;
+                case 2:  ++splits; break;
+                default: break;
+                }
+            }
+            float imbalance = (float)(front > back ? front - back : back - front);
+            float score = options.splitWeight * splits + (1.0f - options.splitWeight) * imbalance;
+            if (c == 0 || score < bestScore)
+            {
+                best = pick;
+                bestScore = score;
+            }
+        }
+        return triangles[best];
+    }
+
+    void classify(const Triangle& tri, const glm::vec4& plane, std::vector<Triangle>& coplanar,
+                  std::vector<Triangle>& front, std::vector<Triangle>& back)
+    {
+        switch (side(tri, plane))
+        {
+        case 0:  coplanar.push_back(tri); return;
+        case 1:  front.push_back(tri); return;
+        case -1: back.push_back(tri); return;
+        default: break;
+        }
+        ++treeStats.splits;
+
+        // clip the triangle into a front and a back polygon (3 or 4 vertices)
+        unsigned int frontPoly[4], backPoly[4];
+        int frontCount = 0, backCount = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            unsigned int a = tri.v[i], b = tri.v[(i + 1) % 3];
+            float da = distance(plane, a), db = distance(plane, b);
+            if (da >= -epsilon())
+                frontPoly[frontCount++] = a;
+            if (da <= epsilon())
+                backPoly[backCount++] = a;
+            if ((da > epsilon() && db < -epsilon()) || (da < -epsilon() && db > epsilon()))
+            {
+                unsigned int v = splitVertex(a, b, da / (da - db));
+                frontPoly[frontCount++] = v;
+                backPoly[backCount++] = v;
+            }
+        }
+        for (int i = 1; i + 1 < frontCount; ++i)
+            front.push_back(Triangle(frontPoly[0], frontPoly[i], frontPoly[i + 1]));
+        for (int i = 1; i + 1 < backCount; ++i)
+            back.push_back(Triangle(backPoly[0], backPoly[i], backPoly[i + 1]));
+    }
+
+    unsigned int splitVertex(unsigned int a, unsigned int b, float t)
+    {
+        const unsigned int stride = geometry.stride;
+        size_t offset = geometry.vertices.size();
+        geometry.vertices.resize(offset + stride);
+        const float* va = &geometry.vertices[(size_t)a * stride];
+        const float* vb = &geometry.vertices[(size_t)b * stride];
+        float* out = &geometry.vertices[offset];
+        for (unsigned int k = 0; k < stride; ++k)
+            out[k] = va[k] + (vb[k] - va[k]) * t;
+        return (unsigned int)(offset / stride);
+    }
+};
+#endif
@@ -0,0 +1,267 @@
+#ifndef DEPTH_KEYS_H
+#define DEPTH_KEYS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Geometry.hpp>
+#include <RadixSort.hpp>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DEPTH_KEYS_X86 1
+#else
+#define DEPTH_KEYS_X86 0
+#endif
+
+/* Painter's depth keys, computed in batches.
+ *
+ * The triangle corners are copied once into structure-of-arrays form (one
+ * array per corner and coordinate), so a SIMD register holds the same value
+ * of 8 (AVX2) or 4 (SSE4.1) consecutive triangles. The key of a triangle is
+ * the view-space z of its farthest corner, turned into sortable unsigned
+ * bits right away - the output can go straight into the radix sort.
+ *
+ * The instruction set is picked at runtime from CPUID; the vector paths are
+ * compiled with per-function target attributes, so no global -mavx2 is
+ * needed and the binary still runs on older CPUs.
+ */
+enum class SimdLevel
+{
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+inline const char* simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::Scalar: return "scalar";
+    case SimdLevel::SSE41:  return "SSE4.1";
+    case SimdLevel::AVX2:   return "AVX2";
+    }
+    return "?";
+}
+
+inline SimdLevel detectSimdLevel()
+{
+#if DEPTH_KEYS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return SimdLevel::SSE41;
+#endif
+    return SimdLevel::Scalar;
+}
+
+// triangle corners in structure-of-arrays layout: corner[c][axis][triangle]
+struct TriangleSoA
+{
+    std::vector<float> corner[3][3];
+    size_t count;
+
+    TriangleSoA() : count(0), sourceGeneration(0) {}
+
+    void build(const Geometry& geometry)
+    {
+        count = geometry.triangleCount();
+        for (int c = 0; c < 3; ++c)
+            for (int axis = 0; axis < 3; ++axis)
+                corner[c][axis].resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                const float* p = &geometry.vertices[(size_t)geometry.indices[i * 3 + c] * geometry.stride];
+                corner[c][0][i] = p[0];
+                corner[c][1][i] = p[1];
+                corner[c][2][i] = p[2];
+            }
+        }
+        sourceGeneration = geometry.generation;
+    }
+
+    // rebuild unless already built from this generation of the geometry;
+    // true if it did
+    bool update(const Geometry& geometry)
+    {
+        if (geometry.generation == sourceGeneration)
+            return false;
+        build(geometry);
+        return true;
+    }
+
+private:
+    uint64_t sourceGeneration;    // 0: never built
+};
+
+namespace depthkeys
+{
+    // z row of the model-view matrix - the only part the key needs
+    struct ZRow
+    {
+        float x, y, z, w;
+
+        explicit ZRow(const glm::mat4& modelView)
+            : x(modelView[0][2]), y(modelView[1][2]), z(modelView[2][2]), w(modelView[3][2])
+        {
+        }
+    };
+
+    inline void computeScalar(const TriangleSoA& soa, const ZRow& row, uint32_t* out, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            float farthest = 0.0f;
+            for (int c = 0; c < 3; ++c)
+            {
+                float z = row.x * soa.corner[c][0][i] + row.y * soa.corner[c][1][i] + row.z * soa.corner[c][2][i] + row.w;
+                farthest = c == 0 ? z : std::min(farthest, z);
+            }
+            out[i] = floatToSortableKey(farthest);
+        }
+    }
+
+    // out[i] = key of triangle ids[i]
+    inline void computeIndexedScalar(const TriangleSoA& soa, const ZRow& row, const uint32_t* ids, uint32_t* out,
+                                     size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            size_t t = ids[i];
+            float farthest = 0.0f;
+            for (int c = 0; c < 3; ++c)
+            {
+                float z = row.x * soa.corner[c][0][t] + row.y * soa.corner[c][1][t] + row.z * soa.corner[c][2][t] + row.w;
+                farthest = c == 0 ? z : std::min(farthest, z);
+            }
+            out[i] = floatToSortableKey(farthest);
+        }
+    }
+
+#if DEPTH_KEYS_X86
+    __attribute__((target("sse4.1")))
+    inline size_t computeSSE41(const TriangleSoA& soa, const ZRow& row, uint32_t* out, size_t begin, size_t end)
+    {
+        const __m128 rx = _mm_set1_ps(row.x), ry = _mm_set1_ps(row.y);
+        const __m128 rz = _mm_set1_ps(row.z), rw = _mm_set1_ps(row.w);
+        const __m128i signBit = _mm_set1_epi32((int)0x80000000);
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 farthest = _mm_setzero_ps();
+            for (int c = 0; c < 3; ++c)
+            {
+                // same summation order as the scalar path, so all paths agree bit for bit
+                __m128 z = _mm_mul_ps(rx, _mm_loadu_ps(&soa.corner[c][0][i]));
+                z = _mm_add_ps(z, _mm_mul_ps(ry, _mm_loadu_ps(&soa.corner[c][1][i])));
+                z = _mm_add_ps(z, _mm_mul_ps(rz, _mm_loadu_ps(&soa.corner[c][2][i])));
+                z = _mm_add_ps(z, rw);
+                farthest = c == 0 ? z : _mm_min_ps(farthest, z);
+            }
+            // floatToSortableKey: flip everything for negatives, the sign for positives
+            __m128i bits = _mm_castps_si128(farthest);
+            __m128i mask = _mm_or_si128(_mm_srai_epi32(bits, 31), signBit);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(bits, mask));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    inline size_t computeAVX2(const TriangleSoA& soa, const ZRow& row, uint32_t* out, size_t begin, size_t end)
+    {
+        const __m256 rx = _mm256_set1_ps(row.x), ry = _mm256_set1_ps(row.y);
+        const __m256 rz = _mm256_set1_ps(row.z), rw = _mm256_set1_ps(row.w);
+        const __m256i signBit = _mm256_set1_epi32((int)0x80000000);
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256 farthest = _mm256_setzero_ps();
+            for (int c = 0; c < 3; ++c)
+            {
+                __m256 z = _mm256_mul_ps(rx, _mm256_loadu_ps(&soa.corner[c][0][i]));
+                z = _mm256_add_ps(z, _mm256_mul_ps(ry, _mm256_loadu_ps(&soa.corner[c][1][i])));
+                z = _mm256_add_ps(z, _mm256_mul_ps(rz, _mm256_loadu_ps(&soa.corner[c][2][i])));
+                z = _mm256_add_ps(z, rw);
+                farthest = c == 0 ? z : _mm256_min_ps(farthest, z);
+            }
+            __m256i bits = _mm256_castps_si256(farthest);
+            __m256i mask = _mm256_or_si256(_mm256_srai_epi32(bits, 31), signBit);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_xor_si256(bits, mask));
+        }
+        return i;
+    }
+
+    // the indexed variant loads the corners with gathers; SSE has none, so
+    // SSE4.1 machines take the scalar loop for it
+    __attribute__((target("avx2")))
+    inline size_t computeIndexedAVX2(const TriangleSoA& soa, const ZRow& row, const uint32_t* ids, uint32_t* out,
+                                     size_t begin, size_t end)
+    {
+        const __m256 rx = _mm256_set1_ps(row.x), ry = _mm256_set1_ps(row.y);
+        const __m256 rz = _mm256_set1_ps(row.z), rw = _mm256_set1_ps(row.w);
+        const __m256i signBit = _mm256_set1_epi32((int)0x80000000);
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ids + i));
+            __m256 farthest = _mm256_setzero_ps();
+            for (int c = 0; c < 3; ++c)
+            {
+                __m256 z = _mm256_mul_ps(rx, _mm256_i32gather_ps(soa.corner[c][0].data(), index, 4));
+                z = _mm256_add_ps(z, _mm256_mul_ps(ry, _mm256_i32gather_ps(soa.corner[c][1].data(), index, 4)));
+                z = _mm256_add_ps(z, _mm256_mul_ps(rz, _mm256_i32gather_ps(soa.corner[c][2].data(), index, 4)));
+                z = _mm256_add_ps(z, rw);
+                farthest = c == 0 ? z : _mm256_min_ps(farthest, z);
+            }
+            __m256i bits = _mm256_castps_si256(farthest);
+            __m256i mask = _mm256_or_si256(_mm256_srai_epi32(bits, 31), signBit);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_xor_si256(bits, mask));
+        }
+        return i;
+    }
+#endif
+}
+
+// keys of triangles [begin, end) into out[begin, end)
+// ------------------------------------------------------------------------
+inline void computeDepthKeys(const TriangleSoA& soa, const glm::mat4& modelView, uint32_t* out,
+                             size_t begin, size_t end, SimdLevel level)
+{
+    depthkeys::ZRow row(modelView);
+    size_t done = begin;
+#if DEPTH_KEYS_X86
+    if (level == SimdLevel::AVX2)
+        done = depthkeys::computeAVX2(soa, row, out, begin, end);
+    else if (level == SimdLevel::SSE41)
+        done = depthkeys::computeSSE41(soa, row, out, begin, end);
+#else
+    (void)level;
+#endif
+    // remainder (or everything, without SIMD)
+    depthkeys::computeScalar(soa, row, out, done, end);
+}
+
+// keys of the triangles ids[begin, end) into out[begin, end), for sorting a
+// subset of the triangles (e.g. the ones that survived culling)
+// ------------------------------------------------------------------------
+inline void computeDepthKeysIndexed(const TriangleSoA& soa, const glm::mat4& modelView, const uint32_t* ids,
+                                    uint32_t* out, size_t begin, size_t end, SimdLevel level)
+{
+    depthkeys::ZRow row(modelView);
+    size_t done = begin;
+#if DEPTH_KEYS_X86
+    if (level == SimdLevel::AVX2)
+        done = depthkeys::computeIndexedAVX2(soa, row, ids, out, begin, end);
+#else
+    (void)level;
+#endif
+    depthkeys::computeIndexedScalar(soa, row, ids, out, done, end);
+}
+#endif
@@ -0,0 +1,114 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/* Bump allocator for data that only lives for one frame.
+ *
+ * allocate() hands out memory from the current block and opens a new block
+ * when it runs out. reset() throws everything away at once; if the last frame
+ * needed more than one block, the blocks are merged into a single one big
+ * enough for the whole frame, so after a few frames the arena settles on one
+ * block and steady-state frames do not touch the heap at all.
+ *
+ * Only meant for trivially destructible types - nothing is ever destroyed.
+ */
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t initialSize = 1 << 20)
+        : blockSize(initialSize), current(0), offset(0), usedBytes(0), peakBytes(0)
+    {
+        blocks.push_back(Block(blockSize));
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    template <typename T>
+    T* allocate(size_t count)
+    {
+        return static_cast<T*>(allocateBytes(count * sizeof(T), alignof(T)));
+    }
+
+    void* allocateBytes(size_t size, size_t alignment)
+    {
+        for (;;)
+        {
+            Block& block = blocks[current];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+            size_t aligned = (size_t)(((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+            if (aligned + size <= block.size)
+            {
+                offset = aligned + size;
+                usedBytes += size;
+                return block.data.get() + aligned;
+            }
+            // current block is full, continue in the next (or a new) one
+            ++current;
+            offset = 0;
+            if (current == blocks.size())
+                blocks.push_back(Block(size + alignment > blockSize ? size + alignment : blockSize));
+        }
+    }
+
+    // release everything allocated since the last reset
+    // ------------------------------------------------------------------------
+    void reset()
+    {
+        if (usedBytes > peakBytes)
+            peakBytes = usedBytes;
+        if (blocks.size() > 1)
+        {
+            size_t total = 0;
+            for (const Block& block : blocks)
+                total += block.size;
+            blocks.clear();
+            blocks.push_back(Block(total));
+            blockSize = total;
+        }
+        current = 0;
+        offset = 0;
+        usedBytes = 0;
+    }
+
+    // bytes handed out since the last reset
+    size_t used() const
+    {
+        return usedBytes;
+    }
+
+    // largest frame seen so far
+    size_t peak() const
+    {
+        return usedBytes > peakBytes ? usedBytes : peakBytes;
+    }
+
+    size_t capacity() const
+    {
+        size_t total = 0;
+        for (const Block& block : blocks)
+            total += block.size;
+        return total;
+    }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+
+        explicit Block(size_t size) : data(new char[size]), size(size) {}
+    };
+
+    std::vector<Block> blocks;
+    size_t blockSize;
+    size_t current;
+    size_t offset;
+    size_t usedBytes;
+    size_t peakBytes;
+};
+#endif
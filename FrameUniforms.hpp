@@ -0,0 +1,182 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#include <GLState.hpp>
+
+/* Per-frame data every program reads: the camera, the time and the viewport.
+ *
+ * It lives in one uniform buffer, bound to FRAME_UNIFORMS_BINDING, which the
+ * Shader class attaches the FrameUniforms block of every program it links to
+ * (shaders/frame_uniforms.glsl declares the block). The buffer is written
+ * once per frame, so the programs need no per-program uploads for it.
+ *
+ * FrameUniformData is the block in std140 layout, checked member by member
+ * below; shaders/frame_uniforms.glsl has to stay in step with it.
+ *
+ * Like IndexRing, the buffer is persistently mapped where glBufferStorage is
+ * available and cut into SEGMENTS parts, one per frame in flight, each
+ * guarded by a fence; update() writes the next part and binds it with
+ * glBindBufferRange. Without buffer storage it falls back to a single part
+ * updated with glBufferSubData.
+ */
+struct FrameUniformData
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec4 viewport;    // width, height, 1 / width, 1 / height
+    float time;            // seconds since the start
+    float deltaTime;       // seconds since the previous frame
+    float padding[2];      // std140 rounds the block up to 16 bytes
+};
+
+static const GLuint FRAME_UNIFORMS_BINDING = 0;
+
+static_assert(sizeof(glm::mat4) == 64 && sizeof(glm::vec4) == 16, "glm types must be tightly packed floats");
+static_assert(offsetof(FrameUniformData, view) == 0, "std140 offset of view");
+static_assert(offsetof(FrameUniformData, projection) == 64, "std140 offset of projection");
+static_assert(offsetof(FrameUniformData, viewProjection) == 128, "std140 offset of viewProjection");
+static_assert(offsetof(FrameUniformData, viewport) == 192, "std140 offset of viewport");
+static_assert(offsetof(FrameUniformData, time) == 208, "std140 offset of time");
+static_assert(offsetof(FrameUniformData, deltaTime) == 212, "std140 offset of deltaTime");
+static_assert(sizeof(FrameUniformData) == 224, "std140 size of the FrameUniforms block");
+
+class FrameUniformBuffer
+{
+public:
+    static const unsigned int SEGMENTS = 3;
+
+    FrameUniformBuffer()
+        : buffer(0), mapped(nullptr), stride(0), segment(SEGMENTS - 1), stalls(0)
+    {
+        for (unsigned int i = 0; i < SEGMENTS; ++i)
+            fences[i] = 0;
+    }
+
+    FrameUniformBuffer(const FrameUniformBuffer&) = delete;
+    FrameUniformBuffer& operator=(const FrameUniformBuffer&) = delete;
+
+    // allocate the buffer; persistently mapped if buffer storage is there
+    // ------------------------------------------------------------------------
+    void create()
+    {
+        release();
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        if (alignment <= 0)
+            alignment = 256;
+        stride = (sizeof(FrameUniformData) + alignment - 1) / alignment * alignment;
+        glGenBuffers(1, &buffer);
+        GLState::current().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+        if (glBufferStorage)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_UNIFORM_BUFFER, (GLsizeiptr)(stride * SEGMENTS), NULL, flags);
+            mapped = static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)(stride * SEGMENTS), flags));
+            if (!mapped)
+                std::cout << "ERROR::FRAME_UNIFORMS::MAP_FAILED: " << glGetError() << std::endl;
+        }
+        if (!mapped)
+            glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)sizeof(FrameUniformData), NULL, GL_DYNAMIC_DRAW);
+        GLState::current().bindBuffer(GL_UNIFORM_BUFFER, 0);
+        segment = SEGMENTS - 1;
+    }
+
+    bool isMapped() const
+    {
+        return mapped != nullptr;
+    }
+
+    // write this frame's data and bind it to FRAME_UNIFORMS_BINDING
+    // ------------------------------------------------------------------------
+    void update(const FrameUniformData& data)
+    {
+        if (!mapped)
+        {
+            GLState::current().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniformData), &data);
+            GLState::current().bindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, buffer);
+            return;
+        }
+        segment = (segment + 1) % SEGMENTS;
+        waitFor(segment);
+        std::memcpy(mapped + segment * stride, &data, sizeof(FrameUniformData));
+        GLState::current().bindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, buffer,
+                                           (GLintptr)(segment * stride), (GLsizeiptr)sizeof(FrameUniformData));
+    }
+
+    // after the frame's last draw that reads the block
+    void fence()
+    {
+        if (!mapped)
+            return;
+        if (fences[segment])
+            glDeleteSync(fences[segment]);
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // frames that had to wait for the GPU to release their segment
+    size_t stallCount() const
+    {
+        return stalls;
+    }
+
+    // delete the buffer and the fences; needs the context, unlike the
+    // destructor
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        for (unsigned int i = 0; i < SEGMENTS; ++i)
+        {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        if (buffer)
+        {
+            if (mapped)
+            {
+                GLState::current().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+            }
+            GLState::current().forgetBuffer(buffer);
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        mapped = nullptr;
+    }
+
+private:
+    GLuint buffer;
+    char* mapped;
+    size_t stride;           // segment size, a multiple of the offset alignment
+    unsigned int segment;
+    GLsync fences[SEGMENTS];
+    size_t stalls;
+
+    void waitFor(unsigned int index)
+    {
+        GLsync sync = fences[index];
+        if (!sync)
+            return;
+        GLenum status = glClientWaitSync(sync, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            ++stalls;
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        }
+        if (status == GL_WAIT_FAILED)
+            std::cout << "ERROR::FRAME_UNIFORMS::WAIT_FAILED" << std::endl;
+        glDeleteSync(sync);
+        fences[index] = 0;
+    }
+};
+#endif
@@ -0,0 +1,369 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+/* The GL state the renderer changes, mirrored on the CPU so redundant calls
+ * never reach the driver.
+ *
+ * Every bind and state change goes through GLState::current() and is only
+ * issued if it differs from what was last set: the program, the vertex
+ * array, the buffer of each common target, the indexed uniform buffer
+ * ranges, the texture of each unit, and the blend, depth and cull state.
+ * stats() counts issued and skipped calls since resetStats(), which the
+ * render loop calls once per frame.
+ *
+ * Everything starts out unknown, so the first call always goes through.
+ * Code that changes this state behind the tracker's back has to call
+ * invalidate(); deleting an object has to be reported with the forget*()
+ * calls, since GL may hand its name out again. The element array binding
+ * belongs to the vertex array, so binding another vertex array forgets it.
+ *
+ * There is one GL context in this program, hence one tracker.
+ */
+struct GLStateStats
+{
+    size_t issued;       // calls passed on to GL
+    size_t skipped;      // calls dropped as redundant
+
+    GLStateStats() : issued(0), skipped(0) {}
+};
+
+class GLState
+{
+public:
+    enum
+    {
+        TEXTURE_UNITS = 16,
+        UNIFORM_BINDINGS = 16
+    };
+
+    static GLState& current()
+    {
+        static GLState state;
+        return state;
+    }
+
+    GLState(const GLState&) = delete;
+    GLState& operator=(const GLState&) = delete;
+
+    // objects
+    // ------------------------------------------------------------------------
+    void useProgram(GLuint program)
+    {
+        if (!changed(currentProgram, program))
+            return;
+        glUseProgram(program);
+    }
+
+    void bindVertexArray(GLuint vertexArray)
+    {
+        if (!changed(currentVertexArray, vertexArray))
+            return;
+        glBindVertexArray(vertexArray);
+        buffers[ELEMENT_ARRAY] = UNKNOWN;
+    }
+
+    void bindBuffer(GLenum target, GLuint buffer)
+    {
+        int slot = bufferSlot(target);
+        if (slot >= 0 && !changed(buffers[slot], buffer))
+            return;
+        if (slot < 0)
+            ++counters.issued;
+        glBindBuffer(target, buffer);
+    }
+
+    // indexed uniform buffer bindings; like GL, they also set the generic one
+    // ------------------------------------------------------------------------
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+    {
+        bindBufferRange(target, index, buffer, 0, 0);
+    }
+
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        if (target != GL_UNIFORM_BUFFER || index >= UNIFORM_BINDINGS)
+        {
+            ++counters.issued;
+            if (size == 0)
+                glBindBufferBase(target, index, buffer);
+            else
+                glBindBufferRange(target, index, buffer, offset, size);
+            int slot = bufferSlot(target);
+            if (slot >= 0)
+                buffers[slot] = buffer;
+            return;
+        }
+        IndexedBinding& binding = uniformBindings[index];
+        if (binding.buffer == buffer && binding.offset == offset && binding.size == size)
+        {
+            ++counters.skipped;
+            return;
+        }
+        ++counters.issued;
+        if (size == 0)
+            glBindBufferBase(target, index, buffer);
+        else
+            glBindBufferRange(target, index, buffer, offset, size);
+        binding.buffer = buffer;
+        binding.offset = offset;
+        binding.size = size;
+        buffers[UNIFORM] = buffer;
+    }
+
+    // `texture` on `unit`; only switches the active unit when binding
+    void bindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        int slot = textureSlot(target);
+        if (unit < TEXTURE_UNITS && slot >= 0 && !changed(textures[unit][slot], texture))
+            return;
+        if (unit >= TEXTURE_UNITS || slot < 0)
+            ++counters.issued;
+        if (activeUnit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+        }
+        glBindTexture(target, texture);
+    }
+
+    // fixed-function state
+    // ------------------------------------------------------------------------
+    void setEnabled(GLenum capability, bool enabled)
+    {
+        int slot = capabilitySlot(capability);
+        if (slot >= 0 && !changed(capabilities[slot], enabled ? 1u : 0u))
+            return;
+        if (slot < 0)
+            ++counters.issued;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    void enable(GLenum capability)
+    {
+        setEnabled(capability, true);
+    }
+
+    void disable(GLenum capability)
+    {
+        setEnabled(capability, false);
+    }
+
+    void blendFunc(GLenum source, GLenum destination)
+    {
+        bool same = blendSource == source && blendDestination == destination;
+        count(same);
+        if (same)
+            return;
+        glBlendFunc(source, destination);
+        blendSource = source;
+        blendDestination = destination;
+    }
+
+    void depthFunc(GLenum function)
+    {
+        if (!changed(depthFunction, function))
+            return;
+        glDepthFunc(function);
+    }
+
+    void depthMask(bool write)
+    {
+        if (!changed(depthWrite, write ? 1u : 0u))
+            return;
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void cullFace(GLenum face)
+    {
+        if (!changed(cullMode, face))
+            return;
+        glCullFace(face);
+    }
+
+    // deleted objects: GL unbinds buffers, vertex arrays and textures itself,
+    // a deleted program stays in use until another one is
+    // ------------------------------------------------------------------------
+    void forgetProgram(GLuint program)
+    {
+        if (currentProgram == program)
+            currentProgram = UNKNOWN;
+    }
+
+    void forgetVertexArray(GLuint vertexArray)
+    {
+        if (currentVertexArray == vertexArray)
+        {
+            currentVertexArray = 0;
+            buffers[ELEMENT_ARRAY] = UNKNOWN;
+        }
+    }
+
+    void forgetBuffer(GLuint buffer)
+    {
+        for (int i = 0; i < BUFFER_TARGETS; ++i)
+        {
+            if (buffers[i] == buffer)
+                buffers[i] = 0;
+        }
+        for (int i = 0; i < UNIFORM_BINDINGS; ++i)
+        {
+            if (uniformBindings[i].buffer == buffer)
+                uniformBindings[i] = IndexedBinding();
+        }
+        // the element array of vertex arrays that are not bound is unknown
+        // anyway, the next bindVertexArray() forgets it
+    }
+
+    void forgetTexture(GLuint texture)
+    {
+        for (int unit = 0; unit < TEXTURE_UNITS; ++unit)
+        {
+            for (int i = 0; i < TEXTURE_TARGETS; ++i)
+            {
+                if (textures[unit][i] == texture)
+                    textures[unit][i] = 0;
+            }
+        }
+    }
+
+    // forget everything, after code that changed the state directly
+    // ------------------------------------------------------------------------
+    void invalidate()
+    {
+        currentProgram = currentVertexArray = UNKNOWN;
+        for (int i = 0; i < BUFFER_TARGETS; ++i)
+            buffers[i] = UNKNOWN;
+        for (int i = 0; i < UNIFORM_BINDINGS; ++i)
+            uniformBindings[i] = IndexedBinding();
+        activeUnit = UNKNOWN;
+        for (int unit = 0; unit < TEXTURE_UNITS; ++unit)
+        {
+            for (int i = 0; i < TEXTURE_TARGETS; ++i)
+                textures[unit][i] = UNKNOWN;
+        }
+        for (int i = 0; i < CAPABILITIES; ++i)
+            capabilities[i] = UNKNOWN;
+        blendSource = blendDestination = depthFunction = cullMode = UNKNOWN;
+        depthWrite = UNKNOWN;
+    }
+
+    const GLStateStats& stats() const
+    {
+        return counters;
+    }
+
+    void resetStats()
+    {
+        counters = GLStateStats();
+    }
+
+private:
+    static const GLuint UNKNOWN = ~0u;
+
+    enum BufferTarget
+    {
+        ARRAY,
+        ELEMENT_ARRAY,
+        UNIFORM,
+        COPY_READ,
+        COPY_WRITE,
+        PIXEL_PACK,
+        PIXEL_UNPACK,
+        BUFFER_TARGETS
+    };
+
+    enum
+    {
+        TEXTURE_TARGETS = 4,     // 2D, 3D, cube map, 2D array
+        CAPABILITIES = 5         // blend, depth test, cull face, scissor test, stencil test
+    };
+
+    struct IndexedBinding
+    {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;          // 0 for the whole buffer
+
+        IndexedBinding() : buffer(UNKNOWN), offset(0), size(0) {}
+    };
+
+    GLStateStats counters;
+    GLuint currentProgram, currentVertexArray;
+    GLuint buffers[BUFFER_TARGETS];
+    IndexedBinding uniformBindings[UNIFORM_BINDINGS];
+    GLuint activeUnit;
+    GLuint textures[TEXTURE_UNITS][TEXTURE_TARGETS];
+    GLuint capabilities[CAPABILITIES];
+    GLenum blendSource, blendDestination, depthFunction, cullMode;
+    GLuint depthWrite;
+
+    GLState()
+    {
+        invalidate();
+    }
+
+    void count(bool redundant)
+    {
+        if (redundant)
+            ++counters.skipped;
+        else
+            ++counters.issued;
+    }
+
+    // true (and `tracked` updated) if the call has to be issued
+    bool changed(GLuint& tracked, GLuint value)
+    {
+        bool same = tracked == value;
+        count(same);
+        tracked = value;
+        return !same;
+    }
+
+    static int bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER:         return ARRAY;
+        case GL_ELEMENT_ARRAY_BUFFER: return ELEMENT_ARRAY;
+        case GL_UNIFORM_BUFFER:       return UNIFORM;
+        case GL_COPY_READ_BUFFER:     return COPY_READ;
+        case GL_COPY_WRITE_BUFFER:    return COPY_WRITE;
+        case GL_PIXEL_PACK_BUFFER:    return PIXEL_PACK;
+        case GL_PIXEL_UNPACK_BUFFER:  return PIXEL_UNPACK;
+        default:                      return -1;
+        }
+    }
+
+    static int textureSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D:       return 0;
+        case GL_TEXTURE_3D:       return 1;
+        case GL_TEXTURE_CUBE_MAP: return 2;
+        case GL_TEXTURE_2D_ARRAY: return 3;
+        default:                  return -1;
+        }
+    }
+
+    static int capabilitySlot(GLenum capability)
+    {
+        switch (capability)
+        {
+        case GL_BLEND:        return 0;
+        case GL_DEPTH_TEST:   return 1;
+        case GL_CULL_FACE:    return 2;
+        case GL_SCISSOR_TEST: return 3;
+        case GL_STENCIL_TEST: return 4;
+        default:              return -1;
+        }
+    }
+};
+#endif
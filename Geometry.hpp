@@ -0,0 +1,60 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/* Indexed triangle list as the CPU side of the renderer sees it.
+ *
+ * Vertices are interleaved floats, `stride` floats per vertex, and always
+ * start with the position (x, y, z) - the same layout the VBO uses, so the
+ * arrays can be handed to glBufferData unchanged.
+ *
+ * `generation` identifies the contents for caches built from them (the
+ * painter's TriangleSoA): every Geometry starts with a new one, and code
+ * that edits the arrays calls changed() to take the next. Copies share the
+ * generation of the contents they copied.
+ */
+struct Geometry
+{
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    unsigned int stride;
+    uint64_t generation;
+
+    Geometry() : stride(6), generation(nextGeneration()) {}
+
+    // call after editing vertices or indices
+    void changed()
+    {
+        generation = nextGeneration();
+    }
+
+    size_t vertexCount() const
+    {
+        return vertices.size() / stride;
+    }
+
+    size_t triangleCount() const
+    {
+        return indices.size() / 3;
+    }
+
+    glm::vec3 position(unsigned int vertex) const
+    {
+        const float* v = &vertices[(size_t)vertex * stride];
+        return glm::vec3(v[0], v[1], v[2]);
+    }
+
+private:
+    // unique across all geometries, so a cache cannot mistake one for another
+    static uint64_t nextGeneration()
+    {
+        static std::atomic<uint64_t> counter(0);
+        return ++counter;
+    }
+};
+#endif
@@ -0,0 +1,29 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* 64-bit FNV-1a. Not cryptographic - used to tell whether cached data on
+ * disk still belongs to the input it was built from.
+ */
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+const uint64_t FNV_PRIME = 1099511628211ull;
+
+inline uint64_t fnv1a64(const void* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// the same hash of a NUL-terminated string, usable in constant expressions
+constexpr uint64_t fnv1a64String(const char* text, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    return *text ? fnv1a64String(text + 1, (hash ^ (unsigned char)*text) * FNV_PRIME) : hash;
+}
+#endif
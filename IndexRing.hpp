@@ -0,0 +1,206 @@
+#ifndef INDEX_RING_H
+#define INDEX_RING_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include <GLState.hpp>
+
+/* Triple-buffered, persistently mapped element buffer for the per-frame
+ * index stream of the painter's algorithm.
+ *
+ * The buffer is allocated once with glBufferStorage (GL 4.4 or
+ * ARB_buffer_storage) and stays mapped, coherent, for its whole life. It is
+ * cut into SEGMENTS equal parts; every frame takes the next one, so the
+ * pipeline can write the indices straight into memory the GPU reads from,
+ * while the GPU may still be drawing from the other two. A fence placed
+ * after the draw guards each segment. map() waits on it before handing the
+ * segment out again, and counts a stall whenever it actually had to wait -
+ * the CPU has caught up with the GPU.
+ *
+ * A frame that needs more than a segment holds makes the ring grow: it waits
+ * for the GPU to finish with all segments and reallocates at twice the size.
+ * The GL objects are released by release(), which has to run while the
+ * context is still current - the destructor does not touch GL.
+ *
+ * Usage, once per frame, with the VAO bound:
+ *
+ *     unsigned int* out = ring.map(count);   // write `count` indices
+ *     glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, ring.offset());
+ *     ring.fence();
+ */
+struct RingStats
+{
+    size_t frames;
+    size_t stalls;       // frames that had to wait for their segment
+    double stallMs;      // total time spent waiting
+    double lastStallMs;
+    size_t grows;
+
+    RingStats() : frames(0), stalls(0), stallMs(0.0), lastStallMs(0.0), grows(0) {}
+};
+
+class IndexRing
+{
+public:
+    static const unsigned int SEGMENTS = 3;
+
+    IndexRing()
+        : buffer(0), mapped(nullptr), capacity(0), segment(SEGMENTS - 1)
+    {
+        for (unsigned int i = 0; i < SEGMENTS; ++i)
+            fences[i] = 0;
+    }
+
+    IndexRing(const IndexRing&) = delete;
+    IndexRing& operator=(const IndexRing&) = delete;
+
+    // glBufferStorage is there (the GL 4.4 entry point or ARB_buffer_storage
+    // loaded into it)
+    static bool supported()
+    {
+        return glBufferStorage != NULL;
+    }
+
+    // allocate room for `indices` indices per segment and bind the buffer as
+    // the element array of the current VAO; false if buffer storage is
+    // unavailable, the caller then keeps using a plain EBO
+    // ------------------------------------------------------------------------
+    bool create(size_t indices)
+    {
+        release();
+        if (!supported())
+            return false;
+        capacity = indices > 0 ? indices : 1;
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr size = (GLsizeiptr)(capacity * SEGMENTS * sizeof(unsigned int));
+        glGenBuffers(1, &buffer);
+        GLState::current().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+        glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, size, NULL, flags);
+        mapped = static_cast<unsigned int*>(glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, size, flags));
+        if (!mapped)
+        {
+            std::cout << "ERROR::INDEX_RING::MAP_FAILED: " << glGetError() << std::endl;
+            release();
+            return false;
+        }
+        segment = SEGMENTS - 1;
+        return true;
+    }
+
+    bool isCreated() const
+    {
+        return mapped != nullptr;
+    }
+
+    // the next segment, ready for `count` indices; call with the VAO bound,
+    // growing re-binds the buffer to it. nullptr if the ring had to grow and
+    // could not - it is released then, the caller goes back to a plain EBO
+    // ------------------------------------------------------------------------
+    unsigned int* map(size_t count)
+    {
+        if (count > capacity)
+        {
+            // the GPU may still read every segment, let it finish first
+            for (unsigned int i = 0; i < SEGMENTS; ++i)
+                waitFor(i, false);
+            size_t grown = capacity * 2 > count ? capacity * 2 : count;
+            if (!create(grown))
+                return nullptr;
+            ++frameStats.grows;
+        }
+        segment = (segment + 1) % SEGMENTS;
+        ++frameStats.frames;
+        frameStats.lastStallMs = 0.0;
+        waitFor(segment, true);
+        return mapped + segment * capacity;
+    }
+
+    // byte offset of the current segment, for the draw call
+    const void* offset() const
+    {
+        return reinterpret_cast<const void*>(segment * capacity * sizeof(unsigned int));
+    }
+
+    // after the draw that reads the current segment
+    void fence()
+    {
+        if (fences[segment])
+            glDeleteSync(fences[segment]);
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // indices per segment
+    size_t segmentCapacity() const
+    {
+        return capacity;
+    }
+
+    const RingStats& stats() const
+    {
+        return frameStats;
+    }
+
+    // unmap and delete the buffer and the fences
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        for (unsigned int i = 0; i < SEGMENTS; ++i)
+        {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        if (buffer)
+        {
+            GLState::current().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+            if (mapped)
+                glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+            GLState::current().forgetBuffer(buffer);
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        mapped = nullptr;
+        capacity = 0;
+    }
+
+private:
+    GLuint buffer;
+    unsigned int* mapped;
+    size_t capacity;
+    unsigned int segment;
+    GLsync fences[SEGMENTS];
+    RingStats frameStats;
+
+    void waitFor(unsigned int index, bool countStall)
+    {
+        GLsync sync = fences[index];
+        if (!sync)
+            return;
+        // a zero-timeout poll tells whether the GPU is already done
+        GLenum status = glClientWaitSync(sync, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            typedef std::chrono::steady_clock Clock;
+            Clock::time_point start = Clock::now();
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            if (status == GL_WAIT_FAILED)
+                std::cout << "ERROR::INDEX_RING::WAIT_FAILED" << std::endl;
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            if (countStall)
+            {
+                ++frameStats.stalls;
+                frameStats.stallMs += ms;
+                frameStats.lastStallMs = ms;
+            }
+        }
+        glDeleteSync(sync);
+        fences[index] = 0;
+    }
+};
+#endif
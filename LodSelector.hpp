@@ -0,0 +1,82 @@
+#ifndef LOD_SELECTOR_H
+#define LOD_SELECTOR_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+
+#include <Mesh.hpp>
+
+/* Picks the level of detail to draw a Mesh with, once per frame.
+ *
+ * A level's error (MeshLod::error, in the mesh's own units) is scaled into
+ * world units by the model matrix and projected at the distance of the
+ * nearest point of the sphere around the mesh's bounding box
+ * (Mesh::bounds()):
+ *
+ *     pixels = error * scale * projection[1][1] * viewportHeight / 2 / distance
+ *
+ * and the coarsest level that stays within maxPixelError() is chosen.
+ * Inside the bounding sphere the full mesh is always drawn.
+ */
+class LodSelector
+{
+public:
+    LodSelector() : maxError(1.0f), lastError(0.0f) {}
+
+    void setMaxPixelError(float pixels)
+    {
+        maxError = pixels;
+    }
+
+    float maxPixelError() const
+    {
+        return maxError;
+    }
+
+    // the level of `mesh` to draw; `model` takes the mesh's original units
+    // (after Mesh::decode()) to world space
+    // ------------------------------------------------------------------------
+    size_t select(const Mesh& mesh, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection,
+                  float viewportHeight)
+    {
+        lastError = 0.0f;
+        if (mesh.lodCount() < 2)
+            return 0;
+        const MeshBounds& bounds = mesh.bounds();
+        glm::vec4 center = view * model * glm::vec4(bounds.center, 1.0f);
+        glm::vec4 halfDiagonal = model * glm::vec4(bounds.extent, 0.0f);
+        float radius = glm::length(glm::vec3(halfDiagonal.x, halfDiagonal.y, halfDiagonal.z));
+        float distance = glm::length(glm::vec3(center.x, center.y, center.z)) - radius;
+        if (distance <= 0.0f)
+            return 0;
+        float scale = 0.0f;
+        for (int i = 0; i < 3; ++i)
+            scale = std::max(scale, glm::length(glm::vec3(model[i].x, model[i].y, model[i].z)));
+        float pixelsPerUnit = scale * projection[1][1] * 0.5f * viewportHeight / distance;
+
+        // errors only grow from one level to the next
+        size_t level = 0;
+        for (size_t i = 1; i < mesh.lodCount(); ++i)
+        {
+            float pixels = mesh.lod(i).error * pixelsPerUnit;
+            if (pixels > maxError)
+                break;
+            level = i;
+            lastError = pixels;
+        }
+        return level;
+    }
+
+    // projected error of the last selected level, in pixels
+    float pixelError() const
+    {
+        return lastError;
+    }
+
+private:
+    float maxError;
+    float lastError;
+};
+#endif
@@ -0,0 +1,109 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* A whole file mapped read-only into memory (POSIX mmap).
+ *
+ * The contents are used in place - nothing is copied, and pages are read in
+ * by the kernel as they are touched. The mapping stays valid until close()
+ * or destruction, but a file that is truncated while mapped makes reads past
+ * its new end fault, so files that may be rewritten should be re-opened
+ * rather than read again through an old mapping. An empty file opens fine
+ * with size() 0 and data() nullptr.
+ */
+class MappedFile
+{
+public:
+    MappedFile() : bytes(nullptr), length(0) {}
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) : bytes(other.bytes), length(other.length)
+    {
+        other.bytes = nullptr;
+        other.length = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other)
+    {
+        if (this != &other)
+        {
+            close();
+            bytes = other.bytes;
+            length = other.length;
+            other.bytes = nullptr;
+            other.length = 0;
+        }
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    // map `path`; false if it cannot be opened (no message, callers decide
+    // whether a missing file is an error)
+    // ------------------------------------------------------------------------
+    bool open(const std::string& path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        bool ok = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+        if (ok && info.st_size > 0)
+        {
+            void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = mapped != MAP_FAILED;
+            if (ok)
+            {
+                bytes = static_cast<const char*>(mapped);
+                length = (size_t)info.st_size;
+            }
+        }
+        ::close(fd);
+        return ok;
+    }
+
+    void close()
+    {
+        if (bytes)
+            munmap(const_cast<char*>(bytes), length);
+        bytes = nullptr;
+        length = 0;
+    }
+
+    // the kernel reads the whole file ahead instead of page by page
+    void adviseSequential() const
+    {
+        if (!bytes)
+            return;
+        madvise(const_cast<char*>(bytes), length, MADV_SEQUENTIAL);
+        madvise(const_cast<char*>(bytes), length, MADV_WILLNEED);
+    }
+
+    const char* data() const
+    {
+        return bytes;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+private:
+    const char* bytes;
+    size_t length;
+};
+#endif
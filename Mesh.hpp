@@ -0,0 +1,226 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include <GLState.hpp>
+#include <Geometry.hpp>
+#include <VertexFormat.hpp>
+
+/* A static indexed triangle mesh on the GPU: its VAO, VBO and EBO.
+ *
+ * create() uploads an EncodedMesh (see VertexFormat.hpp) as it is, one
+ * glBufferData per buffer, and sets the attribute pointers up for its
+ * format; the Geometry overload encodes first. Quantized positions come out
+ * in [-1, 1] - draw with model * decode() so the shader needs no changes.
+ * bounds() is the bounding box in the original units for every encoding;
+ * decode() only spans it for quantized positions.
+ *
+ * A mesh can carry levels of detail (MeshSimplifier.hpp): ranges of its
+ * index buffer over the same vertices, drawn with drawLod(); without them it
+ * has a single level, all of its indices.
+ *
+ * Meshes the painter's pipeline re-sorts every frame stay in the float
+ * layout of Geometry (split vertices are appended to them on the fly); Mesh
+ * is for everything drawn in a fixed order.
+ */
+struct MeshStats
+{
+    size_t vertices;
+    size_t triangles;           // of the full mesh
+    size_t lods;                // levels of detail, the full mesh included
+    unsigned int vertexSize;    // bytes per vertex
+    unsigned int indexSize;     // bytes per index
+    size_t bytes;               // vertex and index buffers together
+
+    MeshStats() : vertices(0), triangles(0), lods(0), vertexSize(0), indexSize(0), bytes(0) {}
+};
+
+class Mesh
+{
+public:
+    Mesh() : vao(0), vbo(0), ebo(0), indexType(GL_UNSIGNED_INT), normalFormat(NormalEncoding::None), decodeMatrix(1.0f) {}
+
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    // encode `geometry` in `format` and upload it
+    bool create(const Geometry& geometry, const VertexFormat& format = VertexFormat())
+    {
+        EncodedMesh encoded;
+        encodeMesh(geometry, format, encoded);
+        return create(encoded);
+    }
+
+    // upload buffers that are already in their GPU layout
+    // ------------------------------------------------------------------------
+    bool create(const EncodedMesh& mesh)
+    {
+        return create(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indexCount,
+                      mesh.indexType, mesh.format, mesh.normals, mesh.decode(), mesh.bounds, mesh.lods.data(),
+                      mesh.lods.size());
+    }
+
+    bool create(const void* vertices, size_t vertexBytes, const void* indexData, size_t indexCount, GLenum type,
+                const VertexFormat& format, bool normals, const glm::mat4& decode, const MeshBounds& bounds,
+                const MeshLod* lods = nullptr, size_t lodCount = 0)
+    {
+        release();
+        if (type != GL_UNSIGNED_SHORT && type != GL_UNSIGNED_INT)
+        {
+            std::cout << "ERROR::MESH::INDEX_TYPE: " << type << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < lodCount; ++i)
+        {
+            if ((size_t)lods[i].firstIndex + lods[i].indexCount > indexCount)
+            {
+                std::cout << "ERROR::MESH::LOD_OUT_OF_RANGE: " << i << std::endl;
+                return false;
+            }
+        }
+        GLState& state = GLState::current();
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        state.bindVertexArray(vao);
+        state.bindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexBytes, vertices, GL_STATIC_DRAW);
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        unsigned int indexSize = type == GL_UNSIGNED_SHORT ? 2 : 4;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(indexCount * indexSize), indexData, GL_STATIC_DRAW);
+
+        VertexAttribute attributes[3];
+        size_t count = format.attributes(normals, attributes);
+        GLsizei stride = (GLsizei)format.stride(normals);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const VertexAttribute& attribute = attributes[i];
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                                  stride, (void*)(size_t)attribute.offset);
+            glEnableVertexAttribArray(attribute.location);
+        }
+        state.bindVertexArray(0);
+
+        indexType = type;
+        normalFormat = normals ? format.normal : NormalEncoding::None;
+        decodeMatrix = decode;
+        box = bounds;
+        if (lodCount)
+            levels.assign(lods, lods + lodCount);
+        else
+        {
+            MeshLod full = { 0, (uint32_t)indexCount, 0.0f, 0 };
+            levels.assign(1, full);
+        }
+        info = MeshStats();
+        info.vertices = stride ? vertexBytes / (size_t)stride : 0;
+        info.triangles = levels[0].indexCount / 3;
+        info.lods = levels.size();
+        info.vertexSize = (unsigned int)stride;
+        info.indexSize = indexSize;
+        info.bytes = vertexBytes + indexCount * indexSize;
+        return true;
+    }
+
+    bool isCreated() const
+    {
+        return vao != 0;
+    }
+
+    // the full mesh
+    void draw() const
+    {
+        drawLod(0);
+    }
+
+    // level `level` of detail, 0 the full mesh
+    void drawLod(size_t level) const
+    {
+        if (level >= levels.size())
+            return;
+        const MeshLod& lod = levels[level];
+        draw(lod.firstIndex, lod.indexCount);
+    }
+
+    // `count` indices from `first` on
+    void draw(size_t first, size_t count) const
+    {
+        GLState::current().bindVertexArray(vao);
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+        glDrawElements(GL_TRIANGLES, (GLsizei)count, indexType, (void*)(first * indexSize));
+    }
+
+    // maps the stored positions to the original ones; multiply the model
+    // matrix by it
+    const glm::mat4& decode() const
+    {
+        return decodeMatrix;
+    }
+
+    // how the vertices carry their normal (location NORMAL_LOCATION), None
+    // without one; the shader needs the matching NORMALS features
+    NormalEncoding normalEncoding() const
+    {
+        return normalFormat;
+    }
+
+    // bounding box of the original positions (before encoding)
+    const MeshBounds& bounds() const
+    {
+        return box;
+    }
+
+    const MeshStats& stats() const
+    {
+        return info;
+    }
+
+    size_t lodCount() const
+    {
+        return levels.size();
+    }
+
+    const MeshLod& lod(size_t level) const
+    {
+        return levels[level];
+    }
+
+    // delete the GL objects; needs the context, unlike the destructor
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        GLState& state = GLState::current();
+        if (vao)
+        {
+            state.forgetVertexArray(vao);
+            glDeleteVertexArrays(1, &vao);
+        }
+        if (vbo)
+        {
+            state.forgetBuffer(vbo);
+            state.forgetBuffer(ebo);
+            glDeleteBuffers(1, &vbo);
+            glDeleteBuffers(1, &ebo);
+        }
+        vao = vbo = ebo = 0;
+        normalFormat = NormalEncoding::None;
+        levels.clear();
+        info = MeshStats();
+    }
+
+private:
+    GLuint vao, vbo, ebo;
+    GLenum indexType;
+    NormalEncoding normalFormat;
+    glm::mat4 decodeMatrix;
+    MeshBounds box;
+    std::vector<MeshLod> levels;
+    MeshStats info;
+};
+#endif
@@ -0,0 +1,290 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+
+#include <Hash.hpp>
+#include <MappedFile.hpp>
+#include <Mesh.hpp>
+#include <VertexFormat.hpp>
+
+/* Binary mesh cache (.mesh files): an EncodedMesh stored exactly as a Mesh
+ * uploads it, so loading one is an mmap and a glBufferData per buffer
+ * straight from the mapping - no parsing, no conversion.
+ *
+ *     header        MeshCacheHeader, 136 bytes
+ *     levels        lodCount MeshLod entries, 16 bytes each (version 2)
+ *     vertices      at vertexOffset, interleaved in the header's format
+ *     indices       at indexOffset, 16- or 32-bit, every level's
+ *
+ * Both payloads start on a MESH_CACHE_ALIGNMENT boundary. Files are written
+ * in the host byte order and are not meant to move between machines of
+ * different endianness; a foreign file fails the magic check.
+ *
+ * open() checks the header against the file size in every build; the
+ * checksum over the levels and payloads is only verified in debug builds
+ * (NDEBUG not defined), release builds do not touch the payload pages before
+ * upload.
+ */
+const uint64_t MESH_CACHE_ALIGNMENT = 64;
+const uint32_t MESH_CACHE_MAX_LODS = 16;
+
+struct MeshCacheHeader
+{
+    char magic[4];            // "MESH"
+    uint32_t version;
+    // the PositionEncoding / ColorEncoding / NormalEncoding values;
+    // reordering those enums needs a VERSION bump
+    uint8_t position;
+    uint8_t color;
+    uint8_t normal;
+    uint8_t normals;          // the vertices carry a normal
+    uint32_t indexType;       // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t stride;          // bytes per vertex
+    uint32_t lodCount;        // 0: a single level, all indices
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t vertexOffset;    // from the start of the file
+    uint64_t vertexBytes;
+    uint64_t indexOffset;
+    uint64_t indexBytes;
+    float offset[3];          // quantized position * scale + offset
+    float scale[3];
+    float center[3];          // bounding box in the original units (version 3)
+    float extent[3];
+    uint64_t sourceStamp;     // MeshCache::stampOf() the file it was converted from, or 0
+    uint64_t checksum;        // FNV-1a of the levels, the vertex, then the index payload
+};
+
+static_assert(sizeof(MeshCacheHeader) == 136, "MeshCacheHeader is part of the file format");
+static_assert(sizeof(MeshLod) == 16, "MeshLod is part of the file format");
+
+class MeshCache
+{
+public:
+    MeshCache() : info() {}
+
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+
+    // write `mesh` to `path` (through a temporary file, so a reader never
+    // sees half of it)
+    // ------------------------------------------------------------------------
+    static bool save(const std::string& path, const EncodedMesh& mesh, uint64_t sourceStamp = 0)
+    {
+        MeshCacheHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, magic(), 4);
+        header.version = VERSION;
+        header.position = (uint8_t)mesh.format.position;
+        header.color = (uint8_t)mesh.format.color;
+        header.normal = (uint8_t)mesh.format.normal;
+        header.normals = mesh.normals ? 1 : 0;
+        header.indexType = mesh.indexType;
+        header.stride = mesh.stride();
+        header.lodCount = (uint32_t)mesh.lods.size();
+        header.vertexCount = mesh.vertexCount;
+        header.indexCount = mesh.indexCount;
+        const size_t lodBytes = mesh.lods.size() * sizeof(MeshLod);
+        header.vertexOffset = align(sizeof(header) + lodBytes);
+        header.vertexBytes = mesh.vertices.size();
+        header.indexOffset = align(header.vertexOffset + header.vertexBytes);
+        header.indexBytes = mesh.indices.size();
+        for (int i = 0; i < 3; ++i)
+        {
+            header.offset[i] = mesh.offset[i];
+            header.scale[i] = mesh.scale[i];
+            header.center[i] = mesh.bounds.center[i];
+            header.extent[i] = mesh.bounds.extent[i];
+        }
+        header.sourceStamp = sourceStamp;
+        header.checksum = checksumOf(mesh.lods.data(), lodBytes, mesh.vertices.data(), mesh.vertices.size(),
+                                     mesh.indices.data(), mesh.indices.size());
+        if (mesh.lods.size() > MESH_CACHE_MAX_LODS)
+        {
+            std::cout << "ERROR::MESH_CACHE::TOO_MANY_LODS: " << mesh.lods.size() << std::endl;
+            return false;
+        }
+
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary.c_str(), std::ios::binary);
+            const char padding[MESH_CACHE_ALIGNMENT] = {};
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(mesh.lods.data()), (std::streamsize)lodBytes);
+            file.write(padding, (std::streamsize)(header.vertexOffset - sizeof(header) - lodBytes));
+            file.write(reinterpret_cast<const char*>(mesh.vertices.data()), (std::streamsize)header.vertexBytes);
+            file.write(padding, (std::streamsize)(header.indexOffset - header.vertexOffset - header.vertexBytes));
+            file.write(reinterpret_cast<const char*>(mesh.indices.data()), (std::streamsize)header.indexBytes);
+            if (!file)
+            {
+                std::cout << "ERROR::MESH_CACHE::FILE_NOT_SUCCESSFULLY_WRITTEN: " << temporary << std::endl;
+                return false;
+            }
+        }
+        return std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+    // identifies the current contents of `source` (size and modification
+    // time) without reading it; 0 if it does not exist
+    static uint64_t stampOf(const std::string& source)
+    {
+        struct stat info;
+        if (stat(source.c_str(), &info) != 0)
+            return 0;
+        uint64_t parts[3] = { (uint64_t)info.st_size, (uint64_t)info.st_mtim.tv_sec, (uint64_t)info.st_mtim.tv_nsec };
+        return fnv1a64(parts, sizeof(parts));
+    }
+
+    // map `path` and validate its header; false (with a message) if it is
+    // not a cache file this version reads, nothing is uploaded yet
+    // ------------------------------------------------------------------------
+    bool open(const std::string& path)
+    {
+        close();
+        if (!file.open(path))
+            return false;
+        if (file.size() < sizeof(MeshCacheHeader))
+            return fail("FILE_TRUNCATED", path);
+        std::memcpy(&info, file.data(), sizeof(info));
+        if (std::memcmp(info.magic, magic(), 4) != 0 || info.version != VERSION)
+            return fail("UNSUPPORTED_FILE", path);
+        if (info.position > (uint8_t)PositionEncoding::Snorm16 || info.color > (uint8_t)ColorEncoding::Rgba8 ||
+            info.normal > (uint8_t)NormalEncoding::Octahedral ||
+            (info.indexType != GL_UNSIGNED_SHORT && info.indexType != GL_UNSIGNED_INT) ||
+            info.stride != format().stride(info.normals != 0) || info.lodCount > MESH_CACHE_MAX_LODS)
+            return fail("BAD_HEADER", path);
+        // every size and offset is untrusted: the ranges are checked against
+        // the file size with divisions and subtractions that cannot wrap
+        const uint64_t size = file.size();
+        const uint64_t indexSize = info.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+        if (!fits(info.vertexOffset, info.vertexBytes, size) || !fits(info.indexOffset, info.indexBytes, size) ||
+            info.vertexCount > info.vertexBytes / info.stride || info.vertexBytes != info.vertexCount * info.stride ||
+            info.indexCount > info.indexBytes / indexSize || info.indexBytes != info.indexCount * indexSize ||
+            info.vertexOffset % MESH_CACHE_ALIGNMENT || info.indexOffset % MESH_CACHE_ALIGNMENT ||
+            info.vertexOffset < sizeof(info) + info.lodCount * sizeof(MeshLod) ||
+            info.indexOffset < info.vertexOffset || info.indexOffset - info.vertexOffset < info.vertexBytes)
+            return fail("FILE_TRUNCATED", path);
+        for (uint32_t i = 0; i < info.lodCount; ++i)
+        {
+            if ((uint64_t)lods()[i].firstIndex + lods()[i].indexCount > info.indexCount)
+                return fail("BAD_HEADER", path);
+        }
+#ifndef NDEBUG
+        if (checksumOf(lods(), info.lodCount * sizeof(MeshLod), vertices(), info.vertexBytes, indices(),
+                       info.indexBytes) != info.checksum)
+            return fail("CHECKSUM_MISMATCH", path);
+#endif
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return file.data() != nullptr;
+    }
+
+    // hand the mapped payloads to `mesh`; the cache can be closed afterwards
+    bool upload(Mesh& mesh) const
+    {
+        if (!isOpen())
+            return false;
+        return mesh.create(vertices(), (size_t)info.vertexBytes, indices(), (size_t)info.indexCount,
+                           (GLenum)info.indexType, format(), info.normals != 0, decode(), bounds(), lods(),
+                           info.lodCount);
+    }
+
+    void close()
+    {
+        file.close();
+        std::memset(&info, 0, sizeof(info));
+    }
+
+    const MeshCacheHeader& header() const
+    {
+        return info;
+    }
+
+    VertexFormat format() const
+    {
+        return VertexFormat((PositionEncoding)info.position, (ColorEncoding)info.color, (NormalEncoding)info.normal);
+    }
+
+    glm::mat4 decode() const
+    {
+        glm::vec3 offset(info.offset[0], info.offset[1], info.offset[2]);
+        glm::vec3 scale(info.scale[0], info.scale[1], info.scale[2]);
+        return glm::scale(glm::translate(glm::mat4(1.0f), offset), scale);
+    }
+
+    MeshBounds bounds() const
+    {
+        MeshBounds result;
+        result.center = glm::vec3(info.center[0], info.center[1], info.center[2]);
+        result.extent = glm::vec3(info.extent[0], info.extent[1], info.extent[2]);
+        return result;
+    }
+
+    const void* vertices() const
+    {
+        return file.data() + info.vertexOffset;
+    }
+
+    const void* indices() const
+    {
+        return file.data() + info.indexOffset;
+    }
+
+    // header().lodCount levels, right after the header
+    const MeshLod* lods() const
+    {
+        return reinterpret_cast<const MeshLod*>(file.data() + sizeof(MeshCacheHeader));
+    }
+
+private:
+    // 2: levels of detail, 3: bounding box
+    static const uint32_t VERSION = 3;
+
+    MappedFile file;
+    MeshCacheHeader info;
+
+    static const char* magic()
+    {
+        return "MESH";
+    }
+
+    // [offset, offset + bytes) lies within `size` bytes
+    static bool fits(uint64_t offset, uint64_t bytes, uint64_t size)
+    {
+        return bytes <= size && offset <= size - bytes;
+    }
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+    }
+
+    static uint64_t checksumOf(const void* lodData, size_t lodBytes, const void* vertexData, size_t vertexBytes,
+                               const void* indexData, size_t indexBytes)
+    {
+        return fnv1a64(indexData, indexBytes, fnv1a64(vertexData, vertexBytes, fnv1a64(lodData, lodBytes)));
+    }
+
+    bool fail(const char* error, const std::string& path)
+    {
+        std::cout << "ERROR::MESH_CACHE::" << error << ": " << path << std::endl;
+        close();
+        return false;
+    }
+};
+#endif
@@ -0,0 +1,1197 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Geometry.hpp>
+#include <MappedFile.hpp>
+#include <ThreadPool.hpp>
+
+/* Wavefront OBJ and PLY (ASCII, binary little and big endian) into a
+ * Geometry: position, color and - if the file has them - normal, ready for
+ * encodeMesh() and Mesh.
+ *
+ * The file is mmapped and parsed in place by all threads of a ThreadPool:
+ * text is split into line-aligned chunks, binary PLY into record ranges.
+ * Numbers go through a small decimal parser instead of strtod (no locale,
+ * no copies). Results are merged in chunk order, so the output does not
+ * depend on the thread count.
+ *
+ * OBJ faces refer to positions and normals separately; every distinct
+ * (position, normal) pair becomes one vertex. The pairs are deduplicated in
+ * a lock-free hash table shared by all threads, and vertices are numbered
+ * in the order of their first use. Polygons are triangulated as fans; "v"
+ * lines may carry an RGB color after the position, texture coordinates are
+ * ignored. PLY vertices are taken as they are, with the usual property
+ * names (x y z, nx ny nz, red green blue); faces come from the vertex_indices
+ * (or vertex_index) list.
+ *
+ * Vertices without a color get MESH_DEFAULT_COLOR (the grey the shaders use
+ * without VERTEX_COLORS). In an OBJ with normals, corners that name none
+ * ("f a" next to "f a//n") take the normal of the first triangle they
+ * appear in. Up to 2^32 - 2 face corners.
+ */
+const float MESH_DEFAULT_COLOR = 0.8f;
+
+struct MeshLoadStats
+{
+    size_t bytes;          // size of the file
+    size_t positions;      // as read (OBJ "v" lines, PLY vertices)
+    size_t vertices;       // after deduplication
+    size_t triangles;
+    unsigned int chunks;   // parsed in parallel
+    double parseMs;        // chunks parsed and merged
+    double dedupMs;        // OBJ corners deduplicated into vertices
+    double totalMs;        // from open() to the finished Geometry
+
+    MeshLoadStats()
+        : bytes(0), positions(0), vertices(0), triangles(0), chunks(0), parseMs(0.0), dedupMs(0.0), totalMs(0.0)
+    {
+    }
+
+    // MB of file per second of parsing
+    double throughput() const
+    {
+        return parseMs > 0.0 ? bytes / (parseMs * 1000.0) : 0.0;
+    }
+};
+
+class MeshLoader
+{
+public:
+    explicit MeshLoader(ThreadPool& pool) : pool(pool) {}
+
+    MeshLoader(const MeshLoader&) = delete;
+    MeshLoader& operator=(const MeshLoader&) = delete;
+
+    // the mesh in `path`, by its extension (.obj or .ply); false if the file
+    // cannot be read or is malformed, `out` is then empty
+    // ------------------------------------------------------------------------
+    bool load(const std::string& path, Geometry& out)
+    {
+        Clock::time_point start = Clock::now();
+        loadStats = MeshLoadStats();
+        out.vertices.clear();
+        out.indices.clear();
+        out.stride = 6;
+        MappedFile file;
+        if (!file.open(path))
+        {
+            std::cout << "ERROR::MESH_LOADER::FILE_NOT_READ: " << path << std::endl;
+            return false;
+        }
+        file.adviseSequential();
+        loadStats.bytes = file.size();
+        bool loaded = false;
+        if (hasExtension(path, ".obj"))
+            loaded = loadObj(file.data(), file.size(), out);
+        else if (hasExtension(path, ".ply"))
+            loaded = loadPly(file.data(), file.size(), out);
+        else
+            std::cout << "ERROR::MESH_LOADER::UNKNOWN_FORMAT: " << path << std::endl;
+        if (!loaded)
+        {
+            std::cout << "ERROR::MESH_LOADER::LOAD_FAILED: " << path << std::endl;
+            out.vertices.clear();
+            out.indices.clear();
+            return false;
+        }
+        out.changed();
+        loadStats.vertices = out.vertexCount();
+        loadStats.triangles = out.triangleCount();
+        loadStats.totalMs = msSince(start);
+        return true;
+    }
+
+    const MeshLoadStats& stats() const
+    {
+        return loadStats;
+    }
+
+    // a decimal number (optional sign, digits, fraction, exponent) at `p`,
+    // after blanks; advances `p` past it, false if there is none
+    // ------------------------------------------------------------------------
+    static bool parseNumber(const char*& p, const char* end, double& value)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            ++p;
+        const char* at = p;
+        bool negative = false;
+        if (at < end && (*at == '-' || *at == '+'))
+            negative = *at++ == '-';
+        uint64_t mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool any = false;
+        for (; at < end && (unsigned)(*at - '0') < 10; ++at, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (unsigned)(*at - '0');
+                digits += mantissa != 0;
+            }
+            else
+                ++exponent;
+        }
+        if (at < end && *at == '.')
+        {
+            for (++at; at < end && (unsigned)(*at - '0') < 10; ++at, any = true)
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (unsigned)(*at - '0');
+                    digits += mantissa != 0;
+                    --exponent;
+                }
+            }
+        }
+        if (!any)
+            return false;
+        if (at < end && (*at == 'e' || *at == 'E'))
+        {
+            const char* e = at + 1;
+            bool negativeExponent = false;
+            if (e < end && (*e == '-' || *e == '+'))
+                negativeExponent = *e++ == '-';
+            if (e < end && (unsigned)(*e - '0') < 10)
+            {
+                int power = 0;
+                for (; e < end && (unsigned)(*e - '0') < 10; ++e)
+                    power = power < 10000 ? power * 10 + (*e - '0') : power;
+                exponent += negativeExponent ? -power : power;
+                at = e;
+            }
+        }
+        // exact powers of ten up to 1e22 keep this correctly rounded for
+        // mantissas below 2^53
+        static const double powers[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                         1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        double result = (double)mantissa;
+        if (mantissa == 0)
+            result = 0.0;
+        else if (exponent >= 0 && exponent <= 22)
+            result *= powers[exponent];
+        else if (exponent < 0 && exponent >= -22)
+            result /= powers[-exponent];
+        else
+            result *= std::pow(10.0, exponent);
+        value = negative ? -result : result;
+        p = at;
+        return true;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum : uint32_t
+    {
+        NONE = 0xffffffffu        // no normal, or an index still to be resolved
+    };
+    enum
+    {
+        MIN_CHUNK = 256 * 1024    // bytes of text per chunk at least
+    };
+
+    ThreadPool& pool;
+    MeshLoadStats loadStats;
+
+    static double msSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    static bool hasExtension(const std::string& path, const char* extension)
+    {
+        size_t length = std::strlen(extension);
+        if (path.size() < length)
+            return false;
+        for (size_t i = 0; i < length; ++i)
+        {
+            char c = path[path.size() - length + i];
+            if ((c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c) != extension[i])
+                return false;
+        }
+        return true;
+    }
+
+    // chunk boundaries of [begin, end), each but the first starting a line
+    // ------------------------------------------------------------------------
+    std::vector<const char*> splitLines(const char* begin, const char* end)
+    {
+        size_t size = (size_t)(end - begin);
+        unsigned int chunks = pool.chunksFor(size, MIN_CHUNK) * 4;
+        if ((size_t)chunks > size / MIN_CHUNK)
+            chunks = size / MIN_CHUNK > 0 ? (unsigned int)(size / MIN_CHUNK) : 1;
+        std::vector<const char*> bounds(1, begin);
+        for (unsigned int i = 1; i < chunks; ++i)
+        {
+            const char* at = begin + size * i / chunks;
+            if (at < bounds.back())
+                at = bounds.back();
+            const char* newline = static_cast<const char*>(std::memchr(at, '\n', (size_t)(end - at)));
+            at = newline ? newline + 1 : end;
+            if (at > bounds.back() && at < end)
+                bounds.push_back(at);
+        }
+        bounds.push_back(end);
+        return bounds;
+    }
+
+    static const char* lineEnd(const char* p, const char* end)
+    {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', (size_t)(end - p)));
+        return newline ? newline : end;
+    }
+
+    static bool parseFloat(const char*& p, const char* end, float& value)
+    {
+        double parsed;
+        if (!parseNumber(p, end, parsed))
+            return false;
+        value = (float)parsed;
+        return true;
+    }
+
+    // a signed integer, for OBJ indices; magnitudes past 2^32 saturate there
+    // (no index can be that large, the caller rejects them)
+    static bool parseInteger(const char*& p, const char* end, int64_t& value)
+    {
+        const int64_t LIMIT = (int64_t)1 << 32;
+        const char* at = p;
+        bool negative = false;
+        if (at < end && (*at == '-' || *at == '+'))
+            negative = *at++ == '-';
+        if (at >= end || (unsigned)(*at - '0') >= 10)
+            return false;
+        int64_t result = 0;
+        for (; at < end && (unsigned)(*at - '0') < 10; ++at)
+            result = std::min(result * 10 + (*at - '0'), LIMIT);
+        value = negative ? -result : result;
+        p = at;
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    // OBJ
+
+    // a face corner referring to a position or normal by a negative index,
+    // resolved once the counts before the chunk are known
+    struct ObjFixup
+    {
+        size_t corner;          // in the chunk
+        int64_t position;       // chunk-relative if relativePosition
+        int64_t normal;
+        bool relativePosition, relativeNormal;
+    };
+
+    struct ObjChunk
+    {
+        std::vector<float> positions;    // x y z
+        std::vector<float> colors;       // r g b per position once one had a color
+        std::vector<float> normals;      // x y z
+        std::vector<uint32_t> corners;   // position, normal (NONE) pairs, 3 per triangle
+        std::vector<ObjFixup> fixups;
+        bool colored;
+        bool malformed;
+
+        ObjChunk() : colored(false), malformed(false) {}
+    };
+
+    static void parseObjChunk(const char* p, const char* end, ObjChunk& chunk)
+    {
+        std::vector<uint32_t> face;           // corner pairs of the current polygon
+        std::vector<ObjFixup> faceFixups;     // indexed by corner within the face
+        while (p < end && !chunk.malformed)
+        {
+            const char* eol = lineEnd(p, end);
+            while (p < eol && (*p == ' ' || *p == '\t'))
+                ++p;
+            if (eol - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+            {
+                const char* at = p + 2;
+                float xyz[3], rgb[3];
+                for (int i = 0; i < 3 && !chunk.malformed; ++i)
+                    chunk.malformed = !parseFloat(at, eol, xyz[i]);
+                chunk.positions.insert(chunk.positions.end(), xyz, xyz + 3);
+                bool colored = parseFloat(at, eol, rgb[0]) && parseFloat(at, eol, rgb[1]) && parseFloat(at, eol, rgb[2]);
+                if (colored && !chunk.colored)
+                {
+                    chunk.colors.assign(chunk.positions.size() - 3, MESH_DEFAULT_COLOR);
+                    chunk.colored = true;
+                }
+                if (chunk.colored)
+                {
+                    for (int i = 0; i < 3; ++i)
+                        chunk.colors.push_back(colored ? rgb[i] : MESH_DEFAULT_COLOR);
+                }
+            }
+            else if (eol - p >= 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+            {
+                const char* at = p + 3;
+                float xyz[3];
+                for (int i = 0; i < 3 && !chunk.malformed; ++i)
+                    chunk.malformed = !parseFloat(at, eol, xyz[i]);
+                chunk.normals.insert(chunk.normals.end(), xyz, xyz + 3);
+            }
+            else if (eol - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+                parseObjFace(p + 2, eol, chunk, face, faceFixups);
+            p = eol < end ? eol + 1 : end;
+        }
+    }
+
+    // "f a a/b a/b/c a//c ...", triangulated as a fan
+    // ------------------------------------------------------------------------
+    static void parseObjFace(const char* p, const char* eol, ObjChunk& chunk, std::vector<uint32_t>& face,
+                             std::vector<ObjFixup>& faceFixups)
+    {
+        face.clear();
+        faceFixups.clear();
+        const size_t positionsBefore = chunk.positions.size() / 3;
+        const size_t normalsBefore = chunk.normals.size() / 3;
+        for (;;)
+        {
+            while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+                ++p;
+            if (p >= eol)
+                break;
+            int64_t position = 0, texture = 0, normal = 0;
+            bool hasNormal = false;
+            if (!parseInteger(p, eol, position) || position == 0)
+            {
+                chunk.malformed = true;
+                return;
+            }
+            if (p < eol && *p == '/')
+            {
+                ++p;
+                if (p < eol && *p != '/')
+                    parseInteger(p, eol, texture);
+                if (p < eol && *p == '/')
+                {
+                    ++p;
+                    hasNormal = parseInteger(p, eol, normal) && normal != 0;
+                }
+            }
+            ObjFixup fixup;
+            fixup.corner = face.size() / 2;
+            fixup.relativePosition = position < 0;
+            fixup.relativeNormal = hasNormal && normal < 0;
+            fixup.position = position < 0 ? (int64_t)positionsBefore + position : position - 1;
+            fixup.normal = !hasNormal ? -1 : normal < 0 ? (int64_t)normalsBefore + normal : normal - 1;
+            if ((!fixup.relativePosition && fixup.position >= NONE) ||
+                (hasNormal && !fixup.relativeNormal && fixup.normal >= NONE))
+            {
+                chunk.malformed = true;
+                return;
+            }
+            face.push_back(fixup.relativePosition ? NONE : (uint32_t)fixup.position);
+            face.push_back(!hasNormal || fixup.relativeNormal ? NONE : (uint32_t)fixup.normal);
+            if (fixup.relativePosition || fixup.relativeNormal)
+                faceFixups.push_back(fixup);
+        }
+        size_t count = face.size() / 2;
+        if (count < 3)
+            return;
+        // fan around the first corner; fixups follow their corners
+        for (size_t i = 1; i + 1 < count; ++i)
+        {
+            const size_t fan[3] = { 0, i, i + 1 };
+            for (int c = 0; c < 3; ++c)
+            {
+                for (size_t f = 0; f < faceFixups.size(); ++f)
+                {
+                    if (faceFixups[f].corner != fan[c])
+                        continue;
+                    ObjFixup moved = faceFixups[f];
+                    moved.corner = chunk.corners.size() / 2;
+                    chunk.fixups.push_back(moved);
+                }
+                chunk.corners.push_back(face[fan[c] * 2]);
+                chunk.corners.push_back(face[fan[c] * 2 + 1]);
+            }
+        }
+    }
+
+    bool loadObj(const char* data, size_t size, Geometry& out)
+    {
+        Clock::time_point start = Clock::now();
+        std::vector<const char*> bounds = splitLines(data, data + size);
+        unsigned int chunkCount = (unsigned int)bounds.size() - 1;
+        std::vector<ObjChunk> chunks(chunkCount);
+        auto parse = [&](unsigned int i) { parseObjChunk(bounds[i], bounds[i + 1], chunks[i]); };
+        pool.run(chunkCount, parse);
+        loadStats.chunks = chunkCount;
+
+        // where each chunk's positions, normals and corners go
+        std::vector<size_t> positionBase(chunkCount + 1, 0), normalBase(chunkCount + 1, 0),
+            cornerBase(chunkCount + 1, 0);
+        bool colors = false;
+        for (unsigned int i = 0; i < chunkCount; ++i)
+        {
+            if (chunks[i].malformed)
+            {
+                std::cout << "ERROR::MESH_LOADER::MALFORMED_OBJ: in chunk " << i << std::endl;
+                return false;
+            }
+            positionBase[i + 1] = positionBase[i] + chunks[i].positions.size() / 3;
+            normalBase[i + 1] = normalBase[i] + chunks[i].normals.size() / 3;
+            cornerBase[i + 1] = cornerBase[i] + chunks[i].corners.size() / 2;
+            colors = colors || chunks[i].colored;
+        }
+        const size_t positionCount = positionBase[chunkCount], normalCount = normalBase[chunkCount];
+        const size_t cornerCount = cornerBase[chunkCount];
+        if (cornerCount >= NONE)
+        {
+            std::cout << "ERROR::MESH_LOADER::TOO_MANY_CORNERS: " << cornerCount << std::endl;
+            return false;
+        }
+        loadStats.positions = positionCount;
+
+        std::vector<float> positions(positionCount * 3), normals(normalCount * 3);
+        std::vector<float> vertexColors(colors ? positionCount * 3 : 0);
+        std::vector<uint32_t> corners(cornerCount * 2);
+        std::atomic<bool> outOfRange(false);
+        auto merge = [&](unsigned int i)
+        {
+            ObjChunk& chunk = chunks[i];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + positionBase[i] * 3);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normalBase[i] * 3);
+            if (colors && !chunk.colored)
+                std::fill(vertexColors.begin() + positionBase[i] * 3, vertexColors.begin() + positionBase[i + 1] * 3,
+                          MESH_DEFAULT_COLOR);
+            else
+                std::copy(chunk.colors.begin(), chunk.colors.end(), vertexColors.begin() + positionBase[i] * 3);
+            uint32_t* target = corners.data() + cornerBase[i] * 2;
+            std::copy(chunk.corners.begin(), chunk.corners.end(), target);
+            // resolved in 64 bits and range-checked before narrowing, so an
+            // index far before the first position cannot wrap into range
+            for (const ObjFixup& fixup : chunk.fixups)
+            {
+                if (fixup.relativePosition)
+                {
+                    int64_t position = (int64_t)positionBase[i] + fixup.position;
+                    if (position < 0 || position >= (int64_t)positionCount)
+                        outOfRange = true;
+                    else
+                        target[fixup.corner * 2] = (uint32_t)position;
+                }
+                if (fixup.relativeNormal)
+                {
+                    int64_t normal = (int64_t)normalBase[i] + fixup.normal;
+                    if (normal < 0 || normal >= (int64_t)normalCount)
+                        outOfRange = true;
+                    else
+                        target[fixup.corner * 2 + 1] = (uint32_t)normal;
+                }
+            }
+            for (size_t c = 0; c < chunk.corners.size(); c += 2)
+            {
+                if (target[c] >= positionCount || (target[c + 1] != NONE && target[c + 1] >= normalCount))
+                    outOfRange = true;
+            }
+            std::vector<float>().swap(chunk.positions);
+            std::vector<uint32_t>().swap(chunk.corners);
+        };
+        pool.run(chunkCount, merge);
+        if (outOfRange)
+        {
+            std::cout << "ERROR::MESH_LOADER::INDEX_OUT_OF_RANGE" << std::endl;
+            return false;
+        }
+        loadStats.parseMs = msSince(start);
+
+        start = Clock::now();
+        dedupObj(positions, vertexColors, normals, corners, normalCount > 0, out);
+        loadStats.dedupMs = msSince(start);
+        return true;
+    }
+
+    // one vertex per distinct (position, normal) corner, numbered in the
+    // order of first use
+    // ------------------------------------------------------------------------
+    void dedupObj(const std::vector<float>& positions, const std::vector<float>& colors,
+                  const std::vector<float>& normals, const std::vector<uint32_t>& corners, bool withNormals,
+                  Geometry& out)
+    {
+        const size_t cornerCount = corners.size() / 2;
+        size_t capacity = 16;
+        while (capacity < cornerCount + cornerCount / 2)
+            capacity *= 2;
+        const uint64_t EMPTY = ~(uint64_t)0;
+        std::unique_ptr<std::atomic<uint64_t>[]> keys(new std::atomic<uint64_t>[capacity]);
+        std::unique_ptr<std::atomic<uint32_t>[]> first(new std::atomic<uint32_t>[capacity]);
+        std::vector<size_t> slotOf(cornerCount);   // the table outgrows 32 bits past ~2.8e9 corners
+        const unsigned int chunks = pool.chunksFor(capacity > cornerCount ? capacity : cornerCount, 64 * 1024) * 4;
+
+        auto clear = [&](unsigned int chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(capacity, chunks, chunk, begin, end);
+            for (size_t i = begin; i < end; ++i)
+            {
+                keys[i].store(EMPTY, std::memory_order_relaxed);
+                first[i].store(NONE, std::memory_order_relaxed);
+            }
+        };
+        pool.run(chunks, clear);
+
+        // 1. every corner claims the slot of its key; the lowest corner wins
+        auto insert = [&](unsigned int chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(cornerCount, chunks, chunk, begin, end);
+            for (size_t c = begin; c < end; ++c)
+            {
+                uint64_t key = (uint64_t)corners[c * 2] << 32 | corners[c * 2 + 1];
+                size_t slot = (size_t)(mix(key) & (capacity - 1));
+                for (;; slot = (slot + 1) & (capacity - 1))
+                {
+                    uint64_t found = keys[slot].load(std::memory_order_relaxed);
+                    if (found == EMPTY && keys[slot].compare_exchange_strong(found, key))
+                        break;
+                    if (found == key)
+                        break;
+                }
+                uint32_t current = first[slot].load(std::memory_order_relaxed);
+                while ((uint32_t)c < current && !first[slot].compare_exchange_weak(current, (uint32_t)c))
+                {
+                }
+                slotOf[c] = slot;
+            }
+        };
+        pool.run(chunks, insert);
+
+        // 2. number the winners in corner order
+        std::vector<size_t> newPerChunk(chunks + 1, 0);
+        auto count = [&](unsigned int chunk)
+        {
+            size_t begin, end, fresh = 0;
+            ThreadPool::chunkRange(cornerCount, chunks, chunk, begin, end);
+            for (size_t c = begin; c < end; ++c)
+                fresh += first[slotOf[c]].load(std::memory_order_relaxed) == (uint32_t)c;
+            newPerChunk[chunk + 1] = fresh;
+        };
+        pool.run(chunks, count);
+        for (unsigned int i = 0; i < chunks; ++i)
+            newPerChunk[i + 1] += newPerChunk[i];
+        const size_t vertexCount = newPerChunk[chunks];
+
+        out.stride = withNormals ? 9 : 6;
+        out.vertices.assign(vertexCount * out.stride, 0.0f);
+        out.indices.assign(cornerCount, 0);
+        auto number = [&](unsigned int chunk)
+        {
+            size_t begin, end, next = newPerChunk[chunk];
+            ThreadPool::chunkRange(cornerCount, chunks, chunk, begin, end);
+            for (size_t c = begin; c < end; ++c)
+            {
+                if (first[slotOf[c]].load(std::memory_order_relaxed) != (uint32_t)c)
+                    continue;
+                out.indices[c] = (unsigned int)next;
+                float* v = &out.vertices[next * out.stride];
+                size_t position = corners[c * 2], normal = corners[c * 2 + 1];
+                std::memcpy(v, &positions[position * 3], 3 * sizeof(float));
+                if (colors.empty())
+                    v[3] = v[4] = v[5] = MESH_DEFAULT_COLOR;
+                else
+                    std::memcpy(v + 3, &colors[position * 3], 3 * sizeof(float));
+                if (withNormals && normal != NONE)
+                    std::memcpy(v + 6, &normals[normal * 3], 3 * sizeof(float));
+                else if (withNormals)
+                    faceNormal(positions, &corners[c / 3 * 6], v + 6);
+                ++next;
+            }
+        };
+        pool.run(chunks, number);
+
+        // 3. the other corners take the number of their slot's winner
+        auto resolve = [&](unsigned int chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(cornerCount, chunks, chunk, begin, end);
+            for (size_t c = begin; c < end; ++c)
+            {
+                uint32_t winner = first[slotOf[c]].load(std::memory_order_relaxed);
+                if (winner != (uint32_t)c)
+                    out.indices[c] = out.indices[winner];
+            }
+        };
+        pool.run(chunks, resolve);
+    }
+
+    // the unit normal of the triangle whose corner pairs start at `corners`,
+    // for corners without one in a file that has normals; +z if the
+    // triangle has no area, never the zero vector the shader cannot normalize
+    static void faceNormal(const std::vector<float>& positions, const uint32_t* corners, float* normal)
+    {
+        const float* a = &positions[corners[0] * (size_t)3];
+        const float* b = &positions[corners[2] * (size_t)3];
+        const float* c = &positions[corners[4] * (size_t)3];
+        float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float w[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float n[3] = { u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2], u[0] * w[1] - u[1] * w[0] };
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (!(length > 0.0f))
+        {
+            normal[0] = normal[1] = 0.0f;
+            normal[2] = 1.0f;
+            return;
+        }
+        for (int i = 0; i < 3; ++i)
+            normal[i] = n[i] / length;
+    }
+
+    // 64-bit finalizer (MurmurHash3), spreads the packed indices over the table
+    static uint64_t mix(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        key ^= key >> 33;
+        return key;
+    }
+
+    // ------------------------------------------------------------------------
+    // PLY
+
+    enum PlyType
+    {
+        PLY_INVALID,
+        PLY_INT8,
+        PLY_UINT8,
+        PLY_INT16,
+        PLY_UINT16,
+        PLY_INT32,
+        PLY_UINT32,
+        PLY_FLOAT32,
+        PLY_FLOAT64
+    };
+
+    enum PlyRole
+    {
+        ROLE_NONE,
+        ROLE_X, ROLE_Y, ROLE_Z,
+        ROLE_NX, ROLE_NY, ROLE_NZ,
+        ROLE_RED, ROLE_GREEN, ROLE_BLUE,
+        ROLE_INDICES
+    };
+
+    struct PlyProperty
+    {
+        PlyType type;
+        PlyType countType;     // PLY_INVALID unless a list
+        PlyRole role;
+    };
+
+    struct PlyElement
+    {
+        std::string name;
+        size_t count;
+        std::vector<PlyProperty> properties;
+    };
+
+    enum PlyFormat
+    {
+        PLY_ASCII,
+        PLY_BINARY_LITTLE,
+        PLY_BINARY_BIG
+    };
+
+    static PlyType plyType(const std::string& name)
+    {
+        if (name == "char" || name == "int8")
+            return PLY_INT8;
+        if (name == "uchar" || name == "uint8")
+            return PLY_UINT8;
+        if (name == "short" || name == "int16")
+            return PLY_INT16;
+        if (name == "ushort" || name == "uint16")
+            return PLY_UINT16;
+        if (name == "int" || name == "int32")
+            return PLY_INT32;
+        if (name == "uint" || name == "uint32")
+            return PLY_UINT32;
+        if (name == "float" || name == "float32")
+            return PLY_FLOAT32;
+        if (name == "double" || name == "float64")
+            return PLY_FLOAT64;
+        return PLY_INVALID;
+    }
+
+    static size_t plySize(PlyType type)
+    {
+        static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+        return sizes[type];
+    }
+
+    // bytes a record of `element` takes at least in a binary file: its
+    // scalars and list counts, the lists empty
+    static size_t plyMinRecordSize(const PlyElement& element)
+    {
+        size_t size = 0;
+        for (const PlyProperty& property : element.properties)
+            size += plySize(property.countType != PLY_INVALID ? property.countType : property.type);
+        return size;
+    }
+
+    // a vertex index read as a double; out of any range if it is not one
+    static uint32_t plyIndex(double value)
+    {
+        return value >= 0.0 && value < 4294967295.0 ? (uint32_t)value : ~0u;
+    }
+
+    static PlyRole plyRole(const std::string& name, bool list)
+    {
+        if (list)
+            return name == "vertex_indices" || name == "vertex_index" ? ROLE_INDICES : ROLE_NONE;
+        static const char* const names[] = { "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue" };
+        for (int i = 0; i < 9; ++i)
+        {
+            if (name == names[i])
+                return (PlyRole)(ROLE_X + i);
+        }
+        if (name == "r" || name == "g" || name == "b")
+            return name == "r" ? ROLE_RED : name == "g" ? ROLE_GREEN : ROLE_BLUE;
+        return ROLE_NONE;
+    }
+
+    // the words of the header line at `p`
+    static std::vector<std::string> words(const char* p, const char* eol)
+    {
+        std::vector<std::string> result;
+        while (p < eol)
+        {
+            while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+                ++p;
+            const char* word = p;
+            while (p < eol && *p != ' ' && *p != '\t' && *p != '\r')
+                ++p;
+            if (p > word)
+                result.push_back(std::string(word, (size_t)(p - word)));
+        }
+        return result;
+    }
+
+    // scalar of `type` at `p` in the file's byte order, as a double
+    static double readBinary(const char* p, PlyType type, bool bigEndian)
+    {
+        unsigned char bytes[8];
+        size_t size = plySize(type);
+        std::memcpy(bytes, p, size);
+        if (bigEndian)
+        {
+            for (size_t i = 0; i < size / 2; ++i)
+                std::swap(bytes[i], bytes[size - 1 - i]);
+        }
+        switch (type)
+        {
+        case PLY_INT8:    { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+        case PLY_UINT8:   return bytes[0];
+        case PLY_INT16:   { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case PLY_UINT16:  { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+        case PLY_INT32:   { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case PLY_UINT32:  { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+        case PLY_FLOAT32: { float v; std::memcpy(&v, bytes, 4); return v; }
+        case PLY_FLOAT64: { double v; std::memcpy(&v, bytes, 8); return v; }
+        default:          return 0.0;
+        }
+    }
+
+    // colors are stored as integers of their type's range or as 0..1 floats
+    static float colorScale(PlyType type)
+    {
+        switch (type)
+        {
+        case PLY_UINT8:  return 1.0f / 255.0f;
+        case PLY_UINT16: return 1.0f / 65535.0f;
+        case PLY_INT8:   return 1.0f / 127.0f;
+        case PLY_INT16:  return 1.0f / 32767.0f;
+        case PLY_INT32:
+        case PLY_UINT32: return 1.0f / 255.0f;
+        default:         return 1.0f;
+        }
+    }
+
+    // write one vertex property value into the Geometry vertex `v`
+    static void storeVertex(float* v, const PlyProperty& property, double value)
+    {
+        switch (property.role)
+        {
+        case ROLE_X: case ROLE_Y: case ROLE_Z:
+            v[property.role - ROLE_X] = (float)value;
+            break;
+        case ROLE_RED: case ROLE_GREEN: case ROLE_BLUE:
+            v[3 + property.role - ROLE_RED] = (float)value * colorScale(property.type);
+            break;
+        case ROLE_NX: case ROLE_NY: case ROLE_NZ:
+            v[6 + property.role - ROLE_NX] = (float)value;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // append the fan of a polygon to `indices`; false on a bad index
+    static bool addPolygon(const uint32_t* polygon, size_t count, size_t vertexCount, std::vector<unsigned int>& indices)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (polygon[i] >= vertexCount)
+                return false;
+        }
+        for (size_t i = 1; i + 1 < count; ++i)
+        {
+            indices.push_back(polygon[0]);
+            indices.push_back(polygon[i]);
+            indices.push_back(polygon[i + 1]);
+        }
+        return true;
+    }
+
+    bool loadPly(const char* data, size_t size, Geometry& out)
+    {
+        Clock::time_point start = Clock::now();
+        const char* end = data + size;
+        // header
+        // --------------------------------------------------------------------
+        if (size < 4 || std::memcmp(data, "ply", 3) != 0)
+        {
+            std::cout << "ERROR::MESH_LOADER::NOT_A_PLY_FILE" << std::endl;
+            return false;
+        }
+        PlyFormat format = PLY_ASCII;
+        std::vector<PlyElement> elements;
+        const char* p = lineEnd(data, end) + 1;
+        bool headerEnd = false;
+        while (p < end && !headerEnd)
+        {
+            const char* eol = lineEnd(p, end);
+            std::vector<std::string> line = words(p, eol);
+            p = eol < end ? eol + 1 : end;
+            if (line.empty() || line[0] == "comment" || line[0] == "obj_info")
+                continue;
+            if (line[0] == "end_header")
+                headerEnd = true;
+            else if (line[0] == "format" && line.size() >= 2)
+            {
+                if (line[1] == "ascii")
+                    format = PLY_ASCII;
+                else if (line[1] == "binary_little_endian")
+                    format = PLY_BINARY_LITTLE;
+                else if (line[1] == "binary_big_endian")
+                    format = PLY_BINARY_BIG;
+                else
+                {
+                    std::cout << "ERROR::MESH_LOADER::PLY_FORMAT: " << line[1] << std::endl;
+                    return false;
+                }
+            }
+            else if (line[0] == "element" && line.size() >= 3)
+            {
+                PlyElement element;
+                element.name = line[1];
+                element.count = (size_t)std::strtoull(line[2].c_str(), nullptr, 10);
+                elements.push_back(element);
+            }
+            else if (line[0] == "property" && !elements.empty())
+            {
+                PlyProperty property;
+                bool list = line.size() >= 5 && line[1] == "list";
+                property.countType = list ? plyType(line[2]) : PLY_INVALID;
+                property.type = plyType(list ? line[3] : line.size() >= 2 ? line[1] : "");
+                property.role = plyRole(line.back(), list);
+                if (property.type == PLY_INVALID || (list && property.countType == PLY_INVALID))
+                {
+                    std::cout << "ERROR::MESH_LOADER::PLY_PROPERTY: " << line.back() << std::endl;
+                    return false;
+                }
+                elements.back().properties.push_back(property);
+            }
+        }
+        if (!headerEnd)
+        {
+            std::cout << "ERROR::MESH_LOADER::PLY_HEADER_INCOMPLETE" << std::endl;
+            return false;
+        }
+
+        const PlyElement* vertexElement = nullptr;
+        bool normals = false;
+        for (const PlyElement& element : elements)
+        {
+            if (element.name != "vertex")
+                continue;
+            vertexElement = &element;
+            for (const PlyProperty& property : element.properties)
+                normals = normals || property.role == ROLE_NX || property.role == ROLE_NY || property.role == ROLE_NZ;
+        }
+        if (!vertexElement)
+        {
+            std::cout << "ERROR::MESH_LOADER::PLY_NO_VERTICES" << std::endl;
+            return false;
+        }
+        // the counts size the vertex array: one the body cannot hold (a record
+        // takes a line in ASCII, its fixed part in binary, a byte at least)
+        // is rejected before anything is allocated
+        size_t remaining = (size_t)(end - p);
+        for (const PlyElement& element : elements)
+        {
+            size_t recordSize = format == PLY_ASCII ? 1 : std::max<size_t>(plyMinRecordSize(element), 1);
+            if (element.count > remaining / recordSize)
+            {
+                std::cout << "ERROR::MESH_LOADER::PLY_COUNT_TOO_LARGE: " << element.name << " " << element.count
+                          << std::endl;
+                return false;
+            }
+            remaining -= element.count * recordSize;
+        }
+        out.stride = normals ? 9 : 6;
+        out.vertices.assign(vertexElement->count * out.stride, 0.0f);
+        for (size_t i = 0; i < vertexElement->count; ++i)
+        {
+            float* v = &out.vertices[i * out.stride];
+            v[3] = v[4] = v[5] = MESH_DEFAULT_COLOR;
+        }
+        loadStats.positions = vertexElement->count;
+
+        bool loaded = format == PLY_ASCII ? loadPlyAscii(p, end, elements, out)
+                                          : loadPlyBinary(p, end, elements, format == PLY_BINARY_BIG, out);
+        loadStats.parseMs = msSince(start);
+        return loaded;
+    }
+
+    // ASCII: one line per element instance, in element order
+    // ------------------------------------------------------------------------
+    bool loadPlyAscii(const char* body, const char* end, const std::vector<PlyElement>& elements, Geometry& out)
+    {
+        std::vector<const char*> bounds = splitLines(body, end);
+        unsigned int chunkCount = (unsigned int)bounds.size() - 1;
+        loadStats.chunks = chunkCount;
+        // 1. the first line number of every chunk
+        std::vector<size_t> firstLine(chunkCount + 1, 0);
+        auto countLines = [&](unsigned int i)
+        {
+            size_t lines = 0;
+            for (const char* p = bounds[i]; p < bounds[i + 1]; ++lines)
+                p = lineEnd(p, bounds[i + 1]) + 1;
+            firstLine[i + 1] = lines;
+        };
+        pool.run(chunkCount, countLines);
+        for (unsigned int i = 0; i < chunkCount; ++i)
+            firstLine[i + 1] += firstLine[i];
+        size_t records = 0;
+        for (const PlyElement& element : elements)
+            records += element.count;
+        if (firstLine[chunkCount] < records)
+            return truncated();
+
+        // 2. parse; vertices go straight to their place, faces per chunk
+        const size_t vertexCount = out.vertexCount();
+        std::vector<std::vector<unsigned int> > faces(chunkCount);
+        std::vector<char> failed(chunkCount, 0);
+        auto parse = [&](unsigned int i)
+        {
+            size_t line = firstLine[i];
+            size_t elementIndex = 0, elementStart = 0;
+            std::vector<uint32_t> polygon;
+            for (const char* p = bounds[i]; p < bounds[i + 1] && !failed[i]; ++line)
+            {
+                const char* eol = lineEnd(p, bounds[i + 1]);
+                while (elementIndex < elements.size() && line >= elementStart + elements[elementIndex].count)
+                    elementStart += elements[elementIndex++].count;
+                if (elementIndex == elements.size())
+                    break;
+                const PlyElement& element = elements[elementIndex];
+                bool isVertex = element.name == "vertex", isFace = element.name == "face";
+                float* v = isVertex ? &out.vertices[(line - elementStart) * out.stride] : nullptr;
+                const char* at = p;
+                bool ok = true;
+                for (const PlyProperty& property : element.properties)
+                {
+                    double value = 0.0;
+                    ok = ok && parseNumber(at, eol, value);
+                    if (property.countType == PLY_INVALID)
+                    {
+                        if (ok && v)
+                            storeVertex(v, property, value);
+                        continue;
+                    }
+                    ok = ok && value >= 0.0;
+                    size_t count = ok ? (size_t)value : 0;
+                    polygon.clear();
+                    for (size_t k = 0; k < count && ok; ++k)
+                    {
+                        ok = parseNumber(at, eol, value);
+                        polygon.push_back(plyIndex(value));
+                    }
+                    if (ok && isFace && property.role == ROLE_INDICES)
+                        ok = addPolygon(polygon.data(), polygon.size(), vertexCount, faces[i]);
+                }
+                failed[i] = !ok;
+                p = eol < bounds[i + 1] ? eol + 1 : bounds[i + 1];
+            }
+        };
+        pool.run(chunkCount, parse);
+        for (unsigned int i = 0; i < chunkCount; ++i)
+        {
+            if (failed[i])
+            {
+                std::cout << "ERROR::MESH_LOADER::MALFORMED_PLY: in chunk " << i << std::endl;
+                return false;
+            }
+        }
+        appendFaces(faces, out);
+        return true;
+    }
+
+    // binary: record ranges; fixed-size elements are cut anywhere, elements
+    // with lists are scanned once for the chunk starts
+    // ------------------------------------------------------------------------
+    bool loadPlyBinary(const char* p, const char* end, const std::vector<PlyElement>& elements, bool bigEndian,
+                       Geometry& out)
+    {
+        const size_t vertexCount = out.vertexCount();
+        for (const PlyElement& element : elements)
+        {
+            if (element.count == 0)
+                continue;
+            bool fixed = true;
+            size_t recordSize = 0;
+            for (const PlyProperty& property : element.properties)
+            {
+                fixed = fixed && property.countType == PLY_INVALID;
+                recordSize += plySize(property.type);
+            }
+            unsigned int chunks = pool.chunksFor(element.count, 16 * 1024) * 4;
+            if ((size_t)chunks > element.count)
+                chunks = (unsigned int)element.count;
+            // the byte offset of every chunk's first record
+            std::vector<const char*> starts(chunks + 1);
+            std::vector<size_t> firstRecord(chunks + 1);
+            for (unsigned int c = 0; c <= chunks; ++c)
+            {
+                size_t begin, last;
+                ThreadPool::chunkRange(element.count, chunks, c < chunks ? c : chunks - 1, begin, last);
+                firstRecord[c] = c < chunks ? begin : element.count;
+            }
+            if (fixed)
+            {
+                if (recordSize && element.count > (size_t)(end - p) / recordSize)
+                    return truncated();
+                for (unsigned int c = 0; c <= chunks; ++c)
+                    starts[c] = p + firstRecord[c] * recordSize;
+            }
+            else
+            {
+                const char* at = p;
+                unsigned int c = 0;
+                for (size_t record = 0; record <= element.count; ++record)
+                {
+                    while (c <= chunks && firstRecord[c] == record)
+                        starts[c++] = at;
+                    if (record == element.count)
+                        break;
+                    // every step is held against the bytes left, so a
+                    // corrupt list count cannot run past the end
+                    for (const PlyProperty& property : element.properties)
+                    {
+                        if (property.countType == PLY_INVALID)
+                        {
+                            if ((size_t)(end - at) < plySize(property.type))
+                                return truncated();
+                            at += plySize(property.type);
+                            continue;
+                        }
+                        if ((size_t)(end - at) < plySize(property.countType))
+                            return truncated();
+                        double count = readBinary(at, property.countType, bigEndian);
+                        at += plySize(property.countType);
+                        if (!(count >= 0.0) || count > (double)((size_t)(end - at) / plySize(property.type)))
+                            return truncated();
+                        at += (size_t)count * plySize(property.type);
+                    }
+                }
+            }
+            const bool isVertex = element.name == "vertex", isFace = element.name == "face";
+            if (isVertex || isFace)
+            {
+                std::vector<std::vector<unsigned int> > faces(isFace ? chunks : 0);
+                std::vector<char> failed(chunks, 0);
+                auto parse = [&](unsigned int c)
+                {
+                    const char* at = starts[c];
+                    std::vector<uint32_t> polygon;
+                    for (size_t record = firstRecord[c]; record < firstRecord[c + 1] && !failed[c]; ++record)
+                    {
+                        float* v = isVertex ? &out.vertices[record * out.stride] : nullptr;
+                        for (const PlyProperty& property : element.properties)
+                        {
+                            if (property.countType == PLY_INVALID)
+                            {
+                                if (v)
+                                    storeVertex(v, property, readBinary(at, property.type, bigEndian));
+                                at += plySize(property.type);
+                                continue;
+                            }
+                            size_t count = (size_t)readBinary(at, property.countType, bigEndian);
+                            at += plySize(property.countType);
+                            if (isFace && property.role == ROLE_INDICES)
+                            {
+                                polygon.resize(count);
+                                for (size_t k = 0; k < count; ++k)
+                                    polygon[k] = plyIndex(readBinary(at + k * plySize(property.type), property.type,
+                                                                     bigEndian));
+                                failed[c] = !addPolygon(polygon.data(), count, vertexCount, faces[c]);
+                            }
+                            at += count * plySize(property.type);
+                        }
+                    }
+                };
+                pool.run(chunks, parse);
+                for (unsigned int c = 0; c < chunks; ++c)
+                {
+                    if (failed[c])
+                    {
+                        std::cout << "ERROR::MESH_LOADER::INDEX_OUT_OF_RANGE" << std::endl;
+                        return false;
+                    }
+                }
+                if (isFace)
+                    appendFaces(faces, out);
+                loadStats.chunks = loadStats.chunks > chunks ? loadStats.chunks : chunks;
+            }
+            p = starts[chunks];
+        }
+        return true;
+    }
+
+    static bool truncated()
+    {
+        std::cout << "ERROR::MESH_LOADER::PLY_TRUNCATED" << std::endl;
+        return false;
+    }
+
+    // the per-chunk triangle lists, in chunk order
+    void appendFaces(std::vector<std::vector<unsigned int> >& faces, Geometry& out)
+    {
+        std::vector<size_t> base(faces.size() + 1, out.indices.size());
+        for (size_t i = 0; i < faces.size(); ++i)
+            base[i + 1] = base[i] + faces[i].size();
+        out.indices.resize(base.back());
+        auto copy = [&](unsigned int i)
+        {
+            std::copy(faces[i].begin(), faces[i].end(), out.indices.begin() + base[i]);
+        };
+        pool.run((unsigned int)faces.size(), copy);
+    }
+};
+#endif
@@ -0,0 +1,330 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <Geometry.hpp>
+#include <VertexFormat.hpp>
+
+/* Index and vertex order for meshes drawn as they are (Mesh), not re-sorted
+ * by the painter's pipeline.
+ *
+ * optimize() first reorders the triangles for the post-transform vertex
+ * cache with Forsyth's linear-speed algorithm: every vertex scores by its
+ * position in a simulated LRU cache and by how many of its triangles are
+ * still to be drawn, and the next triangle is the best-scoring one around
+ * the vertices just used. Then the vertices are renumbered in the order the
+ * new index buffer first touches them, so vertex fetches walk the buffer
+ * forwards. Neither pass changes what is drawn. Levels of detail sharing the
+ * vertices (MeshSimplifier.hpp) are reordered each in its own range, and
+ * the vertex order follows the full mesh, which uses every vertex.
+ *
+ * The effect is measured on a FIFO cache of VERTEX_CACHE_SIZE entries, the
+ * usual model of the hardware one:
+ *
+ *     ACMR  vertices transformed per triangle (0.5 at best on a regular
+ *           grid, 3 at worst)
+ *     ATVR  vertices transformed per vertex (1 at best)
+ */
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats
+{
+    double acmr;
+    double atvr;
+
+    VertexCacheStats() : acmr(0.0), atvr(0.0) {}
+};
+
+struct MeshOptimizeStats
+{
+    size_t triangles;
+    VertexCacheStats before;
+    VertexCacheStats after;
+    double cacheMs;      // triangle reordering
+    double fetchMs;      // vertex reordering
+
+    MeshOptimizeStats() : triangles(0), cacheMs(0.0), fetchMs(0.0) {}
+};
+
+class MeshOptimizer
+{
+public:
+    MeshOptimizer()
+    {
+        buildScoreTables();
+    }
+
+    // reorder `geometry`'s triangles, level by level if it has `lods`, then
+    // its vertices; the stats are the full mesh's
+    // ------------------------------------------------------------------------
+    void optimize(Geometry& geometry, const std::vector<MeshLod>& lods = std::vector<MeshLod>())
+    {
+        info = MeshOptimizeStats();
+        const size_t vertexCount = geometry.vertexCount();
+        const size_t fullCount = lods.empty() ? geometry.indices.size() : lods[0].indexCount;
+        info.triangles = fullCount / 3;
+        info.before = analyze(geometry.indices.data(), fullCount, vertexCount);
+
+        Clock::time_point start = Clock::now();
+        if (lods.empty())
+            optimizeVertexCache(geometry.indices, vertexCount);
+        for (const MeshLod& lod : lods)
+        {
+            unsigned int* first = &geometry.indices[lod.firstIndex];
+            levelIndices.assign(first, first + lod.indexCount);
+            optimizeVertexCache(levelIndices, vertexCount);
+            std::copy(levelIndices.begin(), levelIndices.end(), first);
+        }
+        info.cacheMs = msSince(start);
+        start = Clock::now();
+        optimizeVertexFetch(geometry);
+        info.fetchMs = msSince(start);
+
+        info.after = analyze(geometry.indices.data(), fullCount, vertexCount);
+        geometry.changed();
+    }
+
+    const MeshOptimizeStats& stats() const
+    {
+        return info;
+    }
+
+    // ACMR and ATVR of drawing `count` indices through a FIFO cache of
+    // `cacheSize`
+    // ------------------------------------------------------------------------
+    static VertexCacheStats analyze(const unsigned int* indices, size_t count, size_t vertexCount,
+                                    unsigned int cacheSize = VERTEX_CACHE_SIZE)
+    {
+        VertexCacheStats result;
+        if (count < 3 || vertexCount == 0)
+            return result;
+        // a vertex is in the cache while fewer than cacheSize misses have
+        // happened since it was last loaded
+        std::vector<size_t> loadedAt(vertexCount, 0);
+        size_t misses = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            unsigned int index = indices[i];
+            if (loadedAt[index] == 0 || misses - loadedAt[index] >= cacheSize)
+            {
+                ++misses;
+                loadedAt[index] = misses;
+            }
+        }
+        result.acmr = (double)misses / (double)(count / 3);
+        result.atvr = (double)misses / (double)vertexCount;
+        return result;
+    }
+
+    // Forsyth's triangle order for an LRU cache of CACHE_SIZE
+    // ------------------------------------------------------------------------
+    void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+    {
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        // triangles around each vertex (compressed rows, live ones first)
+        adjacencyStart.assign(vertexCount + 1, 0);
+        for (unsigned int index : indices)
+            ++adjacencyStart[index + 1];
+        for (size_t v = 0; v < vertexCount; ++v)
+            adjacencyStart[v + 1] += adjacencyStart[v];
+        liveTriangles.assign(vertexCount, 0);
+        adjacency.resize(indices.size());
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                unsigned int v = indices[t * 3 + c];
+                adjacency[adjacencyStart[v] + liveTriangles[v]++] = (unsigned int)t;
+            }
+        }
+
+        cachePosition.assign(vertexCount, -1);
+        vertexScore.resize(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+            vertexScore[v] = score(-1, liveTriangles[v]);
+        triangleScore.resize(triangleCount);
+        for (size_t t = 0; t < triangleCount; ++t)
+            triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] +
+                               vertexScore[indices[t * 3 + 2]];
+        emitted.assign(triangleCount, 0);
+        order.clear();
+        order.reserve(indices.size());
+        cache.clear();
+
+        size_t cursor = 0;
+        size_t best = bestTriangle(triangleCount);
+        while (order.size() < indices.size())
+        {
+            // nothing around the cache left: the best of all, or the next
+            // one in input order once scores stop mattering
+            if (best == NONE)
+            {
+                while (emitted[cursor])
+                    ++cursor;
+                best = cursor;
+            }
+            const unsigned int* triangle = &indices[best * 3];
+            emitted[best] = 1;
+            for (int c = 0; c < 3; ++c)
+            {
+                unsigned int v = triangle[c];
+                order.push_back(v);
+                // drop the triangle from the vertex's live ones
+                unsigned int* live = &adjacency[adjacencyStart[v]];
+                unsigned int* last = live + --liveTriangles[v];
+                *std::find(live, last + 1, (unsigned int)best) = *last;
+            }
+
+            // the triangle's vertices move to the front of the LRU cache
+            nextCache.assign(triangle, triangle + 3);
+            for (unsigned int v : cache)
+            {
+                if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                    nextCache.push_back(v);
+            }
+            for (size_t i = CACHE_SIZE; i < nextCache.size(); ++i)
+                cachePosition[nextCache[i]] = -1;
+            // rescore what is in or just fell out of the cache, and with it
+            // the live triangles around those vertices
+            for (size_t i = 0; i < nextCache.size(); ++i)
+            {
+                unsigned int v = nextCache[i];
+                if (i < CACHE_SIZE)
+                    cachePosition[v] = (int)i;
+                float updated = score(cachePosition[v], liveTriangles[v]);
+                float delta = updated - vertexScore[v];
+                vertexScore[v] = updated;
+                for (size_t a = adjacencyStart[v], end = a + liveTriangles[v]; a < end; ++a)
+                    triangleScore[adjacency[a]] += delta;
+            }
+            if (nextCache.size() > CACHE_SIZE)
+                nextCache.resize(CACHE_SIZE);
+            cache.swap(nextCache);
+
+            best = NONE;
+            float bestScore = -1.0f;
+            for (unsigned int v : cache)
+            {
+                for (size_t a = adjacencyStart[v], end = a + liveTriangles[v]; a < end; ++a)
+                {
+                    unsigned int t = adjacency[a];
+                    if (triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        best = t;
+                    }
+                }
+            }
+        }
+        indices.swap(order);
+    }
+
+    // renumber the vertices in the order the indices first use them;
+    // vertices no triangle uses go last
+    // ------------------------------------------------------------------------
+    void optimizeVertexFetch(Geometry& geometry)
+    {
+        const size_t vertexCount = geometry.vertexCount();
+        remap.assign(vertexCount, NONE);
+        unsigned int next = 0;
+        for (unsigned int& index : geometry.indices)
+        {
+            if (remap[index] == NONE)
+                remap[index] = next++;
+            index = remap[index];
+        }
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            if (remap[v] == NONE)
+                remap[v] = next++;
+        }
+        const unsigned int stride = geometry.stride;
+        reordered.resize(geometry.vertices.size());
+        for (size_t v = 0; v < vertexCount; ++v)
+            std::copy(&geometry.vertices[v * stride], &geometry.vertices[v * stride] + stride,
+                      &reordered[(size_t)remap[v] * stride]);
+        geometry.vertices.swap(reordered);
+        geometry.changed();
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum : unsigned int
+    {
+        NONE = ~0u
+    };
+
+    // Forsyth's constants: the cache the scores assume, and how far the
+    // valence boost goes
+    enum
+    {
+        CACHE_SIZE = 32,
+        MAX_VALENCE = 32
+    };
+
+    float cacheScores[CACHE_SIZE];
+    float valenceScores[MAX_VALENCE];
+
+    MeshOptimizeStats info;
+    // scratch, kept between meshes
+    std::vector<unsigned int> adjacencyStart, adjacency, liveTriangles;
+    std::vector<int> cachePosition;
+    std::vector<float> vertexScore, triangleScore;
+    std::vector<unsigned char> emitted;
+    std::vector<unsigned int> order, cache, nextCache, remap, levelIndices;
+    std::vector<float> reordered;
+
+    void buildScoreTables()
+    {
+        // the three vertices of the last triangle score the same, so its
+        // neighbours are not favoured by their order in it
+        const float lastTriangleScore = 0.75f, decayPower = 1.5f;
+        for (int i = 0; i < CACHE_SIZE; ++i)
+        {
+            if (i < 3)
+                cacheScores[i] = lastTriangleScore;
+            else
+                cacheScores[i] = std::pow(1.0f - (float)(i - 3) / (CACHE_SIZE - 3), decayPower);
+        }
+        // vertices with few triangles left are finished off first, so they
+        // do not have to be reloaded later for a lone triangle
+        const float valenceBoostScale = 2.0f, valenceBoostPower = 0.5f;
+        valenceScores[0] = 0.0f;
+        for (int i = 1; i < MAX_VALENCE; ++i)
+            valenceScores[i] = valenceBoostScale * std::pow((float)i, -valenceBoostPower);
+    }
+
+    float score(int position, unsigned int live) const
+    {
+        if (live == 0)
+            return -1.0f;
+        float cached = position < 0 ? 0.0f : cacheScores[position];
+        return cached + valenceScores[std::min(live, (unsigned int)MAX_VALENCE - 1)];
+    }
+
+    size_t bestTriangle(size_t triangleCount) const
+    {
+        size_t best = 0;
+        for (size_t t = 1; t < triangleCount; ++t)
+        {
+            if (triangleScore[t] > triangleScore[best])
+                best = t;
+        }
+        return best;
+    }
+
+    static double msSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+};
+#endif
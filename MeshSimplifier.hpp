@@ -0,0 +1,409 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include <Geometry.hpp>
+#include <VertexFormat.hpp>
+
+/* Levels of detail by quadric error edge collapse (Garland and Heckbert).
+ *
+ * Every vertex carries the sum of the squared-distance quadrics of the
+ * planes of its triangles; open edges add a plane through the edge across
+ * the triangle, weighted up, so borders and attribute seams (where the
+ * loader split vertices) hold their shape. The cheapest edge collapses
+ * first, always onto one of its two vertices so no new vertex is made and
+ * every level indexes the original vertex buffer - one VBO serves all of
+ * them. An edge's cost is the distance below, so the collapses come off the
+ * heap nearest first. Collapses that would fold a triangle over are
+ * skipped, and the collapsing stops for good at the first one that would
+ * stray more than 2% of the bounding box diagonal from the surface.
+ *
+ * build() runs the collapses once, down to the coarsest level, and takes a
+ * snapshot each time the triangle count halves. The levels are appended to
+ * the geometry's index buffer after the full mesh, each a MeshLod range
+ * whose error is the largest collapse error so far: the root mean square
+ * distance of the kept vertex to the planes it has absorbed, weighted by
+ * area, a distance in the mesh's units - what the LOD selector projects
+ * to pixels.
+ */
+struct SimplifyStats
+{
+    size_t levels;
+    size_t collapses;
+    double buildMs;
+
+    SimplifyStats() : levels(0), collapses(0), buildMs(0.0) {}
+};
+
+class MeshSimplifier
+{
+public:
+    MeshSimplifier() : maxLevels(MAX_LEVELS), minTriangles(MIN_TRIANGLES) {}
+
+    // stop at `levels` levels (the full mesh included), or when a level
+    // would have fewer than `triangles` triangles
+    void setLimits(size_t levels, size_t triangles)
+    {
+        maxLevels = std::max<size_t>(1, std::min<size_t>(levels, MAX_LEVELS));
+        minTriangles = triangles;
+    }
+
+    // append the coarser levels to `geometry.indices` and describe every
+    // level in `lods`, the full mesh first
+    // ------------------------------------------------------------------------
+    void build(Geometry& geometry, std::vector<MeshLod>& lods)
+    {
+        Clock::time_point start = Clock::now();
+        info = SimplifyStats();
+        const size_t triangleCount = geometry.triangleCount();
+        lods.clear();
+        MeshLod full = { 0, (uint32_t)(triangleCount * 3), 0.0f, 0 };
+        lods.push_back(full);
+
+        setUp(geometry);
+        size_t target = triangleCount / 2;
+        double error = 0.0;
+        bool limited = false;
+        while (lods.size() < maxLevels && target >= minTriangles && !heap.empty() && !limited)
+        {
+            // collapse until the level is reached, nothing can go or the
+            // next collapse would stray too far - and so would every one
+            // after it, the heap being ordered by that distance
+            while (live > target && !heap.empty())
+            {
+                Collapse collapse = heap.top();
+                heap.pop();
+                if (removed[collapse.from] || removed[collapse.to] ||
+                    collapse.stamp != stamps[collapse.from] + stamps[collapse.to])
+                    continue;
+                if (flips(collapse.from, collapse.to))
+                    continue;
+                Quadric merged = quadrics[collapse.from];
+                merged.add(quadrics[collapse.to]);
+                double distance = merged.distance(positions[collapse.to]);
+                if (distance > errorLimit)
+                {
+                    limited = true;
+                    break;
+                }
+                error = std::max(error, distance);
+                collapseEdge(collapse.from, collapse.to);
+                ++info.collapses;
+            }
+            // stuck well above the target (everything left would fold
+            // over): not worth another level
+            size_t previous = lods.back().indexCount / 3;
+            if (live * 4 > previous * 3)
+                break;
+            MeshLod level = { (uint32_t)geometry.indices.size(), 0, (float)error, 0 };
+            for (size_t t = 0; t < triangleCount; ++t)
+            {
+                if (!alive[t])
+                    continue;
+                geometry.indices.insert(geometry.indices.end(), &triangles[t * 3], &triangles[t * 3] + 3);
+            }
+            level.indexCount = (uint32_t)(geometry.indices.size() - level.firstIndex);
+            lods.push_back(level);
+            target = live / 2;
+        }
+        info.levels = lods.size();
+        info.buildMs = msSince(start);
+        geometry.changed();
+        release();
+    }
+
+    const SimplifyStats& stats() const
+    {
+        return info;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum
+    {
+        MAX_LEVELS = 8,
+        MIN_TRIANGLES = 64
+    };
+
+    // an open edge's plane weighs this times its length squared (a triangle's
+    // weighs its area)
+    static double boundaryWeight()
+    {
+        return 10.0;
+    }
+
+    // no collapse may stray further than this part of the bounding box
+    // diagonal; past it the levels would only be drawn as a few pixels
+    static double maxRelativeError()
+    {
+        return 0.02;
+    }
+
+    // the symmetric 4x4 matrix of a weighted sum of squared plane distances
+    struct Quadric
+    {
+        double a[10];
+        double weight;
+
+        Quadric() : weight(0.0)
+        {
+            std::fill(a, a + 10, 0.0);
+        }
+
+        // distance to the plane n.p + d = 0 (n unit length), squared, times `weight`
+        void addPlane(const glm::dvec3& n, double d, double weight)
+        {
+            this->weight += weight;
+            a[0] += weight * n.x * n.x; a[1] += weight * n.x * n.y; a[2] += weight * n.x * n.z; a[3] += weight * n.x * d;
+            a[4] += weight * n.y * n.y; a[5] += weight * n.y * n.z; a[6] += weight * n.y * d;
+            a[7] += weight * n.z * n.z; a[8] += weight * n.z * d;
+            a[9] += weight * d * d;
+        }
+
+        void add(const Quadric& other)
+        {
+            for (int i = 0; i < 10; ++i)
+                a[i] += other.a[i];
+            weight += other.weight;
+        }
+
+        double evaluate(const glm::dvec3& p) const
+        {
+            return a[0] * p.x * p.x + 2.0 * a[1] * p.x * p.y + 2.0 * a[2] * p.x * p.z + 2.0 * a[3] * p.x +
+                   a[4] * p.y * p.y + 2.0 * a[5] * p.y * p.z + 2.0 * a[6] * p.y +
+                   a[7] * p.z * p.z + 2.0 * a[8] * p.z + a[9];
+        }
+
+        // root mean square distance of `p` to the planes
+        double distance(const glm::dvec3& p) const
+        {
+            return weight > 0.0 ? std::sqrt(std::max(evaluate(p), 0.0) / weight) : 0.0;
+        }
+    };
+
+    struct Collapse
+    {
+        double cost;
+        uint32_t from, to;
+        uint32_t stamp;     // the two vertices' stamps when it was queued
+
+        bool operator<(const Collapse& other) const
+        {
+            return cost > other.cost;   // the cheapest on top
+        }
+    };
+
+    size_t maxLevels;
+    size_t minTriangles;
+    SimplifyStats info;
+
+    std::vector<glm::dvec3> positions;
+    std::vector<Quadric> quadrics;
+    std::vector<unsigned int> triangles;               // current corners, collapsed vertices replaced
+    std::vector<unsigned char> alive;
+    std::vector<std::vector<uint32_t>> vertexTriangles;
+    std::vector<unsigned char> removed;
+    std::vector<uint32_t> stamps;                       // bumped whenever a vertex's quadric changes
+    std::vector<uint32_t> neighbours;
+    std::priority_queue<Collapse> heap;
+    size_t live;
+    double errorLimit;
+
+    void setUp(const Geometry& geometry)
+    {
+        const size_t vertexCount = geometry.vertexCount();
+        const size_t triangleCount = geometry.triangleCount();
+        positions.resize(vertexCount);
+        glm::dvec3 low(0.0, 0.0, 0.0), high(0.0, 0.0, 0.0);
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            const glm::dvec3 p = glm::dvec3(geometry.position((unsigned int)v));
+            positions[v] = p;
+            if (v == 0)
+                low = high = p;
+            low = glm::dvec3(std::min(low.x, p.x), std::min(low.y, p.y), std::min(low.z, p.z));
+            high = glm::dvec3(std::max(high.x, p.x), std::max(high.y, p.y), std::max(high.z, p.z));
+        }
+        errorLimit = maxRelativeError() * glm::length(high - low);
+        quadrics.assign(vertexCount, Quadric());
+        triangles.assign(geometry.indices.begin(), geometry.indices.begin() + triangleCount * 3);
+        alive.assign(triangleCount, 1);
+        vertexTriangles.assign(vertexCount, std::vector<uint32_t>());
+        removed.assign(vertexCount, 0);
+        stamps.assign(vertexCount, 0);
+        heap = std::priority_queue<Collapse>();
+        live = triangleCount;
+
+        // edge (low, high) -> how many triangles use it, and the last one
+        std::unordered_map<uint64_t, uint64_t> edges;
+        edges.reserve(triangleCount * 2);
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            const unsigned int* corner = &triangles[t * 3];
+            if (corner[0] == corner[1] || corner[1] == corner[2] || corner[0] == corner[2])
+            {
+                alive[t] = 0;
+                --live;
+                continue;
+            }
+            glm::dvec3 normal = glm::cross(positions[corner[1]] - positions[corner[0]],
+                                           positions[corner[2]] - positions[corner[0]]);
+            // weighted by area, so slivers count for little
+            double length = glm::length(normal);
+            if (length > 0.0)
+                normal /= length;
+            Quadric plane;
+            plane.addPlane(normal, -glm::dot(normal, positions[corner[0]]), length * 0.5);
+            for (int c = 0; c < 3; ++c)
+            {
+                quadrics[corner[c]].add(plane);
+                vertexTriangles[corner[c]].push_back((uint32_t)t);
+                unsigned int a = corner[c], b = corner[(c + 1) % 3];
+                uint64_t& edge = edges[edgeKey(a, b)];
+                edge = ((edge >> 32) + 1) << 32 | (uint64_t)t;
+            }
+        }
+        // open edges get a plane across them
+        for (const auto& edge : edges)
+        {
+            if (edge.second >> 32 != 1)
+                continue;
+            unsigned int a = (unsigned int)(edge.first >> 32), b = (unsigned int)edge.first;
+            const unsigned int* corner = &triangles[(edge.second & 0xffffffffu) * 3];
+            glm::dvec3 normal = glm::cross(positions[corner[1]] - positions[corner[0]],
+                                           positions[corner[2]] - positions[corner[0]]);
+            glm::dvec3 edgeVector = positions[b] - positions[a];
+            glm::dvec3 across = glm::cross(edgeVector, normal);
+            double length = glm::length(across);
+            if (length <= 0.0)
+                continue;
+            across /= length;
+            Quadric plane;
+            plane.addPlane(across, -glm::dot(across, positions[a]), boundaryWeight() * glm::dot(edgeVector, edgeVector));
+            quadrics[a].add(plane);
+            quadrics[b].add(plane);
+        }
+        for (const auto& edge : edges)
+            queue((uint32_t)(edge.first >> 32), (uint32_t)edge.first);
+    }
+
+    static uint64_t edgeKey(unsigned int a, unsigned int b)
+    {
+        return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+    }
+
+    // the cheaper direction of the edge (a, b), costed by the distance the
+    // error limit is checked against, so the heap pops collapses in the
+    // order that check sees them
+    void queue(uint32_t a, uint32_t b)
+    {
+        Quadric sum = quadrics[a];
+        sum.add(quadrics[b]);
+        double toB = sum.distance(positions[b]), toA = sum.distance(positions[a]);
+        Collapse collapse;
+        collapse.from = toB <= toA ? a : b;
+        collapse.to = toB <= toA ? b : a;
+        collapse.cost = std::min(toA, toB);
+        collapse.stamp = stamps[a] + stamps[b];
+        heap.push(collapse);
+    }
+
+    // would moving `from` onto `to` turn a remaining triangle over or make
+    // it degenerate
+    bool flips(uint32_t from, uint32_t to) const
+    {
+        for (uint32_t t : vertexTriangles[from])
+        {
+            if (!alive[t])
+                continue;
+            const unsigned int* corner = &triangles[t * 3];
+            if (corner[0] == to || corner[1] == to || corner[2] == to)
+                continue;
+            glm::dvec3 p[3], q[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                p[c] = positions[corner[c]];
+                q[c] = corner[c] == from ? positions[to] : p[c];
+            }
+            glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::dvec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            double lengths = glm::length(before) * glm::length(after);
+            if (lengths <= 0.0 || glm::dot(before, after) < 0.25 * lengths)
+                return true;
+        }
+        return false;
+    }
+
+    void collapseEdge(uint32_t from, uint32_t to)
+    {
+        quadrics[to].add(quadrics[from]);
+        removed[from] = 1;
+        ++stamps[to];
+        std::vector<uint32_t>& target = vertexTriangles[to];
+        for (uint32_t t : vertexTriangles[from])
+        {
+            if (!alive[t])
+                continue;
+            unsigned int* corner = &triangles[t * 3];
+            if (corner[0] == to || corner[1] == to || corner[2] == to)
+            {
+                alive[t] = 0;
+                --live;
+                continue;
+            }
+            for (int c = 0; c < 3; ++c)
+            {
+                if (corner[c] == from)
+                    corner[c] = to;
+            }
+            target.push_back(t);
+        }
+        std::vector<uint32_t>().swap(vertexTriangles[from]);
+
+        // drop the dead triangles, and requeue every edge around `to`,
+        // whose cost changed with its quadric
+        size_t kept = 0;
+        neighbours.clear();
+        for (uint32_t t : target)
+        {
+            if (!alive[t])
+                continue;
+            target[kept++] = t;
+            for (int c = 0; c < 3; ++c)
+            {
+                if (triangles[t * 3 + c] != to)
+                    neighbours.push_back(triangles[t * 3 + c]);
+            }
+        }
+        target.resize(kept);
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for (uint32_t n : neighbours)
+            queue(n, to);
+    }
+
+    void release()
+    {
+        std::vector<glm::dvec3>().swap(positions);
+        std::vector<Quadric>().swap(quadrics);
+        std::vector<unsigned int>().swap(triangles);
+        std::vector<std::vector<uint32_t>>().swap(vertexTriangles);
+        heap = std::priority_queue<Collapse>();
+    }
+
+    static double msSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+};
+#endif
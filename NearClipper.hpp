@@ -0,0 +1,302 @@
+#ifndef NEAR_CLIPPER_H
+#define NEAR_CLIPPER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <FrameArena.hpp>
+#include <Geometry.hpp>
+#include <ThreadPool.hpp>
+
+/* Near-plane clipping on the CPU side of the painter's algorithm.
+ *
+ * A triangle that reaches behind the camera has corners with w <= 0; their
+ * projections flip through infinity, which breaks every screen-space test
+ * the overlap resolver does. Each triangle is therefore clipped against the
+ * near plane in homogeneous coordinates (z + w >= 0, OpenGL clip space) with
+ * a one-plane Sutherland-Hodgman step, which leaves nothing (all corners
+ * behind), the triangle itself (none behind), or a triangle or quad.
+ *
+ * The depth order is kept: clipping never removes a triangle's farthest
+ * corner, so its depth key stays what the sorter used.
+ *
+ * The work is split over the thread pool in two passes. The first one
+ * classifies the triangles of each chunk and clips the few that straddle the
+ * plane into the chunk's own FrameArena; a prefix sum over the chunks then
+ * gives every chunk its place in the output, and the second pass writes the
+ * index stream and the new vertices there. New vertices continue after the
+ * geometry's own ones (extraVertices()), with the same layout, and are
+ * interpolated in object space - clip space is an affine image of it.
+ */
+struct ClipStats
+{
+    size_t triangles;      // triangles looked at
+    size_t clipped;        // straddled the near plane
+    size_t rejected;       // entirely behind it
+    size_t outTriangles;   // in the index stream
+    size_t newVertices;
+    double clipMs;
+
+    ClipStats() : triangles(0), clipped(0), rejected(0), outTriangles(0), newVertices(0), clipMs(0.0) {}
+};
+
+class NearClipper
+{
+public:
+    explicit NearClipper(ThreadPool& pool)
+        : pool(pool), enabled(true), preparedChunks(0)
+    {
+    }
+
+    void setEnabled(bool on)
+    {
+        enabled = on;
+    }
+
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    const ClipStats& stats() const
+    {
+        return frameStats;
+    }
+
+    // vertices created by the last clip(), `stride` floats each
+    const std::vector<float>& extraVertices() const
+    {
+        return clipVertices;
+    }
+
+    // clip the triangles of `geometry` in `order` against the near plane of
+    // `modelViewProjection` and write them, in the same order, to `outIndices`
+    // ------------------------------------------------------------------------
+    void clip(const Geometry& geometry, const std::vector<uint32_t>& order, const glm::mat4& modelViewProjection,
+              std::vector<unsigned int>& outIndices)
+    {
+        outIndices.resize(prepare(geometry, order, modelViewProjection));
+        write(geometry, order, outIndices.data());
+    }
+
+    // the same in two steps, for writing straight into mapped memory:
+    // prepare() clips and returns how many indices write() will produce
+    // ------------------------------------------------------------------------
+    size_t prepare(const Geometry& geometry, const std::vector<uint32_t>& order, const glm::mat4& modelViewProjection)
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+
+        size_t count = order.size();
+        const unsigned int stride = geometry.stride;
+        // z + w of the clip position, as a plane in object space
+        glm::vec4 plane(modelViewProjection[0][2] + modelViewProjection[0][3],
+                        modelViewProjection[1][2] + modelViewProjection[1][3],
+                        modelViewProjection[2][2] + modelViewProjection[2][3],
+                        modelViewProjection[3][2] + modelViewProjection[3][3]);
+
+        unsigned int chunks = pool.chunksFor(count, 16384);
+        if (chunkData.size() < chunks)
+            chunkData.resize(chunks);
+        kinds.resize(count);
+
+        auto classifyChunk = [&](unsigned int chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(count, chunks, chunk, begin, end);
+            Chunk& data = chunkData[chunk];
+            data.reset();
+            for (size_t i = begin; i < end; ++i)
+            {
+                const unsigned int* tri = &geometry.indices[(size_t)order[i] * 3];
+                float d[3];
+                int inside = 0;
+                for (int c = 0; c < 3; ++c)
+                {
+                    const float* p = &geometry.vertices[(size_t)tri[c] * stride];
+                    d[c] = plane.x * p[0] + plane.y * p[1] + plane.z * p[2] + plane.w;
+                    inside += d[c] >= 0.0f;
+                }
+                if (inside == 3)
+                {
+                    kinds[i] = KEEP;
+                    ++data.triangles;
+                }
+                else if (inside == 0)
+                {
+                    kinds[i] = DROP;
+                    ++data.rejected;
+                }
+                else
+                {
+                    kinds[i] = CLIP;
+                    clipTriangle(geometry, tri, d, data);
+                }
+            }
+        };
+        pool.run(chunks, classifyChunk);
+
+        // where each chunk's triangles and vertices go
+        frameStats = ClipStats();
+        frameStats.triangles = count;
+        size_t triangleTotal = 0, vertexTotal = 0;
+        for (unsigned int chunk = 0; chunk < chunks; ++chunk)
+        {
+            Chunk& data = chunkData[chunk];
+            data.firstTriangle = triangleTotal;
+            data.firstVertex = vertexTotal;
+            triangleTotal += data.triangles;
+            vertexTotal += data.vertices;
+            frameStats.clipped += data.polygons.size();
+            frameStats.rejected += data.rejected;
+        }
+        frameStats.outTriangles = triangleTotal;
+        frameStats.newVertices = vertexTotal;
+        clipVertices.resize(vertexTotal * stride);
+        preparedChunks = chunks;
+        frameStats.clipMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        return triangleTotal * 3;
+    }
+
+    // `out` needs room for the count prepare() returned
+    void write(const Geometry& geometry, const std::vector<uint32_t>& order, unsigned int* out)
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        size_t count = order.size();
+        const unsigned int stride = geometry.stride;
+        const unsigned int chunks = preparedChunks;
+        const uint32_t baseVertex = (uint32_t)geometry.vertexCount();
+
+        auto writeChunk = [&](unsigned int chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(count, chunks, chunk, begin, end);
+            const Chunk& data = chunkData[chunk];
+            unsigned int* dst = out + data.firstTriangle * 3;
+            const uint32_t firstNew = baseVertex + (uint32_t)data.firstVertex;
+            size_t next = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (kinds[i] == KEEP)
+                {
+                    const unsigned int* tri = &geometry.indices[(size_t)order[i] * 3];
+                    dst[0] = tri[0];
+                    dst[1] = tri[1];
+                    dst[2] = tri[2];
+                    dst += 3;
+                }
+                else if (kinds[i] == CLIP)
+                {
+                    // fan-triangulate; new vertices are numbered within the chunk
+                    const ClippedPolygon& polygon = *data.polygons[next++];
+                    uint32_t ids[4];
+                    for (uint32_t k = 0; k < polygon.count; ++k)
+                        ids[k] = (polygon.vertices[k] & NEW_VERTEX) ? firstNew + (polygon.vertices[k] & ~NEW_VERTEX)
+                                                                  : polygon.vertices[k];
+                    for (uint32_t k = 1; k + 1 < polygon.count; ++k)
+                    {
+                        dst[0] = ids[0];
+                        dst[1] = ids[k];
+                        dst[2] = ids[k + 1];
+                        dst += 3;
+                    }
+                    std::copy(polygon.newData, polygon.newData + polygon.newCount * stride,
+                              clipVertices.begin() + (data.firstVertex + polygon.firstNew) * stride);
+                }
+            }
+        };
+        pool.run(chunks, writeChunk);
+        frameStats.clipMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+private:
+    enum Kind : uint8_t
+    {
+        KEEP,
+        DROP,
+        CLIP
+    };
+
+    // vertex ids with this bit set are new, numbered within their chunk
+    static const uint32_t NEW_VERTEX = 0x80000000u;
+
+    // a clipped triangle: 3 or 4 corners, at most 2 of them new
+    struct ClippedPolygon
+    {
+        uint32_t vertices[4];
+        uint32_t count;
+        uint32_t firstNew;     // chunk-local number of its first new vertex
+        uint32_t newCount;
+        float* newData;        // newCount vertices, `stride` floats each
+    };
+
+    struct Chunk
+    {
+        std::unique_ptr<FrameArena> arena;
+        std::vector<ClippedPolygon*> polygons;
+        size_t triangles;      // output triangles
+        size_t vertices;       // new vertices
+        size_t rejected;
+        size_t firstTriangle;
+        size_t firstVertex;
+
+        Chunk() : arena(new FrameArena(64 * 1024)), triangles(0), vertices(0), rejected(0),
+                  firstTriangle(0), firstVertex(0)
+        {
+        }
+
+        void reset()
+        {
+            arena->reset();
+            polygons.clear();
+            triangles = vertices = rejected = 0;
+        }
+    };
+
+    ThreadPool& pool;
+    bool enabled;
+    unsigned int preparedChunks;
+    ClipStats frameStats;
+    std::vector<Chunk> chunkData;
+    std::vector<uint8_t> kinds;          // Kind of every triangle in the order
+    std::vector<float> clipVertices;
+
+    // one Sutherland-Hodgman step against the near plane; `d` holds the
+    // corners' distances to it, at least one of them is negative
+    static void clipTriangle(const Geometry& geometry, const unsigned int* tri, const float* d, Chunk& data)
+    {
+        const unsigned int stride = geometry.stride;
+        ClippedPolygon* polygon = data.arena->allocate<ClippedPolygon>(1);
+        polygon->count = 0;
+        polygon->firstNew = (uint32_t)data.vertices;
+        polygon->newCount = 0;
+        polygon->newData = data.arena->allocate<float>(2 * stride);
+        for (int i = 0; i < 3; ++i)
+        {
+            int j = (i + 1) % 3;
+            if (d[i] >= 0.0f)
+                polygon->vertices[polygon->count++] = tri[i];
+            if ((d[i] >= 0.0f) != (d[j] >= 0.0f))
+            {
+                float t = d[i] / (d[i] - d[j]);
+                const float* a = &geometry.vertices[(size_t)tri[i] * stride];
+                const float* b = &geometry.vertices[(size_t)tri[j] * stride];
+                float* out = polygon->newData + polygon->newCount * stride;
+                for (unsigned int k = 0; k < stride; ++k)
+                    out[k] = a[k] + (b[k] - a[k]) * t;
+                polygon->vertices[polygon->count++] = NEW_VERTEX | (polygon->firstNew + polygon->newCount);
+                ++polygon->newCount;
+            }
+        }
+        data.vertices += polygon->newCount;
+        data.triangles += polygon->count - 2;
+        data.polygons.push_back(polygon);
+    }
+};
+#endif
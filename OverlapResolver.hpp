@@ -0,0 +1,775 @@
+#ifndef OVERLAP_RESOLVER_H
+#define OVERLAP_RESOLVER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <FrameArena.hpp>
+#include <Geometry.hpp>
+
+/* Newell-Newell-Sancha overlap resolution.
+ *
+ * A plain depth sort gets intersecting and cyclically overlapping polygons
+ * wrong. Starting from the depth-sorted list (farthest vertex first), the
+ * head polygon P is checked against every polygon Q whose z-extent overlaps
+ * its own. P may be drawn before Q if one of the tests passes:
+ *
+ *  1. the z-extents do not overlap,
+ *  2. the screen bounding boxes do not overlap,
+ *  3. P lies entirely on the far side of Q's plane,
+ *  4. Q lies entirely on the near side of P's plane,
+ *  5. the projections of P and Q do not intersect.
+ *
+ * If all of them fail but Q can be shown to lie behind P (tests 3 and 4
+ * with the roles swapped), Q is moved to the front of the list and marked.
+ * Marked polygons only ever sit at the front, behind them the list stays
+ * sorted by farthest z.
+ * Otherwise - or when a marked polygon would have to move again, which means
+ * there is a cycle - one polygon is split by the plane of the other and the
+ * pieces are put back into the list.
+ *
+ * Checking P against every z-overlapping polygon is quadratic on deep
+ * scenes, so by default the polygons are also binned into a uniform grid
+ * over the viewport by their screen bounding boxes, and P is only tested
+ * against polygons sharing at least one cell with it - polygons that share
+ * none cannot pass test 2's opposite anyway.
+ *
+ * All per-frame data (polygons, their vertex lists, the list itself) comes
+ * from a FrameArena; split vertices are appended to extraVertices() with the
+ * same layout as the source geometry, so their indices continue right after
+ * the original vertices.
+ */
+struct ResolverStats
+{
+    size_t polygons;       // polygons emitted (after splitting)
+    size_t comparisons;    // P/Q pairs that needed the overlap tests
+    size_t moves;          // polygons moved to the front of the list
+    size_t splits;         // polygons cut in two
+    double resolveMs;
+    // screen grid, for tuning the cell size
+    unsigned int gridColumns;
+    unsigned int gridRows;
+    size_t occupiedCells;
+    size_t binnedEntries;  // polygon/cell pairs, a polygon is in every cell its box touches
+    size_t maxOccupancy;   // most polygons in one cell
+
+    ResolverStats()
+        : polygons(0), comparisons(0), moves(0), splits(0), resolveMs(0.0),
+          gridColumns(0), gridRows(0), occupiedCells(0), binnedEntries(0), maxOccupancy(0)
+    {
+    }
+
+    double averageOccupancy() const
+    {
+        return occupiedCells ? (double)binnedEntries / occupiedCells : 0.0;
+    }
+};
+
+class OverlapResolver
+{
+public:
+    OverlapResolver()
+        : enabled(true), binning(true), viewportWidth(1), viewportHeight(1), minCellPixels(8),
+          columns(1), rows(1), stamp(0)
+    {
+    }
+
+    // framebuffer size in pixels, the grid cells are laid out over it
+    void setViewport(int width, int height)
+    {
+        viewportWidth = width > 0 ? width : 1;
+        viewportHeight = height > 0 ? height : 1;
+    }
+
+    // grid binning of the overlap candidates; off = scan the depth-sorted list
+    void setGridBinning(bool on)
+    {
+        binning = on;
+    }
+
+    bool gridBinning() const
+    {
+        return binning;
+    }
+
+    // lower bound for the cell size; the grid is otherwise sized to hold a
+    // few polygons per cell
+    void setMinCellPixels(unsigned int pixels)
+    {
+        minCellPixels = pixels > 0 ? pixels : 1;
+    }
+
+    void setEnabled(bool on)
+    {
+        enabled = on;
+    }
+
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    const ResolverStats& stats() const
+    {
+        return frameStats;
+    }
+
+    // vertices created by splitting during the last resolve(), `stride` floats each
+    const std::vector<float>& extraVertices() const
+    {
+        return splitVertices;
+    }
+
+    // take the triangles of `geometry` in back-to-front `order`, fix their
+    // ordering where the depth sort got it wrong and write the triangulated
+    // result to `outIndices`
+    // ------------------------------------------------------------------------
+    void resolve(const Geometry& geometry, const std::vector<uint32_t>& order,
+                 const glm::mat4& modelView, const glm::mat4& projection,
+                 std::vector<unsigned int>& outIndices)
+    {
+        orderedIndices.resize(order.size() * 3);
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            const unsigned int* tri = &geometry.indices[(size_t)order[i] * 3];
+            orderedIndices[i * 3 + 0] = tri[0];
+            orderedIndices[i * 3 + 1] = tri[1];
+            orderedIndices[i * 3 + 2] = tri[2];
+        }
+        static const std::vector<float> noVertices;
+        resolve(geometry, orderedIndices, noVertices, modelView, projection, outIndices);
+    }
+
+    // same for a triangle index stream that is already in back-to-front
+    // order and may use `inputVertices` (e.g. from the near-plane clipper),
+    // numbered after the geometry's vertices; they are passed on at the
+    // start of extraVertices()
+    // ------------------------------------------------------------------------
+    void resolve(const Geometry& geometry, const std::vector<unsigned int>& triangles,
+                 const std::vector<float>& inputVertices,
+                 const glm::mat4& modelView, const glm::mat4& projection,
+                 std::vector<unsigned int>& outIndices)
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+
+        arena.reset();
+        frameStats = ResolverStats();
+        splitVertices.assign(inputVertices.begin(), inputVertices.end());
+        source = &geometry;
+        baseVertex = (uint32_t)geometry.vertexCount();
+        this->projection = projection;
+        transformVertices(geometry, modelView);
+
+        size_t count = triangles.size() / 3;
+        Polygon* head = buildList(triangles.data(), count);
+        outIndices.clear();
+        // give up splitting and moving when a frame goes pathological, the
+        // result is then no worse than the plain depth sort
+        splitBudget = count * 16 + 256;
+        moveBudget = count * 64 + 1024;
+
+        if (enabled && binning)
+            binPolygons(head, count);
+
+        while (head)
+        {
+            Polygon* P = head;
+            bool restart = false;
+            candidates.clear();
+            if (enabled)
+                gatherCandidates(P);
+            for (size_t i = 0; i < candidates.size(); ++i)
+            {
+                Polygon* Q = candidates[i];
+                ++frameStats.comparisons;
+                if (drawsBefore(*P, *Q))
+                    continue;
+                bool qBehind = behind(*Q, *P);
+                if (!Q->moved && qBehind)
+                {
+                    moveToFront(head, Q);
+                    restart = true;
+                    break;
+                }
+                if (frameStats.splits < splitBudget &&
+                    (splitPair(head, P, Q) || (Q->moved && splitCycle(head, P, Q))))
+                {
+                    restart = true;
+                    break;
+                }
+                // a marked polygon that cannot be split (the planes only
+                // touch within epsilon) still has to go first
+                if (qBehind && frameStats.moves < moveBudget)
+                {
+                    moveToFront(head, Q);
+                    restart = true;
+                    break;
+                }
+            }
+            if (restart)
+                continue;
+            emit(*P, outIndices);
+            P->done = true;
+            head = P->next;
+            if (head)
+                head->prev = nullptr;
+        }
+
+        frameStats.resolveMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+private:
+    struct Polygon
+    {
+        uint32_t* vertices;   // ids: < baseVertex original, >= baseVertex split
+        uint32_t count;
+        float zFar;           // smallest view-space z
+        float zNear;          // largest view-space z
+        glm::vec2 boxMin;     // NDC bounding box
+        glm::vec2 boxMax;
+        glm::vec4 plane;      // view space, normalised normal
+        Polygon* prev;
+        Polygon* next;
+        uint32_t stamp;       // last candidate search that saw this polygon
+        bool moved;
+        bool done;            // emitted, or replaced by its split pieces
+    };
+
+    bool enabled;
+    bool binning;
+    int viewportWidth;
+    int viewportHeight;
+    unsigned int minCellPixels;
+    unsigned int columns;
+    unsigned int rows;
+    float cellWidth;       // in NDC units
+    float cellHeight;
+    uint32_t stamp;
+    // the copy of zFar lets a search skip most entries without touching the polygon
+    struct CellEntry
+    {
+        Polygon* polygon;
+        float zFar;
+    };
+    // every cell is kept sorted by zFar; cellStart skips the finished prefix
+    std::vector<std::vector<CellEntry> > cells;
+    std::vector<size_t> cellStart;
+    std::vector<Polygon*> candidates;
+    FrameArena arena;
+    ResolverStats frameStats;
+    const Geometry* source;
+    uint32_t baseVertex;
+    size_t splitBudget;
+    size_t moveBudget;
+    glm::mat4 projection;
+    std::vector<glm::vec3> viewPositions;   // per vertex id
+    std::vector<glm::vec2> ndcPositions;    // per vertex id
+    std::vector<float> splitVertices;
+    std::vector<unsigned int> orderedIndices;
+
+    static float epsilon()
+    {
+        return 1e-5f;
+    }
+
+    glm::vec2 project(const glm::vec3& view) const
+    {
+        glm::vec4 clip = projection * glm::vec4(view, 1.0f);
+        float w = std::fabs(clip.w) > 1e-12f ? clip.w : 1e-12f;
+        return glm::vec2(clip.x / w, clip.y / w);
+    }
+
+    // the geometry's vertices followed by the input ones already in splitVertices
+    void transformVertices(const Geometry& geometry, const glm::mat4& modelView)
+    {
+        size_t count = geometry.vertexCount() + splitVertices.size() / geometry.stride;
+        viewPositions.resize(count);
+        ndcPositions.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const float* p = vertexData((uint32_t)i);
+            glm::vec4 view = modelView * glm::vec4(p[0], p[1], p[2], 1.0f);
+            viewPositions[i] = glm::vec3(view.x, view.y, view.z);
+            ndcPositions[i] = project(viewPositions[i]);
+        }
+    }
+
+    // z-extent and screen bounds of a polygon from its vertices
+    void updateBounds(Polygon& polygon) const
+    {
+        const glm::vec3& first = viewPositions[polygon.vertices[0]];
+        polygon.zFar = polygon.zNear = first.z;
+        polygon.boxMin = polygon.boxMax = ndcPositions[polygon.vertices[0]];
+        for (uint32_t i = 1; i < polygon.count; ++i)
+        {
+            float z = viewPositions[polygon.vertices[i]].z;
+            const glm::vec2& p = ndcPositions[polygon.vertices[i]];
+            polygon.zFar = std::min(polygon.zFar, z);
+            polygon.zNear = std::max(polygon.zNear, z);
+            polygon.boxMin.x = std::min(polygon.boxMin.x, p.x);
+            polygon.boxMin.y = std::min(polygon.boxMin.y, p.y);
+            polygon.boxMax.x = std::max(polygon.boxMax.x, p.x);
+            polygon.boxMax.y = std::max(polygon.boxMax.y, p.y);
+        }
+    }
+
+    Polygon* buildList(const unsigned int* triangles, size_t count)
+    {
+        Polygon* head = nullptr;
+        Polygon* last = nullptr;
+        Polygon** tail = &head;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const unsigned int* tri = triangles + i * 3;
+            Polygon* polygon = arena.allocate<Polygon>(1);
+            polygon->vertices = arena.allocate<uint32_t>(3);
+            polygon->count = 3;
+            for (int corner = 0; corner < 3; ++corner)
+                polygon->vertices[corner] = tri[corner];
+            const glm::vec3& a = viewPositions[tri[0]];
+            glm::vec3 normal = glm::cross(viewPositions[tri[1]] - a, viewPositions[tri[2]] - a);
+            float length = glm::length(normal);
+            normal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+            polygon->plane = glm::vec4(normal, -glm::dot(normal, a));
+            polygon->prev = last;
+            polygon->next = nullptr;
+            polygon->stamp = 0;
+            polygon->moved = false;
+            polygon->done = false;
+            updateBounds(*polygon);
+            *tail = polygon;
+            tail = &polygon->next;
+            last = polygon;
+        }
+        return head;
+    }
+
+    void unlink(Polygon*& head, Polygon* polygon)
+    {
+        if (polygon->prev)
+            polygon->prev->next = polygon->next;
+        else
+            head = polygon->next;
+        if (polygon->next)
+            polygon->next->prev = polygon->prev;
+    }
+
+    // insert `polygon` right after `anchor`, or as the new head if null
+    void link(Polygon*& head, Polygon* anchor, Polygon* polygon)
+    {
+        Polygon*& slot = anchor ? anchor->next : head;
+        polygon->prev = anchor;
+        polygon->next = slot;
+        if (slot)
+            slot->prev = polygon;
+        slot = polygon;
+    }
+
+    void moveToFront(Polygon*& head, Polygon* Q)
+    {
+        unlink(head, Q);
+        link(head, nullptr, Q);
+        Q->moved = true;
+        ++frameStats.moves;
+    }
+
+    // lay the grid out over the viewport and put every polygon into the
+    // cells its screen bounding box touches
+    void binPolygons(Polygon* head, size_t count)
+    {
+        // aim for a few polygons per cell, but no cells smaller than minCellPixels
+        const double polygonsPerCell = 4.0;
+        double aspect = (double)viewportWidth / viewportHeight;
+        double cellsWanted = std::max(1.0, count / polygonsPerCell);
+        columns = (unsigned int)std::max(1.0, std::sqrt(cellsWanted * aspect));
+        rows = (unsigned int)std::max(1.0, std::sqrt(cellsWanted / aspect));
+        columns = std::min(columns, std::max(1u, (unsigned int)viewportWidth / minCellPixels));
+        rows = std::min(rows, std::max(1u, (unsigned int)viewportHeight / minCellPixels));
+        cellWidth = 2.0f / columns;
+        cellHeight = 2.0f / rows;
+
+        // clear() keeps every cell's capacity for the next frame
+        if (cells.size() < (size_t)columns * rows)
+            cells.resize((size_t)columns * rows);
+        for (std::vector<CellEntry>& cell : cells)
+            cell.clear();
+        cellStart.assign(cells.size(), 0);
+        // the list is in zFar order up to rounding, so the cells come out
+        // (almost) sorted and the sort below has little to do
+        for (Polygon* polygon = head; polygon; polygon = polygon->next)
+            bin(polygon, false);
+        for (size_t i = 0; i < (size_t)columns * rows; ++i)
+            std::sort(cells[i].begin(), cells[i].end(), byZFar);
+
+        frameStats.gridColumns = columns;
+        frameStats.gridRows = rows;
+        for (size_t i = 0; i < (size_t)columns * rows; ++i)
+        {
+            size_t occupancy = cells[i].size();
+            frameStats.occupiedCells += occupancy > 0;
+            frameStats.binnedEntries += occupancy;
+            frameStats.maxOccupancy = std::max(frameStats.maxOccupancy, occupancy);
+        }
+    }
+
+    void cellRange(const Polygon& polygon, unsigned int& x0, unsigned int& y0, unsigned int& x1, unsigned int& y1) const
+    {
+        // NDC [-1, 1] -> cell, everything off screen lands in the border cells
+        auto cell = [](float ndc, float size, unsigned int cellCount)
+        {
+            float c = std::floor((ndc + 1.0f) / size);
+            return (unsigned int)std::min(std::max(c, 0.0f), (float)(cellCount - 1));
+        };
+        x0 = cell(polygon.boxMin.x, cellWidth, columns);
+        x1 = cell(polygon.boxMax.x, cellWidth, columns);
+        y0 = cell(polygon.boxMin.y, cellHeight, rows);
+        y1 = cell(polygon.boxMax.y, cellHeight, rows);
+    }
+
+    static bool byZFar(const CellEntry& a, const CellEntry& b)
+    {
+        return a.zFar < b.zFar;
+    }
+
+    void bin(Polygon* polygon, bool sortedInsert)
+    {
+        unsigned int x0, y0, x1, y1;
+        cellRange(*polygon, x0, y0, x1, y1);
+        CellEntry entry;
+        entry.polygon = polygon;
+        entry.zFar = polygon->zFar;
+        for (unsigned int y = y0; y <= y1; ++y)
+        {
+            for (unsigned int x = x0; x <= x1; ++x)
+            {
+                size_t c = (size_t)y * columns + x;
+                std::vector<CellEntry>& cell = cells[c];
+                if (!sortedInsert)
+                {
+                    cell.push_back(entry);
+                    continue;
+                }
+                // split pieces go to their zFar position, behind the finished prefix
+                std::vector<CellEntry>::iterator at =
+                    std::upper_bound(cell.begin() + cellStart[c], cell.end(), entry, byZFar);
+                cell.insert(at, entry);
+            }
+        }
+    }
+
+    // pending polygons whose z-extent overlaps P's and which may overlap it on screen
+    void gatherCandidates(Polygon* P)
+    {
+        if (!binning)
+        {
+            for (Polygon* Q = P->next; Q; Q = Q->next)
+            {
+                // past the moved polygons at the front the list is sorted by
+                // zFar, so the first one out of P's z-extent ends the scan
+                if (Q->zFar >= P->zNear)
+                {
+                    if (Q->moved)
+                        continue;
+                    break;
+                }
+                candidates.push_back(Q);
+            }
+            return;
+        }
+
+        ++stamp;
+        P->stamp = stamp;
+        unsigned int x0, y0, x1, y1;
+        cellRange(*P, x0, y0, x1, y1);
+        for (unsigned int y = y0; y <= y1; ++y)
+        {
+            for (unsigned int x = x0; x <= x1; ++x)
+            {
+                size_t c = (size_t)y * columns + x;
+                std::vector<CellEntry>& cell = cells[c];
+                while (cellStart[c] < cell.size() && cell[cellStart[c]].polygon->done)
+                    ++cellStart[c];
+                for (size_t i = cellStart[c]; i < cell.size(); ++i)
+                {
+                    const CellEntry& entry = cell[i];
+                    if (entry.zFar >= P->zNear)
+                        break;
+                    Polygon* Q = entry.polygon;
+                    if (Q->done || Q->stamp == stamp)
+                        continue;
+                    Q->stamp = stamp;
+                    candidates.push_back(Q);
+                }
+            }
+        }
+    }
+
+    static float distance(const glm::vec4& plane, const glm::vec3& point)
+    {
+        return plane.x * point.x + plane.y * point.y + plane.z * point.z + plane.w;
+    }
+
+    // true if no vertex of `polygon` is on the eye's side of `plane`
+    bool farSide(const Polygon& polygon, const glm::vec4& plane) const
+    {
+        float eye = plane.w;   // the eye sits at the view-space origin
+        for (uint32_t i = 0; i < polygon.count; ++i)
+        {
+            float d = distance(plane, viewPositions[polygon.vertices[i]]);
+            if (d * eye > 0.0f && std::fabs(d) > epsilon())
+                return false;
+        }
+        return true;
+    }
+
+    // true if no vertex of `polygon` is on the far side of `plane`
+    bool nearSide(const Polygon& polygon, const glm::vec4& plane) const
+    {
+        float eye = plane.w;
+        for (uint32_t i = 0; i < polygon.count; ++i)
+        {
+            float d = distance(plane, viewPositions[polygon.vertices[i]]);
+            if (d * eye < 0.0f && std::fabs(d) > epsilon())
+                return false;
+        }
+        return true;
+    }
+
+    static bool edgeOn(const Polygon& polygon)
+    {
+        // degenerate, or seen exactly from the side - covers nothing
+        return std::fabs(polygon.plane.w) <= epsilon();
+    }
+
+    // separating axis test on the projected (convex) polygons
+    bool projectionsOverlap(const Polygon& a, const Polygon& b) const
+    {
+        return !separatedByEdgeOf(a, a, b) && !separatedByEdgeOf(b, a, b);
+    }
+
+    bool separatedByEdgeOf(const Polygon& edges, const Polygon& a, const Polygon& b) const
+    {
+        for (uint32_t i = 0; i < edges.count; ++i)
+        {
+            const glm::vec2& p0 = ndcPositions[edges.vertices[i]];
+            const glm::vec2& p1 = ndcPositions[edges.vertices[(i + 1) % edges.count]];
+            glm::vec2 axis(p0.y - p1.y, p1.x - p0.x);
+            if (axis.x == 0.0f && axis.y == 0.0f)
+                continue;
+            float minA, maxA, minB, maxB;
+            projectOnto(a, axis, minA, maxA);
+            projectOnto(b, axis, minB, maxB);
+            float slack = epsilon() * (std::fabs(axis.x) + std::fabs(axis.y));
+            if (maxA <= minB + slack || maxB <= minA + slack)
+                return true;
+        }
+        return false;
+    }
+
+    void projectOnto(const Polygon& polygon, const glm::vec2& axis, float& lo, float& hi) const
+    {
+        lo = hi = glm::dot(ndcPositions[polygon.vertices[0]], axis);
+        for (uint32_t i = 1; i < polygon.count; ++i)
+        {
+            float d = glm::dot(ndcPositions[polygon.vertices[i]], axis);
+            lo = std::min(lo, d);
+            hi = std::max(hi, d);
+        }
+    }
+
+    // may P be painted before Q (tests 1-5)
+    bool drawsBefore(const Polygon& P, const Polygon& Q) const
+    {
+        if (Q.zFar >= P.zNear)
+            return true;
+        if (P.boxMax.x <= Q.boxMin.x || Q.boxMax.x <= P.boxMin.x ||
+            P.boxMax.y <= Q.boxMin.y || Q.boxMax.y <= P.boxMin.y)
+            return true;
+        if (edgeOn(P) || edgeOn(Q))
+            return true;
+        if (farSide(P, Q.plane) || nearSide(Q, P.plane))
+            return true;
+        return !projectionsOverlap(P, Q);
+    }
+
+    // does Q provably lie behind P (tests 3' and 4')
+    bool behind(const Polygon& Q, const Polygon& P) const
+    {
+        return farSide(Q, P.plane) || nearSide(P, Q.plane);
+    }
+
+    static bool crosses(const float* d, uint32_t count)
+    {
+        bool positive = false, negative = false;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            positive = positive || d[i] > epsilon();
+            negative = negative || d[i] < -epsilon();
+        }
+        return positive && negative;
+    }
+
+    // cut one polygon of the pair by the other's plane and replace it in the
+    // list by the two pieces; returns false if neither plane cuts the other
+    bool splitPair(Polygon*& head, Polygon* P, Polygon* Q)
+    {
+        float* dP = arena.allocate<float>(P->count);
+        for (uint32_t i = 0; i < P->count; ++i)
+            dP[i] = distance(Q->plane, viewPositions[P->vertices[i]]);
+        if (crosses(dP, P->count))
+        {
+            replaceBySplit(head, P, dP);
+            return true;
+        }
+        float* dQ = arena.allocate<float>(Q->count);
+        for (uint32_t i = 0; i < Q->count; ++i)
+            dQ[i] = distance(P->plane, viewPositions[Q->vertices[i]]);
+        if (crosses(dQ, Q->count))
+        {
+            replaceBySplit(head, Q, dQ);
+            return true;
+        }
+        return false;
+    }
+
+    // Q was moved already, so P -> ... -> Q -> P is a cycle of polygons that
+    // each have to be painted before the next. If P and Q themselves cannot
+    // be cut, some other pair of the cycle can (three "sticks" overlapping
+    // each other in a ring are the classic case).
+    bool splitCycle(Polygon*& head, Polygon* P, Polygon* Q)
+    {
+        const size_t MAX_CYCLE = 16;
+        Polygon* cycle[MAX_CYCLE];
+        size_t length = 0;
+        for (Polygon* X = P; X && length < MAX_CYCLE; X = X->next)
+        {
+            cycle[length++] = X;
+            if (X == Q)
+                break;
+        }
+        if (cycle[length - 1] != Q)
+            return false;
+        for (size_t i = 0; i < length; ++i)
+        {
+            for (size_t j = 0; j < length; ++j)
+            {
+                if (i == j)
+                    continue;
+                Polygon* cut = cycle[i];
+                float* d = arena.allocate<float>(cut->count);
+                for (uint32_t k = 0; k < cut->count; ++k)
+                    d[k] = distance(cycle[j]->plane, viewPositions[cut->vertices[k]]);
+                if (crosses(d, cut->count))
+                {
+                    replaceBySplit(head, cut, d);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // new vertex on the edge a-b, t measured from a
+    uint32_t splitVertex(uint32_t a, uint32_t b, float t)
+    {
+        const unsigned int stride = source->stride;
+        size_t offset = splitVertices.size();
+        splitVertices.resize(offset + stride);
+        // look the ends up after resizing, they may live in splitVertices
+        const float* va = vertexData(a);
+        const float* vb = vertexData(b);
+        float* out = &splitVertices[offset];
+        for (unsigned int k = 0; k < stride; ++k)
+            out[k] = va[k] + (vb[k] - va[k]) * t;
+
+        glm::vec3 view = viewPositions[a] + (viewPositions[b] - viewPositions[a]) * t;
+        viewPositions.push_back(view);
+        ndcPositions.push_back(project(view));
+        return baseVertex + (uint32_t)(offset / stride);
+    }
+
+    const float* vertexData(uint32_t id) const
+    {
+        if (id < baseVertex)
+            return &source->vertices[(size_t)id * source->stride];
+        return &splitVertices[(size_t)(id - baseVertex) * source->stride];
+    }
+
+    // `d` holds the signed distances of the polygon's vertices to the cutting plane
+    void replaceBySplit(Polygon*& head, Polygon* polygon, const float* d)
+    {
+        uint32_t count = polygon->count;
+        Polygon* pieces[2];
+        for (int side = 0; side < 2; ++side)
+        {
+            pieces[side] = arena.allocate<Polygon>(1);
+            pieces[side]->vertices = arena.allocate<uint32_t>(count + 2);
+            pieces[side]->count = 0;
+            pieces[side]->plane = polygon->plane;
+            pieces[side]->prev = nullptr;
+            pieces[side]->next = nullptr;
+            pieces[side]->stamp = 0;
+            pieces[side]->moved = false;
+            pieces[side]->done = false;
+        }
+        Polygon& front = *pieces[0];
+        Polygon& back = *pieces[1];
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t j = (i + 1) % count;
+            uint32_t a = polygon->vertices[i];
+            uint32_t b = polygon->vertices[j];
+            float da = d[i], db = d[j];
+            if (da >= -epsilon())
+                front.vertices[front.count++] = a;
+            if (da <= epsilon())
+                back.vertices[back.count++] = a;
+            if ((da > epsilon() && db < -epsilon()) || (da < -epsilon() && db > epsilon()))
+            {
+                uint32_t v = splitVertex(a, b, da / (da - db));
+                front.vertices[front.count++] = v;
+                back.vertices[back.count++] = v;
+            }
+        }
+        ++frameStats.splits;
+
+        // unlink the original...
+        Polygon* anchor = polygon->prev;
+        unlink(head, polygon);
+        polygon->done = true;
+        // ...and insert the pieces by their farthest z after the spot it was taken from
+        for (int side = 0; side < 2; ++side)
+        {
+            Polygon* piece = pieces[side];
+            if (piece->count < 3)
+                continue;
+            updateBounds(*piece);
+            Polygon* after = anchor;
+            for (Polygon* next = after ? after->next : head;
+                 next && (next->moved || next->zFar <= piece->zFar); next = next->next)
+                after = next;
+            link(head, after, piece);
+            if (binning)
+                bin(piece, true);
+        }
+    }
+
+    // fan-triangulate a finished polygon into the index stream
+    void emit(const Polygon& polygon, std::vector<unsigned int>& outIndices)
+    {
+        ++frameStats.polygons;
+        for (uint32_t i = 1; i + 1 < polygon.count; ++i)
+        {
+            outIndices.push_back(polygon.vertices[0]);
+            outIndices.push_back(polygon.vertices[i]);
+            outIndices.push_back(polygon.vertices[i + 1]);
+        }
+    }
+};
+#endif
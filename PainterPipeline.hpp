@@ -0,0 +1,124 @@
+#ifndef PAINTER_PIPELINE_H
+#define PAINTER_PIPELINE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <Geometry.hpp>
+#include <NearClipper.hpp>
+#include <OverlapResolver.hpp>
+#include <PainterSorter.hpp>
+#include <ThreadPool.hpp>
+#include <TriangleCuller.hpp>
+
+/* The CPU half of the painter's algorithm, run once per frame:
+ *
+ *   culling (TriangleCuller) -> depth keys + sort (PainterSorter)
+ *       -> near-plane clipping (NearClipper) -> overlap resolution (OverlapResolver)
+ *
+ * The result is an index list in drawing order. Indices below
+ * geometry.vertexCount() refer to the scene's own vertices, the ones above
+ * to extraVertices() (clipped, then split ones), which the renderer appends
+ * to the vertex buffer.
+ */
+class PainterPipeline
+{
+public:
+    TriangleCuller culler;
+    PainterSorter sorter;
+    NearClipper clipper;
+    OverlapResolver resolver;
+
+    explicit PainterPipeline(ThreadPool& pool)
+        : culler(pool), sorter(pool), clipper(pool)
+    {
+    }
+
+    // framebuffer size, for the overlap resolver's screen grid
+    void setViewport(int width, int height)
+    {
+        resolver.setViewport(width, height);
+    }
+
+    void run(const Geometry& geometry, const glm::mat4& modelView, const glm::mat4& projection)
+    {
+        run(geometry, modelView, projection, [this](size_t count)
+        {
+            drawIndices.resize(count);
+            return drawIndices.data();
+        });
+    }
+
+    // same, but the final index stream goes to reserve(count), which returns
+    // room for `count` indices - e.g. a mapped IndexRing segment, so the last
+    // stage writes straight into GPU-visible memory. The overlap resolver
+    // does not know its output size up front; with it on, the indices are
+    // copied over from indices() once it is done. Returns the index count.
+    // ------------------------------------------------------------------------
+    template <typename Reserve>
+    size_t run(const Geometry& geometry, const glm::mat4& modelView, const glm::mat4& projection, Reserve reserve)
+    {
+        const std::vector<uint32_t>* subset = nullptr;
+        if (culler.isEnabled())
+        {
+            culler.cull(sorter.triangles(geometry), modelView, projection, visibleTriangles);
+            subset = &visibleTriangles;
+        }
+        sorter.sort(geometry, modelView, subset);
+
+        if (resolver.isEnabled())
+        {
+            if (clipper.isEnabled())
+            {
+                clipper.clip(geometry, sorter.order(), projection * modelView, clippedIndices);
+                resolver.resolve(geometry, clippedIndices, clipper.extraVertices(), modelView, projection, drawIndices);
+            }
+            else
+                resolver.resolve(geometry, sorter.order(), modelView, projection, drawIndices);
+            size_t count = drawIndices.size();
+            unsigned int* out = reserve(count);
+            if (out && out != drawIndices.data())
+                std::copy(drawIndices.begin(), drawIndices.end(), out);
+            return count;
+        }
+
+        size_t count;
+        if (clipper.isEnabled())
+        {
+            count = clipper.prepare(geometry, sorter.order(), projection * modelView);
+            unsigned int* out = reserve(count);
+            if (out)
+                clipper.write(geometry, sorter.order(), out);
+        }
+        else
+        {
+            count = sorter.indexCount();
+            unsigned int* out = reserve(count);
+            if (out)
+                sorter.writeIndices(geometry, out);
+        }
+        return count;
+    }
+
+    const std::vector<unsigned int>& indices() const
+    {
+        return drawIndices;
+    }
+
+    // vertices created this frame (clipped and split polygons), same layout as the scene
+    const std::vector<float>& extraVertices() const
+    {
+        static const std::vector<float> none;
+        if (resolver.isEnabled())
+            return resolver.extraVertices();
+        return clipper.isEnabled() ? clipper.extraVertices() : none;
+    }
+
+private:
+    std::vector<uint32_t> visibleTriangles;
+    std::vector<unsigned int> clippedIndices;
+    std::vector<unsigned int> drawIndices;
+};
+#endif
@@ -0,0 +1,378 @@
+#ifndef PAINTER_SORTER_H
+#define PAINTER_SORTER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <DepthKeys.hpp>
+#include <Geometry.hpp>
+#include <RadixSort.hpp>
+#include <ThreadPool.hpp>
+
+/* Depth ordering for the painter's algorithm.
+ *
+ * Every frame each triangle gets a depth key - the view-space z of its
+ * farthest vertex, as in the classic painter's algorithm - and the triangles
+ * are ordered back to front. The camera looks down -z, so the farthest
+ * triangle has the smallest z and an ascending sort already gives the
+ * back-to-front order we need. The keys are computed with SIMD from a
+ * structure-of-arrays copy of the triangles (see DepthKeys.hpp), which is
+ * built on first use and rebuilt when the geometry's arrays change.
+ *
+ * Instead of all triangles the sorter can take a subset, e.g. the survivors
+ * of TriangleCuller; the order then holds only those ids.
+ *
+ * Between two frames the camera hardly moves, so last frame's order is
+ * almost right. The incremental mode starts from it, counts the places where
+ * it is out of order and, if there are few, repairs it with an insertion
+ * sort; if there are many (or the repair turns out expensive) it falls back
+ * to the full radix sort.
+ */
+enum class SortMode
+{
+    Unsorted,      // draw triangles in the order they are stored
+    StdSort,       // single-threaded comparison sort, for reference
+    ParallelRadix, // parallel LSD radix sort over float-as-uint keys
+    Incremental    // repair last frame's order, radix sort when too disordered
+};
+
+inline const char* sortModeName(SortMode mode)
+{
+    switch (mode)
+    {
+    case SortMode::Unsorted:      return "unsorted";
+    case SortMode::StdSort:       return "std::sort";
+    case SortMode::ParallelRadix: return "parallel radix";
+    case SortMode::Incremental:   return "incremental";
+    }
+    return "?";
+}
+
+// timings of the last sort() call; the incremental counters accumulate
+struct PainterStats
+{
+    size_t triangles;
+    double keyMs;
+    double sortMs;
+    size_t descents;       // out-of-order neighbours found by the incremental mode
+    size_t fastPaths;      // frames repaired incrementally
+    size_t fullResorts;    // frames the incremental mode had to radix sort
+
+    PainterStats() : triangles(0), keyMs(0.0), sortMs(0.0), descents(0), fastPaths(0), fullResorts(0) {}
+};
+
+class PainterSorter
+{
+public:
+    explicit PainterSorter(ThreadPool& pool, SortMode mode = SortMode::ParallelRadix)
+        : pool(pool), sortMode(mode), disorderThreshold(0.1f), orderValid(false), orderSubset(false),
+          orderTotal(0), simdLevel(detectSimdLevel())
+    {
+    }
+
+    // instruction set for the depth keys; defaults to the best the CPU has
+    void setSimdLevel(SimdLevel level)
+    {
+        simdLevel = std::min(level, detectSimdLevel());
+    }
+
+    SimdLevel simd() const
+    {
+        return simdLevel;
+    }
+
+    // fraction of out-of-order neighbours above which the incremental mode
+    // does not even try to repair the previous order
+    void setDisorderThreshold(float fraction)
+    {
+        disorderThreshold = fraction;
+    }
+
+    void setMode(SortMode mode)
+    {
+        sortMode = mode;
+    }
+
+    SortMode mode() const
+    {
+        return sortMode;
+    }
+
+    const PainterStats& stats() const
+    {
+        return frameStats;
+    }
+
+    // triangle ids of the last sort, back to front
+    const std::vector<uint32_t>& order() const
+    {
+        return triangleOrder;
+    }
+
+    // structure-of-arrays copy of `geometry`'s triangles, brought up to date
+    // (rebuilt when its generation changed)
+    const TriangleSoA& triangles(const Geometry& geometry)
+    {
+        soa.update(geometry);
+        return soa;
+    }
+
+    // order the triangles of `geometry` (or only the ids in `subset`) back
+    // to front as seen through `modelView`; the result is available through
+    // order()
+    // ------------------------------------------------------------------------
+    void sort(const Geometry& geometry, const glm::mat4& modelView, const std::vector<uint32_t>* subset = nullptr)
+    {
+        typedef std::chrono::steady_clock Clock;
+        size_t total = geometry.triangleCount();
+        size_t count = subset ? subset->size() : total;
+        frameStats.triangles = count;
+
+        // the previous order can only be reused for the same triangles; a
+        // subset is reconciled with last frame's, a full order needs a full one
+        bool incremental = sortMode == SortMode::Incremental && orderValid && orderTotal == total &&
+                           (subset || (!orderSubset && triangleOrder.size() == count));
+
+        Clock::time_point start = Clock::now();
+        soa.update(geometry);
+        if (subset)
+            computeSubsetKeys(*subset, total, modelView, incremental);
+        else
+            computeKeys(modelView, incremental);
+        Clock::time_point keyed = Clock::now();
+
+        switch (sortMode)
+        {
+        case SortMode::Unsorted:
+            break;
+        case SortMode::StdSort:
+            sortReference();
+            break;
+        case SortMode::ParallelRadix:
+            sortRadix();
+            break;
+        case SortMode::Incremental:
+            if (incremental && repairOrder())
+                ++frameStats.fastPaths;
+            else
+            {
+                sortRadix();
+                ++frameStats.fullResorts;
+            }
+            break;
+        }
+        orderValid = sortMode != SortMode::Unsorted;
+        orderSubset = subset != nullptr;
+        orderTotal = total;
+        Clock::time_point sorted = Clock::now();
+
+        frameStats.keyMs = std::chrono::duration<double, std::milli>(keyed - start).count();
+        frameStats.sortMs = std::chrono::duration<double, std::milli>(sorted - keyed).count();
+    }
+
+    // same as above, and write the resulting vertex indices to `outIndices`
+    // ------------------------------------------------------------------------
+    void sort(const Geometry& geometry, const glm::mat4& modelView, std::vector<unsigned int>& outIndices,
+              const std::vector<uint32_t>* subset = nullptr)
+    {
+        sort(geometry, modelView, subset);
+        outIndices.resize(indexCount());
+        writeIndices(geometry, outIndices.data());
+    }
+
+    // vertex indices of the last sort
+    size_t indexCount() const
+    {
+        return triangleOrder.size() * 3;
+    }
+
+    // write them to `out` (room for indexCount()), e.g. mapped buffer memory
+    void writeIndices(const Geometry& geometry, unsigned int* out) const
+    {
+        size_t count = triangleOrder.size();
+        const unsigned int* src = geometry.indices.data();
+        for (size_t i = 0; i < count; ++i)
+        {
+            const unsigned int* tri = src + (size_t)triangleOrder[i] * 3;
+            out[i * 3 + 0] = tri[0];
+            out[i * 3 + 1] = tri[1];
+            out[i * 3 + 2] = tri[2];
+        }
+    }
+
+private:
+    ThreadPool& pool;
+    SortMode sortMode;
+    PainterStats frameStats;
+    float disorderThreshold;
+    bool orderValid;
+    bool orderSubset;                      // triangleOrder came from a subset
+    size_t orderTotal;                     // triangle count of its geometry
+    SimdLevel simdLevel;
+    TriangleSoA soa;
+    std::vector<uint32_t> keys;            // keys[i] belongs to triangleOrder[i]
+    std::vector<uint32_t> keysById;
+    std::vector<uint32_t> triangleOrder;
+    std::vector<uint32_t> keysTmp;
+    std::vector<uint32_t> valuesTmp;
+    std::vector<uint64_t> packed;
+    std::vector<uint8_t> subsetMark;
+
+    // key = sortable bits of the farthest corner's view-space z. Normally the
+    // order restarts from the identity; with `keepOrder` the keys are looked
+    // up for last frame's order instead.
+    void computeKeys(const glm::mat4& modelView, bool keepOrder)
+    {
+        size_t count = soa.count;
+        keys.resize(count);
+        triangleOrder.resize(count);
+        keysById.resize(keepOrder ? count : 0);
+
+        // chunks of whole SIMD blocks, so only the last one has a scalar tail
+        const size_t BLOCK = 8;
+        size_t blocks = (count + BLOCK - 1) / BLOCK;
+        unsigned int chunks = pool.chunksFor(count, 16384);
+        auto keyChunk = [&](unsigned int chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(blocks, chunks, chunk, begin, end);
+            begin = std::min(begin * BLOCK, count);
+            end = std::min(end * BLOCK, count);
+            uint32_t* out = keepOrder ? keysById.data() : keys.data();
+            computeDepthKeys(soa, modelView, out, begin, end, simdLevel);
+            if (!keepOrder)
+            {
+                for (size_t i = begin; i < end; ++i)
+                    triangleOrder[i] = (uint32_t)i;
+            }
+        };
+        pool.run(chunks, keyChunk);
+        if (!keepOrder)
+            return;
+
+        // pick the keys up in last frame's order (needs all chunks done)
+        auto gatherChunk = [&](unsigned int chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(count, chunks, chunk, begin, end);
+            for (size_t i = begin; i < end; ++i)
+                keys[i] = keysById[triangleOrder[i]];
+        };
+        pool.run(chunks, gatherChunk);
+    }
+
+    // keys of a subset of the triangles, looked up by id. With `keepOrder`
+    // last frame's order is kept for the ids still in the subset and the
+    // new ones are appended, for the incremental repair to move into place.
+    void computeSubsetKeys(const std::vector<uint32_t>& subset, size_t total, const glm::mat4& modelView, bool keepOrder)
+    {
+        size_t count = subset.size();
+        if (keepOrder)
+        {
+            subsetMark.assign(total, 0);
+            for (uint32_t id : subset)
+                subsetMark[id] = 1;
+            size_t kept = 0;
+            for (uint32_t id : triangleOrder)
+            {
+                if (subsetMark[id] == 1)
+                {
+                    triangleOrder[kept++] = id;
+                    subsetMark[id] = 2;
+                }
+            }
+            triangleOrder.resize(kept);
+            for (uint32_t id : subset)
+            {
+                if (subsetMark[id] == 1)
+                    triangleOrder.push_back(id);
+            }
+        }
+        else
+            triangleOrder.assign(subset.begin(), subset.end());
+        keys.resize(count);
+
+        const size_t BLOCK = 8;
+        size_t blocks = (count + BLOCK - 1) / BLOCK;
+        unsigned int chunks = pool.chunksFor(count, 16384);
+        auto keyChunk = [&](unsigned int chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(blocks, chunks, chunk, begin, end);
+            begin = std::min(begin * BLOCK, count);
+            end = std::min(end * BLOCK, count);
+            computeDepthKeysIndexed(soa, modelView, triangleOrder.data(), keys.data(), begin, end, simdLevel);
+        };
+        pool.run(chunks, keyChunk);
+    }
+
+    void sortRadix()
+    {
+        size_t count = keys.size();
+        keysTmp.resize(count);
+        valuesTmp.resize(count);
+        radixSortPairs(keys.data(), triangleOrder.data(), keysTmp.data(), valuesTmp.data(), count, &pool);
+    }
+
+    // insertion sort of an almost sorted order; gives up (returns false) when
+    // the order is too scrambled or the repair moves too many elements
+    bool repairOrder()
+    {
+        size_t count = keys.size();
+        size_t descents = 0;
+        for (size_t i = 1; i < count; ++i)
+            descents += keys[i - 1] > keys[i];
+        frameStats.descents = descents;
+        if (descents == 0)
+            return true;
+        if ((float)descents > disorderThreshold * (float)count)
+            return false;
+
+        // every element may move a few places on average before radix wins
+        size_t budget = count * 8 + 1024;
+        size_t moves = 0;
+        uint32_t* k = keys.data();
+        uint32_t* v = triangleOrder.data();
+        for (size_t i = 1; i < count; ++i)
+        {
+            uint32_t key = k[i];
+            if (k[i - 1] <= key)
+                continue;
+            uint32_t value = v[i];
+            size_t j = i;
+            while (j > 0 && k[j - 1] > key)
+            {
+                k[j] = k[j - 1];
+                v[j] = v[j - 1];
+                --j;
+            }
+            k[j] = key;
+            v[j] = value;
+            moves += i - j;
+            // the prefix is sorted, so finishing with radix is still correct
+            if (moves > budget)
+                return false;
+        }
+        return true;
+    }
+
+    // pack key and id into one 64-bit word so std::sort stays stable
+    void sortReference()
+    {
+        size_t count = keys.size();
+        packed.resize(count);
+        for (size_t i = 0; i < count; ++i)
+            packed[i] = ((uint64_t)keys[i] << 32) | triangleOrder[i];
+        std::sort(packed.begin(), packed.end());
+        for (size_t i = 0; i < count; ++i)
+        {
+            keys[i] = (uint32_t)(packed[i] >> 32);
+            triangleOrder[i] = (uint32_t)packed[i];
+        }
+    }
+};
+#endif
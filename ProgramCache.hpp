@@ -0,0 +1,205 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <Hash.hpp>
+
+/* On-disk cache of linked program binaries (glGetProgramBinary).
+ *
+ * A program is stored under the 64-bit FNV-1a hash of its shader sources
+ * plus the GL vendor, renderer and version strings, so a driver update or a
+ * different GPU simply misses the cache. Loading hands the blob back to
+ * glProgramBinary; the driver may still refuse it (the link status says
+ * so), and the caller then compiles from source as usual and stores the new
+ * binary. Files are written to a temporary name and renamed, so a crash
+ * never leaves half a binary behind.
+ *
+ * Needs GL 4.1 or ARB_get_program_binary and at least one binary format;
+ * without them every load misses and nothing is stored.
+ */
+class ProgramCache
+{
+public:
+    explicit ProgramCache(const std::string& directory)
+        : directory(directory), hits(0), misses(0)
+    {
+        mkdir(directory.c_str(), 0755);
+    }
+
+    static bool supported()
+    {
+        if (!glProgramBinary || !glGetProgramBinary || !glProgramParameteri)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    // key of a program built from `sources` on the current driver
+    // ------------------------------------------------------------------------
+    static uint64_t key(const std::vector<std::string>& sources)
+    {
+        uint64_t hash = FNV_OFFSET_BASIS;
+        for (const std::string& source : sources)
+            hash = hashPart(source.data(), source.size(), hash);
+        return key(hash);
+    }
+
+    // the same for sources the caller hashed itself
+    static uint64_t key(uint64_t sourceHash)
+    {
+        uint64_t hash = fnv1a64(&sourceHash, sizeof(sourceHash));
+        const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (GLenum name : strings)
+        {
+            const char* value = reinterpret_cast<const char*>(glGetString(name));
+            hash = hashPart(value ? value : "", value ? std::char_traits<char>::length(value) : 0, hash);
+        }
+        return hash;
+    }
+
+    // call before glLinkProgram, or the driver may not keep the binary around
+    static void prepare(GLuint program)
+    {
+        if (supported())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // load the binary stored under `key` into `program`; true if it linked
+    // ------------------------------------------------------------------------
+    bool load(GLuint program, uint64_t key)
+    {
+        if (!supported())
+            return false;
+        std::ifstream file(path(key).c_str(), std::ios::binary);
+        FileHeader header;
+        if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            !std::equal(magic(), magic() + 4, header.magic) || header.version != VERSION || header.key != key)
+        {
+            ++misses;
+            return false;
+        }
+        // a corrupt length must not size the buffer: hold it against the file
+        std::streampos start = file.tellg();
+        file.seekg(0, std::ios::end);
+        uint64_t remaining = (uint64_t)(file.tellg() - start);
+        file.seekg(start);
+        if (header.length > remaining)
+        {
+            std::cout << "ERROR::PROGRAM_CACHE::FILE_TRUNCATED: " << path(key) << std::endl;
+            ++misses;
+            return false;
+        }
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), binary.size()))
+        {
+            std::cout << "ERROR::PROGRAM_CACHE::FILE_TRUNCATED: " << path(key) << std::endl;
+            ++misses;
+            return false;
+        }
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            ++misses;
+            return false;
+        }
+        ++hits;
+        return true;
+    }
+
+    // store the binary of the linked `program` under `key`
+    // ------------------------------------------------------------------------
+    bool store(GLuint program, uint64_t key)
+    {
+        if (!supported())
+            return false;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+        std::vector<char> binary(length);
+        FileHeader header;
+        std::copy(magic(), magic() + 4, header.magic);
+        header.version = VERSION;
+        header.key = key;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &header.format, binary.data());
+        header.length = (uint32_t)written;
+
+        std::string target = path(key);
+        std::string temporary = target + ".tmp";
+        {
+            std::ofstream file(temporary.c_str(), std::ios::binary);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(binary.data(), written);
+            if (!file)
+            {
+                std::cout << "ERROR::PROGRAM_CACHE::FILE_NOT_SUCCESSFULLY_WRITTEN: " << temporary << std::endl;
+                return false;
+            }
+        }
+        return std::rename(temporary.c_str(), target.c_str()) == 0;
+    }
+
+    // programs loaded from / not found in the cache so far
+    size_t hitCount() const
+    {
+        return hits;
+    }
+
+    size_t missCount() const
+    {
+        return misses;
+    }
+
+private:
+    static const uint32_t VERSION = 1;
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        GLenum format;
+        uint32_t length;
+    };
+
+    std::string directory;
+    size_t hits;
+    size_t misses;
+
+    static const char* magic()
+    {
+        return "PBIN";
+    }
+
+    // length first, so ("ab", "c") and ("a", "bc") hash differently
+    static uint64_t hashPart(const char* data, size_t size, uint64_t hash)
+    {
+        uint64_t length = size;
+        hash = fnv1a64(&length, sizeof(length), hash);
+        return fnv1a64(data, size, hash);
+    }
+
+    std::string path(uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return directory + "/" + name;
+    }
+};
+#endif
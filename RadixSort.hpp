@@ -0,0 +1,121 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <ThreadPool.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+/* Map a float onto an unsigned int whose natural ordering matches the
+ * ordering of the floats, so floats can be sorted with integer radix passes.
+ * Negative values get all bits flipped, positive ones only the sign bit.
+ */
+inline uint32_t floatToSortableKey(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t mask = (uint32_t)(-(int32_t)(bits >> 31)) | 0x80000000u;
+    return bits ^ mask;
+}
+
+inline float sortableKeyToFloat(uint32_t key)
+{
+    uint32_t mask = ((key >> 31) - 1) | 0x80000000u;
+    uint32_t bits = key ^ mask;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/* Stable LSD radix sort of (key, value) pairs, ascending by key.
+ *
+ * Four 8-bit passes; every pass builds per-thread histograms over a contiguous
+ * chunk, turns them into per-thread scatter offsets and scatters the chunks in
+ * parallel, which keeps the sort stable. Passes whose digit is the same for
+ * every key are skipped. keysTmp/valuesTmp must hold `count` elements; the
+ * result always ends up in keys/values.
+ */
+inline void radixSortPairs(uint32_t* keys, uint32_t* values, uint32_t* keysTmp, uint32_t* valuesTmp,
+                           size_t count, ThreadPool* pool)
+{
+    const unsigned int RADIX = 256;
+    // below this size the threading overhead is larger than the sort itself
+    const size_t MIN_CHUNK = 16384;
+
+    unsigned int chunks = pool ? pool->chunksFor(count, MIN_CHUNK) : 1;
+    if (chunks > 64)
+        chunks = 64;
+    size_t histogram[64][RADIX];
+
+    uint32_t* srcKeys = keys;
+    uint32_t* srcValues = values;
+    uint32_t* dstKeys = keysTmp;
+    uint32_t* dstValues = valuesTmp;
+
+    for (unsigned int shift = 0; shift < 32; shift += 8)
+    {
+        // 1. count digits per chunk
+        auto countDigits = [&](unsigned int chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(count, chunks, chunk, begin, end);
+            size_t* h = histogram[chunk];
+            std::memset(h, 0, RADIX * sizeof(size_t));
+            for (size_t i = begin; i < end; ++i)
+                ++h[(srcKeys[i] >> shift) & 0xFF];
+        };
+        if (chunks > 1)
+            pool->run(chunks, countDigits);
+        else
+            countDigits(0);
+
+        // 2. exclusive prefix sum in (digit, chunk) order
+        size_t offset = 0;
+        bool trivial = false;
+        for (unsigned int digit = 0; digit < RADIX; ++digit)
+        {
+            size_t digitTotal = 0;
+            for (unsigned int chunk = 0; chunk < chunks; ++chunk)
+            {
+                size_t n = histogram[chunk][digit];
+                histogram[chunk][digit] = offset;
+                offset += n;
+                digitTotal += n;
+            }
+            if (digitTotal == count)
+                trivial = true;
+        }
+        if (trivial)
+            continue;
+
+        // 3. scatter every chunk into its reserved slots
+        auto scatter = [&](unsigned int chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(count, chunks, chunk, begin, end);
+            size_t* h = histogram[chunk];
+            for (size_t i = begin; i < end; ++i)
+            {
+                uint32_t key = srcKeys[i];
+                size_t slot = h[(key >> shift) & 0xFF]++;
+                dstKeys[slot] = key;
+                dstValues[slot] = srcValues[i];
+            }
+        };
+        if (chunks > 1)
+            pool->run(chunks, scatter);
+        else
+            scatter(0);
+
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+
+    if (srcKeys != keys)
+    {
+        std::memcpy(keys, srcKeys, count * sizeof(uint32_t));
+        std::memcpy(values, srcValues, count * sizeof(uint32_t));
+    }
+}
+#endif
@@ -2,97 +2,514 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
+#include <chrono>
+#include <cstdint>
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <utility>
+#include <vector>
 #include <iostream>
 
+#include <GLState.hpp>
+#include <ProgramCache.hpp>
+#include <ShaderLibrary.hpp>
+#include <UniformTable.hpp>
+
+// KHR_parallel_shader_compile, not in the generated loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+/* Sync builds compile and link in the constructor. Async builds only issue
+ * the work there; ready() polls for it (non-blocking with
+ * KHR_parallel_shader_compile, see enableParallelCompile()), and use(),
+ * uniform() and wait() block until it is done. Meanwhile the caller can go
+ * on uploading geometry or issue the builds of other programs, which the
+ * driver may then compile side by side.
+ */
+enum class ShaderBuild
+{
+    Sync,
+    Async
+};
+
+typedef void (APIENTRYP MaxCompilerThreadsProc)(GLuint count);
+
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
-    // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
-    {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            std::cout << vertexPath << std::endl;
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode   = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
+    // constructor generates the shader on the fly from the shaders/ files
+    // `vertexName` and `fragmentName` and what they #include, taken from
+    // `library`, which has to outlive the shader; `defines` ("NAME" or
+    // "NAME VALUE") go right after the #version line of both stages
+    // ------------------------------------------------------------------------
+    Shader(ShaderLibrary& library, const char* vertexName, const char* fragmentName, ProgramCache* cache = nullptr,
+           ShaderBuild mode = ShaderBuild::Sync, const std::vector<std::string>& defines = std::vector<std::string>())
+        : library(&library), vertexName(vertexName), fragmentName(fragmentName), defines(defines), cache(cache),
+          cacheKey(0), cached(false), pending(false), vertex(0), fragment(0), buildMs(0.0), reloading(false),
+          nextID(0), nextVertex(0), nextFragment(0), nextKey(0), reloadMs(0.0), generations(0)
+    {
+        startTime = Clock::now();
         ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        // 1. assemble the sources, 2. take the linked program from the binary
+        // cache or build it
+        if (!start(ID, cacheKey, vertex, fragment, cached))
+            std::cout << "ERROR::SHADER::SOURCES_INCOMPLETE: " << vertexName << ", " << fragmentName << std::endl;
+        if (cached)
+            complete();
+        else
+        {
+            pending = true;
+            if (mode == ShaderBuild::Sync)
+                complete();
+        }
+    }
+    // asynchronous builds: true once the program is linked and usable. Polls
+    // the driver without blocking where KHR_parallel_shader_compile is on,
+    // otherwise waits for the build right away
+    // ------------------------------------------------------------------------
+    bool ready()
+    {
+        if (pending && parallelCompile())
+        {
+            GLint done = 0;
+            glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+                return false;
+        }
+        if (pending)
+            complete();
+        return true;
+    }
+    // an asynchronous build not found done yet
+    bool isBuilding() const
+    {
+        return pending;
+    }
+    // block until the program is built
+    void wait()
+    {
+        if (pending)
+            complete();
+    }
+    // turn on KHR_parallel_shader_compile (or the ARB version): `threadHint`
+    // is the entry point glMaxShaderCompilerThreadsKHR/ARB, NULL if the
+    // extension is not there
+    // ------------------------------------------------------------------------
+    static void enableParallelCompile(MaxCompilerThreadsProc threadHint, unsigned int threads)
+    {
+        parallelCompile() = threadHint != NULL;
+        if (threadHint)
+            threadHint(threads);
+    }
+    // attach the uniform block `name` of every program linked from now on to
+    // `binding`, so one buffer bound there serves them all (GLSL 330 has no
+    // binding layout qualifier)
+    // ------------------------------------------------------------------------
+    static void bindUniformBlock(const std::string& name, GLuint binding)
+    {
+        std::vector<std::pair<std::string, GLuint> >& blocks = blockBindings();
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            if (blocks[i].first == name)
+            {
+                blocks[i].second = binding;
+                return;
+            }
+        }
+        blocks.push_back(std::make_pair(name, binding));
+    }
+
+    static bool parallelCompileEnabled()
+    {
+        return parallelCompile();
+    }
+    // rebuild the program from the library's current sources (after
+    // ShaderLibrary::update()) in the background - asynchronously where the
+    // driver allows; the current program stays in use until updateReload()
+    // finds the new one linked. A reload still in flight is dropped for the
+    // newer one
+    // ------------------------------------------------------------------------
+    void reload()
+    {
+        discardReload();
+        reloadStart = Clock::now();
+        nextID = glCreateProgram();
+        bool loaded = false;
+        if (!start(nextID, nextKey, nextVertex, nextFragment, loaded))
+        {
+            std::cout << "ERROR::SHADER::RELOAD_FAILED: sources incomplete, keeping the previous program" << std::endl;
+            if (nextVertex)
+            {
+                glDeleteShader(nextVertex);
+                glDeleteShader(nextFragment);
+            }
+            GLState::current().forgetProgram(nextID);
+            glDeleteProgram(nextID);
+            nextID = nextVertex = nextFragment = 0;
+            return;
+        }
+        reloading = true;
+    }
+    // call once per frame: true if a reload has just been swapped in - ID
+    // changed and Uniform handles have to be resolved again. A reload that
+    // fails to compile or link is dropped and the old program kept. Never
+    // blocks with KHR_parallel_shader_compile
+    // ------------------------------------------------------------------------
+    bool updateReload()
+    {
+        if (!reloading)
+            return false;
+        if (nextVertex && parallelCompile())
+        {
+            GLint done = 0;
+            glGetProgramiv(nextID, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+                return false;
+        }
+        bool linkedNow = !nextVertex || finish(nextID, nextVertex, nextFragment, nextKey);
+        nextVertex = nextFragment = 0;
+        reloading = false;
+        if (!linkedNow)
+        {
+            std::cout << "ERROR::SHADER::RELOAD_FAILED: keeping the previous program" << std::endl;
+            GLState::current().forgetProgram(nextID);
+            glDeleteProgram(nextID);
+            nextID = 0;
+            return false;
+        }
+        // the old program is freed by GL once it is no longer current
+        wait();
+        GLState::current().forgetProgram(ID);
+        glDeleteProgram(ID);
+        ID = nextID;
+        nextID = 0;
+        cacheKey = nextKey;
+        uniforms.reflect(ID);
+        bindBlocks(ID);
+        reloadMs = std::chrono::duration<double, std::milli>(Clock::now() - reloadStart).count();
+        ++generations;
+        return true;
+    }
+    bool isReloading() const
+    {
+        return reloading;
+    }
+    // time the last swapped-in reload took from reload() to the swap
+    double reloadTime() const
+    {
+        return reloadMs;
+    }
+    // programs swapped in by reloads so far
+    unsigned int generation() const
+    {
+        return generations;
+    }
+    // the files on disk the program's sources came from (the main files and
+    // their includes); empty if all of them are embedded
+    const std::vector<std::string>& sourceFiles() const
+    {
+        return files;
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        wait();
+        GLState::current().useProgram(ID);
     }
-    // utility uniform functions
+    // utility uniform functions (one table lookup each - resolve a handle
+    // with uniform() for anything called every frame); literals convert to
+    // UniformName without allocating, a constexpr UniformName is hashed at
+    // compile time
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
-    {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+    void setBool(const UniformName& name, bool value) const
+    {
+        set(Uniform<bool>(uniforms.location(name)), value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
-    { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+    void setInt(const UniformName& name, int value) const
+    {
+        set(Uniform<int>(uniforms.location(name)), value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
-    { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+    void setFloat(const UniformName& name, float value) const
+    {
+        set(Uniform<float>(uniforms.location(name)), value);
+    }
+    // ------------------------------------------------------------------------
+    template <typename T>
+    void set(const UniformName& name, const T& value) const
+    {
+        set(Uniform<T>(uniforms.location(name)), value);
+    }
+    // typed handle of a uniform, resolved once; an inactive name or a type
+    // that does not match the GLSL declaration gives an invalid handle
+    // ------------------------------------------------------------------------
+    template <typename T>
+    Uniform<T> uniform(const char* name)
+    {
+        wait();
+        const UniformTable::Entry* entry = uniforms.find(name);
+        if (!entry)
+        {
+            std::cout << "ERROR::SHADER::UNIFORM_NOT_ACTIVE: " << name << std::endl;
+            return Uniform<T>();
+        }
+        // samplers are set as ints
+        bool sampler = UniformType<T>::value() == GL_INT && entry->type != GL_INT && entry->type != GL_BOOL;
+        if (entry->type != UniformType<T>::value() && !sampler)
+        {
+            std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << name << std::endl;
+            return Uniform<T>();
+        }
+        return Uniform<T>(entry->location);
+    }
+    // setters through handles - a single call, no lookups. With
+    // glProgramUniform* (GL 4.1 or ARB_separate_shader_objects) the program
+    // need not be in use; without, it is made current through GLState
+    // ------------------------------------------------------------------------
+    void set(Uniform<bool> uniform, bool value) const
+    {
+        set(Uniform<int>(uniform.location), (int)value);
+    }
+    void set(Uniform<int> uniform, int value) const
+    {
+        if (glProgramUniform1i)
+            glProgramUniform1i(ID, uniform.location, value);
+        else
+        {
+            bindForUniforms();
+            glUniform1i(uniform.location, value);
+        }
+    }
+    void set(Uniform<float> uniform, float value) const
+    {
+        if (glProgramUniform1f)
+            glProgramUniform1f(ID, uniform.location, value);
+        else
+        {
+            bindForUniforms();
+            glUniform1f(uniform.location, value);
+        }
+    }
+    void set(Uniform<glm::vec2> uniform, const glm::vec2& value) const
+    {
+        if (glProgramUniform2fv)
+            glProgramUniform2fv(ID, uniform.location, 1, glm::value_ptr(value));
+        else
+        {
+            bindForUniforms();
+            glUniform2fv(uniform.location, 1, glm::value_ptr(value));
+        }
+    }
+    void set(Uniform<glm::vec3> uniform, const glm::vec3& value) const
+    {
+        if (glProgramUniform3fv)
+            glProgramUniform3fv(ID, uniform.location, 1, glm::value_ptr(value));
+        else
+        {
+            bindForUniforms();
+            glUniform3fv(uniform.location, 1, glm::value_ptr(value));
+        }
+    }
+    void set(Uniform<glm::vec4> uniform, const glm::vec4& value) const
+    {
+        if (glProgramUniform4fv)
+            glProgramUniform4fv(ID, uniform.location, 1, glm::value_ptr(value));
+        else
+        {
+            bindForUniforms();
+            glUniform4fv(uniform.location, 1, glm::value_ptr(value));
+        }
+    }
+    void set(Uniform<glm::mat3> uniform, const glm::mat3& value) const
+    {
+        if (glProgramUniformMatrix3fv)
+            glProgramUniformMatrix3fv(ID, uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+        else
+        {
+            bindForUniforms();
+            glUniformMatrix3fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+        }
+    }
+    void set(Uniform<glm::mat4> uniform, const glm::mat4& value) const
+    {
+        if (glProgramUniformMatrix4fv)
+            glProgramUniformMatrix4fv(ID, uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+        else
+        {
+            bindForUniforms();
+            glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+        }
+    }
+    // the program's active uniforms
+    const UniformTable& uniformTable() const
+    {
+        return uniforms;
+    }
+    // true if the program came from the binary cache instead of the compiler
+    bool fromCache() const
+    {
+        return cached;
+    }
+    // time from the start of the build until the program was usable: compile
+    // and link, or loading the binary; for asynchronous builds, until ready()
+    // or wait() found it done
+    double buildTime() const
+    {
+        return buildMs;
     }
 
 private:
+    typedef std::chrono::steady_clock Clock;
+
+    ShaderLibrary* library;
+    std::string vertexName, fragmentName;
+    std::vector<std::string> defines;
+    std::vector<std::string> files;
+    UniformTable uniforms;
+    ProgramCache* cache;
+    uint64_t cacheKey;
+    bool cached;
+    bool pending;            // compiles and link issued, results not checked yet
+    unsigned int vertex, fragment;
+    Clock::time_point startTime;
+    double buildMs;
+    // a reload in flight, swapped in by updateReload()
+    bool reloading;
+    unsigned int nextID, nextVertex, nextFragment;   // stages are 0 if loaded from the cache
+    uint64_t nextKey;
+    Clock::time_point reloadStart;
+    double reloadMs;
+    unsigned int generations;
+
+    static bool& parallelCompile()
+    {
+        static bool enabled = false;
+        return enabled;
+    }
+
+    // glUniform* writes to the program in use
+    void bindForUniforms() const
+    {
+        GLState::current().useProgram(ID);
+    }
+
+    static std::vector<std::pair<std::string, GLuint> >& blockBindings()
+    {
+        static std::vector<std::pair<std::string, GLuint> > blocks;
+        return blocks;
+    }
+
+    // the bindings are program state, also reset by glProgramBinary
+    static void bindBlocks(unsigned int program)
+    {
+        const std::vector<std::pair<std::string, GLuint> >& blocks = blockBindings();
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            GLuint index = glGetUniformBlockIndex(program, blocks[i].first.c_str());
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(program, index, blocks[i].second);
+        }
+    }
+
+    // assemble both stages, then load `program` from the binary cache
+    // (`loaded`) or issue its build; false if a source is missing
+    // ------------------------------------------------------------------------
+    bool start(unsigned int program, uint64_t& key, unsigned int& vertexStage, unsigned int& fragmentStage,
+               bool& loaded)
+    {
+        ShaderSourceList vertexSources, fragmentSources;
+        bool complete = library->assemble(vertexName, defines, vertexSources);
+        complete = library->assemble(fragmentName, defines, fragmentSources) && complete;
+        files = vertexSources.files;
+        files.insert(files.end(), fragmentSources.files.begin(), fragmentSources.files.end());
+        key = ProgramCache::key(fragmentSources.hash(vertexSources.hash()));
+        loaded = complete && cache && cache->load(program, key);
+        if (!loaded)
+            issue(program, vertexSources, fragmentSources, vertexStage, fragmentStage);
+        return complete;
+    }
+
+    // hand both stages and the link to the driver without asking for any
+    // status - a query would make it finish the work right there
+    // ------------------------------------------------------------------------
+    static void issue(unsigned int program, const ShaderSourceList& vertexSources,
+                      const ShaderSourceList& fragmentSources, unsigned int& vertex, unsigned int& fragment)
+    {
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, (GLsizei)vertexSources.strings.size(), vertexSources.strings.data(),
+                       vertexSources.lengths.data());
+        glCompileShader(vertex);
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, (GLsizei)fragmentSources.strings.size(), fragmentSources.strings.data(),
+                       fragmentSources.lengths.data());
+        glCompileShader(fragment);
+        // shader Program
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        // ask the driver to keep the binary around for the cache
+        ProgramCache::prepare(program);
+        glLinkProgram(program);
+    }
+
+    // check what issue() started and store the binary; true if it linked
+    // ------------------------------------------------------------------------
+    bool finish(unsigned int program, unsigned int vertex, unsigned int fragment, uint64_t key)
+    {
+        checkCompileErrors(vertex, "VERTEX");
+        checkCompileErrors(fragment, "FRAGMENT");
+        checkCompileErrors(program, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDetachShader(program, vertex);
+        glDetachShader(program, fragment);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        int success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (success && cache)
+            cache->store(program, key);
+        return success != 0;
+    }
+
+    // the initial build is done: reflect the uniforms
+    // ------------------------------------------------------------------------
+    void complete()
+    {
+        if (pending)
+        {
+            finish(ID, vertex, fragment, cacheKey);
+            vertex = fragment = 0;
+            pending = false;
+        }
+        // 3. look all active uniforms up once, setters never ask GL again
+        uniforms.reflect(ID);
+        bindBlocks(ID);
+        buildMs = std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+    }
+
+    void discardReload()
+    {
+        if (!reloading)
+            return;
+        if (nextVertex)
+        {
+            glDeleteShader(nextVertex);
+            glDeleteShader(nextFragment);
+        }
+        GLState::current().forgetProgram(nextID);
+        glDeleteProgram(nextID);
+        nextID = nextVertex = nextFragment = 0;
+        reloading = false;
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
@@ -0,0 +1,390 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Hash.hpp>
+#include <ShaderSources.hpp>
+
+/* GLSL sources with #include, assembled without copying.
+ *
+ * Every file (a "fragment") is loaded once - copied from the override
+ * directory, or used in place from the table embedded in the program - and
+ * scanned once for its #include "name" lines and its #version line. The
+ * parsed fragments are kept for the life of the library, so a chunk shared
+ * by many programs is read and scanned a single time. Override files are
+ * copied rather than mmapped: they are the ones being edited, and an editor
+ * that saves by truncating in place would make a mapping fault under a
+ * variant built before the watcher's update() arrives.
+ *
+ * assemble() produces a program stage as a list of (pointer, length) spans
+ * into those fragments, ready for one glShaderSource call: the text between
+ * the #include lines, with the included files' spans in their place. Each
+ * file is included at most once per stage (an implicit #pragma once), so
+ * include cycles end by themselves. The only text assemble() writes itself is
+ * the #defines injected right after the #version line and the #line
+ * directives that keep compiler messages pointing at the right line; the
+ * file of a message is its index in ShaderSourceList::names.
+ */
+struct ShaderSourceList
+{
+    std::vector<const char*> strings;
+    std::vector<GLint> lengths;
+    std::vector<std::string> names;   // the files in the order #line numbers them
+    std::vector<std::string> files;   // those of them read from disk
+    std::deque<std::string> generated;  // #defines and #lines, stable addresses
+
+    void clear()
+    {
+        strings.clear();
+        lengths.clear();
+        names.clear();
+        files.clear();
+        generated.clear();
+    }
+
+    // characters over all spans
+    size_t size() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < lengths.size(); ++i)
+            total += (size_t)lengths[i];
+        return total;
+    }
+
+    // FNV-1a over the text, independent of how it is split into spans
+    uint64_t hash(uint64_t seed = FNV_OFFSET_BASIS) const
+    {
+        uint64_t value = seed;
+        for (size_t i = 0; i < strings.size(); ++i)
+            value = fnv1a64(strings[i], (size_t)lengths[i], value);
+        return value;
+    }
+};
+
+struct ShaderLibraryStats
+{
+    size_t files;         // fragments loaded and scanned
+    size_t bytes;         // their total size
+    size_t reused;        // fragment requests served without loading
+    double loadMs;        // time spent loading and scanning
+
+    ShaderLibraryStats() : files(0), bytes(0), reused(0), loadMs(0.0) {}
+};
+
+class ShaderLibrary
+{
+public:
+    // `directory` is searched before the embedded shaders; nullptr for the
+    // embedded ones only
+    explicit ShaderLibrary(const char* directory = shaderOverrideDir())
+        : directory(directory ? directory : "")
+    {
+    }
+
+    ShaderLibrary(const ShaderLibrary&) = delete;
+    ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+    // the stage `name` with `defines` ("NAME" or "NAME VALUE") injected after
+    // its #version line; false if it or one of its includes is missing
+    // ------------------------------------------------------------------------
+    bool assemble(const std::string& name, const std::vector<std::string>& defines, ShaderSourceList& out)
+    {
+        out.clear();
+        const Fragment* root = fragment(name);
+        if (!root)
+            return false;
+        std::string preamble;
+        for (size_t i = 0; i < defines.size(); ++i)
+            preamble += "#define " + defines[i] + "\n";
+        std::vector<const Fragment*> included;
+        return append(*root, preamble, out, included);
+    }
+
+    // new contents of the file at `path` (from a watcher) for the next
+    // assemble(); false if no fragment came from that file
+    // ------------------------------------------------------------------------
+    bool update(const std::string& path, std::string source)
+    {
+        for (auto& entry : fragments)
+        {
+            Fragment& fragment = *entry.second;
+            if (fragment.path != path)
+                continue;
+            fragment.owned.swap(source);
+            fragment.data = fragment.owned.data();
+            fragment.size = fragment.owned.size();
+            parse(fragment);
+            return true;
+        }
+        return false;
+    }
+
+    const ShaderLibraryStats& stats() const
+    {
+        return libraryStats;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // text [begin, end) of the fragment, or one of its #include lines
+    struct Piece
+    {
+        size_t begin, end;
+        std::string include;   // empty for text
+        unsigned int line;     // of the #include, 1-based
+    };
+
+    struct Fragment
+    {
+        std::string name;
+        std::string path;      // empty if embedded
+        std::string owned;     // contents read from `path` or given to update()
+        const char* data;
+        size_t size;
+        size_t versionEnd;     // just past the #version line, 0 if there is none
+        std::vector<Piece> pieces;
+
+        Fragment() : data(nullptr), size(0), versionEnd(0) {}
+    };
+
+    std::string directory;
+    std::unordered_map<std::string, std::unique_ptr<Fragment> > fragments;
+    ShaderLibraryStats libraryStats;
+
+    // the parsed file `name`, loaded on first use
+    // ------------------------------------------------------------------------
+    const Fragment* fragment(const std::string& name)
+    {
+        auto found = fragments.find(name);
+        if (found != fragments.end())
+        {
+            ++libraryStats.reused;
+            return found->second.get();
+        }
+        Clock::time_point start = Clock::now();
+        std::unique_ptr<Fragment> loaded(new Fragment());
+        loaded->name = name;
+        std::string path = directory.empty() ? std::string() : directory + "/" + name;
+        if (!path.empty() && readFile(path, loaded->owned))
+        {
+            loaded->path = path;
+            loaded->data = loaded->owned.data();
+            loaded->size = loaded->owned.size();
+        }
+        else if (const EmbeddedShader* embedded = findEmbeddedShader(name.c_str()))
+        {
+            loaded->data = embedded->source;
+            loaded->size = embedded->size;
+        }
+        else
+        {
+            std::cout << "ERROR::SHADER::SOURCE_NOT_FOUND: " << name << std::endl;
+            return nullptr;
+        }
+        parse(*loaded);
+        ++libraryStats.files;
+        libraryStats.bytes += loaded->size;
+        libraryStats.loadMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        Fragment* result = loaded.get();
+        fragments[name] = std::move(loaded);
+        return result;
+    }
+
+    // the whole file at `path`; false if it cannot be opened
+    static bool readFile(const std::string& path, std::string& source)
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file)
+            return false;
+        file.seekg(0, std::ios::end);
+        std::streamoff size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        if (size < 0)
+            return false;
+        source.resize((size_t)size);
+        file.read(&source[0], size);
+        source.resize((size_t)file.gcount());
+        return true;
+    }
+
+    // split the fragment at its #include lines and after its #version line
+    // ------------------------------------------------------------------------
+    static void parse(Fragment& fragment)
+    {
+        fragment.pieces.clear();
+        fragment.versionEnd = 0;
+        const char* text = fragment.data;
+        const size_t size = fragment.size;
+        size_t textBegin = 0;
+        unsigned int line = 1;
+        for (size_t begin = 0; begin < size; ++line)
+        {
+            size_t end = begin;
+            while (end < size && text[end] != '\n')
+                ++end;
+            size_t next = end < size ? end + 1 : end;
+            // a directive: optional blanks, '#', optional blanks, keyword
+            size_t i = begin;
+            while (i < end && (text[i] == ' ' || text[i] == '\t'))
+                ++i;
+            if (i < end && text[i] == '#')
+            {
+                ++i;
+                while (i < end && (text[i] == ' ' || text[i] == '\t'))
+                    ++i;
+                if (keyword(text, i, end, "include"))
+                {
+                    std::string name = includeName(text, i + 7, end);
+                    if (!name.empty())
+                    {
+                        addText(fragment, textBegin, begin);
+                        Piece piece;
+                        piece.begin = begin;
+                        piece.end = next;
+                        piece.include = name;
+                        piece.line = line;
+                        fragment.pieces.push_back(piece);
+                        textBegin = next;
+                    }
+                }
+                else if (fragment.versionEnd == 0 && keyword(text, i, end, "version"))
+                {
+                    addText(fragment, textBegin, next);
+                    fragment.versionEnd = next;
+                    textBegin = next;
+                }
+            }
+            begin = next;
+        }
+        addText(fragment, textBegin, size);
+    }
+
+    static bool keyword(const char* text, size_t at, size_t end, const char* word)
+    {
+        size_t length = std::char_traits<char>::length(word);
+        if (end - at < length || std::char_traits<char>::compare(text + at, word, length) != 0)
+            return false;
+        return at + length == end || text[at + length] == ' ' || text[at + length] == '\t' ||
+               text[at + length] == '"' || text[at + length] == '<' || text[at + length] == '\r';
+    }
+
+    // the name in "name" or <name>, empty if the line is malformed
+    static std::string includeName(const char* text, size_t at, size_t end)
+    {
+        while (at < end && (text[at] == ' ' || text[at] == '\t'))
+            ++at;
+        if (at >= end || (text[at] != '"' && text[at] != '<'))
+            return std::string();
+        char close = text[at] == '"' ? '"' : '>';
+        size_t first = ++at;
+        while (at < end && text[at] != close)
+            ++at;
+        return at < end ? std::string(text + first, at - first) : std::string();
+    }
+
+    static void addText(Fragment& fragment, size_t begin, size_t end)
+    {
+        if (end <= begin)
+            return;
+        Piece piece;
+        piece.begin = begin;
+        piece.end = end;
+        piece.line = 0;
+        fragment.pieces.push_back(piece);
+    }
+
+    static void addSpan(ShaderSourceList& out, const char* data, size_t length)
+    {
+        out.strings.push_back(data);
+        out.lengths.push_back((GLint)length);
+    }
+
+    static void addGenerated(ShaderSourceList& out, const std::string& text)
+    {
+        // a directive has to start a line, also after a file without a final newline
+        bool lineStart = out.strings.empty() || out.lengths.back() == 0 ||
+                         out.strings.back()[out.lengths.back() - 1] == '\n';
+        out.generated.push_back(lineStart ? text : "\n" + text);
+        addSpan(out, out.generated.back().data(), out.generated.back().size());
+    }
+
+    static std::string lineDirective(unsigned int line, size_t file)
+    {
+        char directive[48];
+        std::snprintf(directive, sizeof(directive), "#line %u %u\n", line, (unsigned int)file);
+        return directive;
+    }
+
+    // the spans of `fragment` and, recursively, of its includes
+    // ------------------------------------------------------------------------
+    bool append(const Fragment& fragment, const std::string& preamble, ShaderSourceList& out,
+                std::vector<const Fragment*>& included)
+    {
+        included.push_back(&fragment);
+        size_t file = out.names.size();
+        out.names.push_back(fragment.name);
+        if (!fragment.path.empty())
+            out.files.push_back(fragment.path);
+        bool root = included.size() == 1;
+        if (root && fragment.versionEnd == 0 && !preamble.empty())
+            addGenerated(out, preamble);
+        for (const Piece& piece : fragment.pieces)
+        {
+            if (piece.include.empty())
+            {
+                addSpan(out, fragment.data + piece.begin, piece.end - piece.begin);
+                if (root && piece.end == fragment.versionEnd && !preamble.empty())
+                {
+                    addGenerated(out, preamble);
+                    // the preamble's lines must not shift the file's
+                    addGenerated(out, lineDirective(lineOf(fragment, piece.end), file));
+                }
+                continue;
+            }
+            const Fragment* child = this->fragment(piece.include);
+            if (!child)
+            {
+                std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: " << piece.include << " in " << fragment.name
+                          << std::endl;
+                return false;
+            }
+            bool seen = false;
+            for (size_t i = 0; i < included.size() && !seen; ++i)
+                seen = included[i] == child;
+            if (seen)
+            {
+                addGenerated(out, lineDirective(piece.line + 1, file));
+                continue;
+            }
+            addGenerated(out, lineDirective(1, out.names.size()));
+            if (!append(*child, preamble, out, included))
+                return false;
+            addGenerated(out, lineDirective(piece.line + 1, file));
+        }
+        return true;
+    }
+
+    // line number of the line starting at `offset`
+    static unsigned int lineOf(const Fragment& fragment, size_t offset)
+    {
+        unsigned int line = 1;
+        for (size_t i = 0; i < offset && i < fragment.size; ++i)
+            line += fragment.data[i] == '\n';
+        return line;
+    }
+};
+#endif
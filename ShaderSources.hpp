@@ -0,0 +1,37 @@
+#ifndef SHADER_SOURCES_H
+#define SHADER_SOURCES_H
+
+#include <cstring>
+
+#include <EmbeddedShaders.hpp>
+
+/* GLSL sources by file name within shaders/.
+ *
+ * Every file of shaders/ is compiled into the program as a constexpr table
+ * (cmake/EmbedShaders.cmake), so a normal start reads no shader files and
+ * the binary runs from anywhere. For development, a build configured with
+ * -DSHADER_OVERRIDE_DIR=<dir> makes ShaderLibrary read the files from that
+ * directory first and fall back to the embedded copy; edits then show up
+ * without rebuilding, and hot reload watches the files. Release builds
+ * (NDEBUG) ignore the override and never touch the filesystem for shaders.
+ */
+inline const EmbeddedShader* findEmbeddedShader(const char* name)
+{
+    for (std::size_t i = 0; i < embedded_shaders::count; ++i)
+    {
+        if (std::strcmp(embedded_shaders::table[i].name, name) == 0)
+            return &embedded_shaders::table[i];
+    }
+    return nullptr;
+}
+
+// the override directory, or nullptr if shaders only come from the binary
+inline const char* shaderOverrideDir()
+{
+#if defined(SHADER_OVERRIDE_DIR) && !defined(NDEBUG)
+    return SHADER_OVERRIDE_DIR;
+#else
+    return nullptr;
+#endif
+}
+#endif
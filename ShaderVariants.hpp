@@ -0,0 +1,166 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ProgramCache.hpp>
+#include <Shader.hpp>
+#include <ShaderLibrary.hpp>
+
+/* Permutations of one program, selected by a 64-bit feature key.
+ *
+ * Every feature is a preprocessor symbol the shader sources test with
+ * #ifdef; feature() gives it a bit of the key. The variant for a key is the
+ * program built with the #defines of its set bits (injected after #version
+ * by ShaderLibrary), compiled the first time get() asks for it and kept by
+ * its key from then on. prewarm() issues the builds of a whole set of keys
+ * at once, asynchronously, so with KHR_parallel_shader_compile the driver
+ * compiles them side by side while the caller goes on; every variant also
+ * goes through the program binary cache like any other Shader.
+ *
+ *     ShaderVariants variants(library, "vertexShader.vs", "frameShader.fs");
+ *     const uint64_t FOG = variants.feature("FOG");
+ *     variants.get(FOG).use();
+ */
+struct VariantStats
+{
+    size_t variants;     // built or being built
+    size_t ready;
+    size_t fromCache;    // of the ready ones, loaded from the binary cache
+    double buildMs;      // summed build time of the ready ones
+
+    VariantStats() : variants(0), ready(0), fromCache(0), buildMs(0.0) {}
+};
+
+class ShaderVariants
+{
+public:
+    ShaderVariants(ShaderLibrary& library, const char* vertexName, const char* fragmentName,
+                   ProgramCache* cache = nullptr)
+        : library(library), vertexName(vertexName), fragmentName(fragmentName), cache(cache)
+    {
+    }
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    // the key bit of the feature `define` ("NAME" or "NAME VALUE"), added on
+    // first use; 0 once all 64 bits are taken
+    // ------------------------------------------------------------------------
+    uint64_t feature(const std::string& define)
+    {
+        for (size_t i = 0; i < features.size(); ++i)
+        {
+            if (features[i] == define)
+                return uint64_t(1) << i;
+        }
+        if (features.size() == 64)
+        {
+            std::cout << "ERROR::SHADER_VARIANTS::TOO_MANY_FEATURES: " << define << std::endl;
+            return 0;
+        }
+        features.push_back(define);
+        return uint64_t(1) << (features.size() - 1);
+    }
+
+    // the variant for `key`, built on first use; its use() and uniform()
+    // wait for the build, ready() tells without waiting
+    // ------------------------------------------------------------------------
+    Shader& get(uint64_t key)
+    {
+        return *variant(key, ShaderBuild::Sync);
+    }
+
+    // issue the builds of all `keys` not built yet, without waiting for them
+    void prewarm(const std::vector<uint64_t>& keys)
+    {
+        for (size_t i = 0; i < keys.size(); ++i)
+            variant(keys[i], ShaderBuild::Async);
+    }
+
+    // true once every variant built so far is ready; polls, never blocks with
+    // KHR_parallel_shader_compile
+    bool ready()
+    {
+        bool all = true;
+        for (auto& entry : variants)
+            all = entry.second->ready() && all;
+        return all;
+    }
+
+    // start rebuilding every variant from the library's current sources (see
+    // Shader::reload())
+    // ------------------------------------------------------------------------
+    void reload()
+    {
+        for (auto& entry : variants)
+            entry.second->reload();
+    }
+
+    // swap in the rebuilt variants that are done; true if any was swapped,
+    // their Uniform handles are then stale
+    bool updateReloads()
+    {
+        bool swapped = false;
+        for (auto& entry : variants)
+            swapped = entry.second->updateReload() || swapped;
+        return swapped;
+    }
+
+    // the defines of `key`
+    std::vector<std::string> defines(uint64_t key) const
+    {
+        std::vector<std::string> result;
+        for (size_t i = 0; i < features.size(); ++i)
+        {
+            if (key & (uint64_t(1) << i))
+                result.push_back(features[i]);
+        }
+        return result;
+    }
+
+    // files on disk the variants are built from
+    const std::vector<std::string>& sourceFiles() const
+    {
+        static const std::vector<std::string> none;
+        return variants.empty() ? none : variants.begin()->second->sourceFiles();
+    }
+
+    VariantStats stats() const
+    {
+        VariantStats result;
+        result.variants = variants.size();
+        for (auto& entry : variants)
+        {
+            const Shader& shader = *entry.second;
+            if (shader.isBuilding())
+                continue;
+            ++result.ready;
+            result.fromCache += shader.fromCache();
+            result.buildMs += shader.buildTime();
+        }
+        return result;
+    }
+
+private:
+    ShaderLibrary& library;
+    std::string vertexName, fragmentName;
+    ProgramCache* cache;
+    std::vector<std::string> features;   // bit i of a key is features[i]
+    std::unordered_map<uint64_t, std::unique_ptr<Shader> > variants;
+
+    Shader* variant(uint64_t key, ShaderBuild mode)
+    {
+        std::unique_ptr<Shader>& slot = variants[key];
+        if (!slot)
+            slot.reset(new Shader(library, vertexName.c_str(), fragmentName.c_str(), cache, mode, defines(key)));
+        return slot.get();
+    }
+};
+#endif
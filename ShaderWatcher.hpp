@@ -0,0 +1,217 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/* Background watcher for shader source files (inotify, Linux only).
+ *
+ * The directories of the watched files are watched rather than the files
+ * themselves: editors often save by writing a new file and renaming it over
+ * the old one, which would end a watch on the file. The watcher thread waits
+ * for writes and renames in them, lets a burst of events settle for a few
+ * milliseconds, then reads every changed file and queues its new source. The
+ * render thread picks the queue up with poll(), which costs one atomic load
+ * while nothing changed - no file I/O ever happens on the render thread.
+ *
+ * Files must be added with watch() before start(). Elsewhere than Linux
+ * start() returns false and poll() never reports anything.
+ */
+struct ShaderChange
+{
+    std::string path;
+    std::string source;
+    std::chrono::steady_clock::time_point detected;   // when the watcher saw the write
+};
+
+class ShaderWatcher
+{
+public:
+    ShaderWatcher() : running(false), changed(false), fd(-1) {}
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    ~ShaderWatcher()
+    {
+        stop();
+    }
+
+    void watch(const std::string& path)
+    {
+        size_t slash = path.rfind('/');
+        std::string directory = slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+        std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+        files[directory].push_back(Watched(name, path));
+    }
+
+    // start the watcher thread; false if inotify is not available
+    // ------------------------------------------------------------------------
+    bool start()
+    {
+#ifdef __linux__
+        if (running)
+            return true;
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+        {
+            std::cout << "ERROR::SHADER_WATCHER::INOTIFY_INIT_FAILED" << std::endl;
+            return false;
+        }
+        for (std::map<std::string, std::vector<Watched> >::iterator it = files.begin(); it != files.end(); ++it)
+        {
+            int wd = inotify_add_watch(fd, it->first.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (wd < 0)
+                std::cout << "ERROR::SHADER_WATCHER::WATCH_FAILED: " << it->first << std::endl;
+            else
+                directories[wd] = it->first;
+        }
+        running = true;
+        thread = std::thread(&ShaderWatcher::loop, this);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void stop()
+    {
+        if (!running)
+            return;
+        running = false;
+        thread.join();
+#ifdef __linux__
+        close(fd);
+#endif
+        fd = -1;
+    }
+
+    // render thread: move the changes queued since the last call to
+    // `changes`; false (and no locking) if there are none
+    // ------------------------------------------------------------------------
+    bool poll(std::vector<ShaderChange>& changes)
+    {
+        changes.clear();
+        if (!changed.load(std::memory_order_acquire))
+            return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        changes.swap(queue);
+        changed.store(false, std::memory_order_relaxed);
+        return !changes.empty();
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Watched
+    {
+        std::string name;   // within its directory
+        std::string path;
+
+        Watched(const std::string& name, const std::string& path) : name(name), path(path) {}
+    };
+
+    // time for a burst of events from one save to settle
+    enum { SETTLE_MS = 15 };
+
+    std::map<std::string, std::vector<Watched> > files;   // by directory
+    std::map<int, std::string> directories;               // by watch descriptor
+    std::atomic<bool> running;
+    std::atomic<bool> changed;
+    std::mutex mutex;
+    std::vector<ShaderChange> queue;
+    std::thread thread;
+    int fd;
+
+#ifdef __linux__
+    void loop()
+    {
+        std::vector<std::string> dirty;
+        while (running)
+        {
+            pollfd pfd = { fd, POLLIN, 0 };
+            // wake up now and then to notice stop()
+            if (::poll(&pfd, 1, 100) <= 0)
+                continue;
+            Clock::time_point detected = Clock::now();
+            dirty.clear();
+            readEvents(dirty);
+            std::this_thread::sleep_for(std::chrono::milliseconds(SETTLE_MS));
+            readEvents(dirty);
+            for (size_t i = 0; i < dirty.size(); ++i)
+            {
+                ShaderChange change;
+                change.path = dirty[i];
+                change.detected = detected;
+                if (!readFile(dirty[i], change.source))
+                    continue;
+                std::lock_guard<std::mutex> lock(mutex);
+                // a newer version of the same file replaces an unpicked one
+                size_t k = 0;
+                while (k < queue.size() && queue[k].path != change.path)
+                    ++k;
+                if (k < queue.size())
+                    queue[k] = change;
+                else
+                    queue.push_back(change);
+                changed.store(true, std::memory_order_release);
+            }
+        }
+    }
+
+    // paths of watched files named by the pending events, each once
+    void readEvents(std::vector<std::string>& dirty)
+    {
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* p = buffer; p < buffer + length;)
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                p += sizeof(inotify_event) + event->len;
+                std::map<int, std::string>::const_iterator directory = directories.find(event->wd);
+                if (!event->len || directory == directories.end())
+                    continue;
+                const std::vector<Watched>& watched = files.find(directory->second)->second;
+                for (size_t i = 0; i < watched.size(); ++i)
+                {
+                    if (watched[i].name == event->name &&
+                        std::find(dirty.begin(), dirty.end(), watched[i].path) == dirty.end())
+                        dirty.push_back(watched[i].path);
+                }
+            }
+        }
+    }
+#endif
+
+    static bool readFile(const std::string& path, std::string& source)
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER_WATCHER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        source = stream.str();
+        return true;
+    }
+};
+#endif
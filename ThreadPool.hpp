@@ -0,0 +1,152 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Small fixed-size pool used by the CPU side of the render pipeline.
+ *
+ * run() hands out task indices [0, taskCount) to the workers and to the
+ * calling thread, and returns once every task has finished. The callable is
+ * passed by reference through a plain function pointer, so dispatching work
+ * does not allocate - it is safe to call from the render loop every frame.
+ */
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency())
+        : generation(0), taskCount(0), nextTask(0), pendingTasks(0),
+          taskContext(nullptr), taskFunction(nullptr), stopping(false)
+    {
+        // the calling thread always takes part, so spawn one worker less
+        unsigned int workerCount = threadCount > 1 ? threadCount - 1 : 0;
+        for (unsigned int i = 0; i < workerCount; ++i)
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // number of threads that execute tasks, including the caller of run()
+    unsigned int size() const
+    {
+        return (unsigned int)workers.size() + 1;
+    }
+
+    // run task(i) for every i in [0, count) and wait for all of them
+    // ------------------------------------------------------------------------
+    template <typename Task>
+    void run(unsigned int count, Task& task)
+    {
+        if (count == 0)
+            return;
+        if (workers.empty() || count == 1)
+        {
+            for (unsigned int i = 0; i < count; ++i)
+                task(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            taskContext = &task;
+            taskFunction = &invoke<Task>;
+            taskCount = count;
+            nextTask.store(0);
+            pendingTasks.store(count);
+            ++generation;
+        }
+        wake.notify_all();
+        execute();
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pendingTasks.load() == 0; });
+        taskContext = nullptr;
+        taskFunction = nullptr;
+    }
+
+    // split [0, total) into `chunks` contiguous ranges and return range `chunk`
+    // ------------------------------------------------------------------------
+    static void chunkRange(size_t total, unsigned int chunks, unsigned int chunk, size_t& begin, size_t& end)
+    {
+        size_t base = total / chunks;
+        size_t extra = total % chunks;
+        begin = chunk * base + (chunk < extra ? chunk : extra);
+        end = begin + base + (chunk < extra ? 1 : 0);
+    }
+
+    // how many chunks are worth using for `total` items of at least `minChunk` each
+    unsigned int chunksFor(size_t total, size_t minChunk) const
+    {
+        size_t chunks = minChunk ? total / minChunk : total;
+        if (chunks < 1)
+            chunks = 1;
+        return chunks < size() ? (unsigned int)chunks : size();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned long long generation;
+    unsigned int taskCount;
+    std::atomic<unsigned int> nextTask;
+    std::atomic<unsigned int> pendingTasks;
+    void* taskContext;
+    void (*taskFunction)(void*, unsigned int);
+    bool stopping;
+
+    template <typename Task>
+    static void invoke(void* context, unsigned int index)
+    {
+        (*static_cast<Task*>(context))(index);
+    }
+
+    // grab task indices until none are left
+    void execute()
+    {
+        for (;;)
+        {
+            unsigned int index = nextTask.fetch_add(1);
+            if (index >= taskCount)
+                return;
+            taskFunction(taskContext, index);
+            if (pendingTasks.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.notify_one();
+            }
+        }
+    }
+
+    void workerLoop()
+    {
+        unsigned long long seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            execute();
+        }
+    }
+};
+#endif
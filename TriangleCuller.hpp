@@ -0,0 +1,358 @@
+#ifndef TRIANGLE_CULLER_H
+#define TRIANGLE_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <DepthKeys.hpp>
+#include <ThreadPool.hpp>
+
+/* Visibility pre-pass in front of the painter's sort.
+ *
+ * Each triangle's corners are taken to clip space (SIMD over the sorter's
+ * structure-of-arrays copy, 8 or 4 triangles at a time) and the triangle is
+ * dropped when
+ *
+ *   - all three corners are outside the same frustum plane, or
+ *   - (with back-face culling on) it does not face the camera.
+ *
+ * The facing test is the determinant of the corners' clip-space (x, y, w),
+ * whose sign is that of the projected area for any w, so triangles that
+ * cross the camera plane are classified right without clipping them. As in
+ * OpenGL's default, counter-clockwise on screen is the front.
+ *
+ * The survivors are compacted into a dense list of triangle ids in their
+ * original order, which the sorter then takes instead of all triangles.
+ */
+
+// counts of the last cull() call
+struct CullStats
+{
+    size_t triangles;
+    size_t visible;
+    size_t outside;      // rejected by the frustum
+    size_t backFacing;   // rejected by the facing test (inside the frustum)
+    double cullMs;
+
+    CullStats() : triangles(0), visible(0), outside(0), backFacing(0), cullMs(0.0) {}
+
+    // fraction of the triangles culled
+    double cullRatio() const
+    {
+        return triangles ? 1.0 - (double)visible / (double)triangles : 0.0;
+    }
+};
+
+namespace culling
+{
+    // clip = mvp * corner, one row per clip coordinate
+    struct ClipRows
+    {
+        float row[4][4];   // row[x|y|z|w][column]
+
+        explicit ClipRows(const glm::mat4& mvp)
+        {
+            for (int r = 0; r < 4; ++r)
+                for (int c = 0; c < 4; ++c)
+                    row[r][c] = mvp[c][r];
+        }
+    };
+
+    // per triangle: 0 visible, 1 outside, 2 back-facing
+    enum Verdict
+    {
+        VISIBLE = 0,
+        OUTSIDE = 1,
+        BACK_FACING = 2
+    };
+
+    inline int classifyScalar(const TriangleSoA& soa, const ClipRows& rows, size_t i, bool backFaces)
+    {
+        float clip[3][4];
+        for (int c = 0; c < 3; ++c)
+        {
+            float x = soa.corner[c][0][i], y = soa.corner[c][1][i], z = soa.corner[c][2][i];
+            for (int r = 0; r < 4; ++r)
+                clip[c][r] = rows.row[r][0] * x + rows.row[r][1] * y + rows.row[r][2] * z + rows.row[r][3];
+        }
+        // outside when all corners are beyond one plane: +-x, +-y, +-z against w
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (clip[0][axis] > clip[0][3] && clip[1][axis] > clip[1][3] && clip[2][axis] > clip[2][3])
+                return OUTSIDE;
+            if (clip[0][axis] < -clip[0][3] && clip[1][axis] < -clip[1][3] && clip[2][axis] < -clip[2][3])
+                return OUTSIDE;
+        }
+        if (backFaces)
+        {
+            float facing = clip[0][0] * (clip[1][1] * clip[2][3] - clip[2][1] * clip[1][3])
+                         - clip[1][0] * (clip[0][1] * clip[2][3] - clip[2][1] * clip[0][3])
+                         + clip[2][0] * (clip[0][1] * clip[1][3] - clip[1][1] * clip[0][3]);
+            if (!(facing > 0.0f))
+                return BACK_FACING;
+        }
+        return VISIBLE;
+    }
+
+    // survivors of [begin, end) go to out[0...]; returns how many
+    inline size_t cullScalar(const TriangleSoA& soa, const ClipRows& rows, bool backFaces, size_t begin, size_t end,
+                             uint32_t* out, size_t& outside, size_t& backFacing)
+    {
+        size_t kept = 0;
+        for (size_t i = begin; i < end; ++i)
+        {
+            int verdict = classifyScalar(soa, rows, i, backFaces);
+            outside += verdict == OUTSIDE;
+            backFacing += verdict == BACK_FACING;
+            if (verdict == VISIBLE)
+                out[kept++] = (uint32_t)i;
+        }
+        return kept;
+    }
+
+#if DEPTH_KEYS_X86
+    // survivors of [begin, end) to out[begin...]; stops at the last whole
+    // vector and reports where in `done`
+    __attribute__((target("sse4.1")))
+    inline size_t cullSSE41(const TriangleSoA& soa, const ClipRows& rows, bool backFaces, size_t begin, size_t end,
+                            uint32_t* out, size_t& outside, size_t& backFacing, size_t& done)
+    {
+        __m128 m[4][4];
+        for (int r = 0; r < 4; ++r)
+            for (int c = 0; c < 4; ++c)
+                m[r][c] = _mm_set1_ps(rows.row[r][c]);
+        const __m128 zero = _mm_setzero_ps();
+        size_t kept = begin;
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 clip[3][4];
+            for (int c = 0; c < 3; ++c)
+            {
+                __m128 x = _mm_loadu_ps(&soa.corner[c][0][i]);
+                __m128 y = _mm_loadu_ps(&soa.corner[c][1][i]);
+                __m128 z = _mm_loadu_ps(&soa.corner[c][2][i]);
+                for (int r = 0; r < 4; ++r)
+                {
+                    __m128 v = _mm_mul_ps(m[r][0], x);
+                    v = _mm_add_ps(v, _mm_mul_ps(m[r][1], y));
+                    v = _mm_add_ps(v, _mm_mul_ps(m[r][2], z));
+                    clip[c][r] = _mm_add_ps(v, m[r][3]);
+                }
+            }
+            __m128 outsideLanes = zero;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                __m128 above = _mm_cmpgt_ps(clip[0][axis], clip[0][3]);
+                __m128 below = _mm_cmplt_ps(clip[0][axis], _mm_sub_ps(zero, clip[0][3]));
+                for (int c = 1; c < 3; ++c)
+                {
+                    above = _mm_and_ps(above, _mm_cmpgt_ps(clip[c][axis], clip[c][3]));
+                    below = _mm_and_ps(below, _mm_cmplt_ps(clip[c][axis], _mm_sub_ps(zero, clip[c][3])));
+                }
+                outsideLanes = _mm_or_ps(outsideLanes, _mm_or_ps(above, below));
+            }
+            int outsideMask = _mm_movemask_ps(outsideLanes);
+            int backMask = 0;
+            if (backFaces)
+            {
+                __m128 a = _mm_mul_ps(clip[0][0], _mm_sub_ps(_mm_mul_ps(clip[1][1], clip[2][3]), _mm_mul_ps(clip[2][1], clip[1][3])));
+                __m128 b = _mm_mul_ps(clip[1][0], _mm_sub_ps(_mm_mul_ps(clip[0][1], clip[2][3]), _mm_mul_ps(clip[2][1], clip[0][3])));
+                __m128 c = _mm_mul_ps(clip[2][0], _mm_sub_ps(_mm_mul_ps(clip[0][1], clip[1][3]), _mm_mul_ps(clip[1][1], clip[0][3])));
+                __m128 facing = _mm_add_ps(_mm_sub_ps(a, b), c);
+                // not (facing > 0), so NaN and edge-on count as back-facing
+                backMask = ~_mm_movemask_ps(_mm_cmpgt_ps(facing, zero)) & 0xF & ~outsideMask;
+            }
+            outside += __builtin_popcount(outsideMask);
+            backFacing += __builtin_popcount(backMask);
+            int visible = ~(outsideMask | backMask) & 0xF;
+            while (visible)
+            {
+                int lane = __builtin_ctz(visible);
+                out[kept++] = (uint32_t)(i + lane);
+                visible &= visible - 1;
+            }
+        }
+        done = i;
+        return kept - begin;
+    }
+
+    __attribute__((target("avx2")))
+    inline size_t cullAVX2(const TriangleSoA& soa, const ClipRows& rows, bool backFaces, size_t begin, size_t end,
+                           uint32_t* out, size_t& outside, size_t& backFacing, size_t& done)
+    {
+        __m256 m[4][4];
+        for (int r = 0; r < 4; ++r)
+            for (int c = 0; c < 4; ++c)
+                m[r][c] = _mm256_set1_ps(rows.row[r][c]);
+        const __m256 zero = _mm256_setzero_ps();
+        size_t kept = begin;
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256 clip[3][4];
+            for (int c = 0; c < 3; ++c)
+            {
+                __m256 x = _mm256_loadu_ps(&soa.corner[c][0][i]);
+                __m256 y = _mm256_loadu_ps(&soa.corner[c][1][i]);
+                __m256 z = _mm256_loadu_ps(&soa.corner[c][2][i]);
+                for (int r = 0; r < 4; ++r)
+                {
+                    __m256 v = _mm256_mul_ps(m[r][0], x);
+                    v = _mm256_add_ps(v, _mm256_mul_ps(m[r][1], y));
+                    v = _mm256_add_ps(v, _mm256_mul_ps(m[r][2], z));
+                    clip[c][r] = _mm256_add_ps(v, m[r][3]);
+                }
+            }
+            __m256 outsideLanes = zero;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                __m256 above = _mm256_cmp_ps(clip[0][axis], clip[0][3], _CMP_GT_OQ);
+                __m256 below = _mm256_cmp_ps(clip[0][axis], _mm256_sub_ps(zero, clip[0][3]), _CMP_LT_OQ);
+                for (int c = 1; c < 3; ++c)
+                {
+                    above = _mm256_and_ps(above, _mm256_cmp_ps(clip[c][axis], clip[c][3], _CMP_GT_OQ));
+                    below = _mm256_and_ps(below, _mm256_cmp_ps(clip[c][axis], _mm256_sub_ps(zero, clip[c][3]), _CMP_LT_OQ));
+                }
+                outsideLanes = _mm256_or_ps(outsideLanes, _mm256_or_ps(above, below));
+            }
+            int outsideMask = _mm256_movemask_ps(outsideLanes);
+            int backMask = 0;
+            if (backFaces)
+            {
+                __m256 a = _mm256_mul_ps(clip[0][0], _mm256_sub_ps(_mm256_mul_ps(clip[1][1], clip[2][3]), _mm256_mul_ps(clip[2][1], clip[1][3])));
+                __m256 b = _mm256_mul_ps(clip[1][0], _mm256_sub_ps(_mm256_mul_ps(clip[0][1], clip[2][3]), _mm256_mul_ps(clip[2][1], clip[0][3])));
+                __m256 c = _mm256_mul_ps(clip[2][0], _mm256_sub_ps(_mm256_mul_ps(clip[0][1], clip[1][3]), _mm256_mul_ps(clip[1][1], clip[0][3])));
+                __m256 facing = _mm256_add_ps(_mm256_sub_ps(a, b), c);
+                backMask = ~_mm256_movemask_ps(_mm256_cmp_ps(facing, zero, _CMP_GT_OQ)) & 0xFF & ~outsideMask;
+            }
+            outside += __builtin_popcount(outsideMask);
+            backFacing += __builtin_popcount(backMask);
+            int visible = ~(outsideMask | backMask) & 0xFF;
+            while (visible)
+            {
+                int lane = __builtin_ctz(visible);
+                out[kept++] = (uint32_t)(i + lane);
+                visible &= visible - 1;
+            }
+        }
+        done = i;
+        return kept - begin;
+    }
+#endif
+}
+
+class TriangleCuller
+{
+public:
+    explicit TriangleCuller(ThreadPool& pool)
+        : pool(pool), enabled(true), backFaces(false), simdLevel(detectSimdLevel())
+    {
+    }
+
+    // whether the pipeline culls at all; off sends every triangle to the sort
+    void setEnabled(bool enable)
+    {
+        enabled = enable;
+    }
+
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    // also drop triangles facing away; only for closed or one-sided meshes
+    void setBackFaceCulling(bool enable)
+    {
+        backFaces = enable;
+    }
+
+    bool backFaceCulling() const
+    {
+        return backFaces;
+    }
+
+    void setSimdLevel(SimdLevel level)
+    {
+        simdLevel = std::min(level, detectSimdLevel());
+    }
+
+    const CullStats& stats() const
+    {
+        return frameStats;
+    }
+
+    // ids of the triangles of `soa` that may be visible through
+    // projection * modelView, in ascending order
+    // ------------------------------------------------------------------------
+    void cull(const TriangleSoA& soa, const glm::mat4& modelView, const glm::mat4& projection,
+              std::vector<uint32_t>& visible)
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        size_t count = soa.count;
+        visible.resize(count);
+        culling::ClipRows rows(projection * modelView);
+
+        // chunks of whole SIMD blocks; each compacts into its own range first
+        const size_t BLOCK = 8;
+        size_t blocks = (count + BLOCK - 1) / BLOCK;
+        unsigned int chunks = pool.chunksFor(count, 16384);
+        chunkKept.assign(chunks, 0);
+        chunkOutside.assign(chunks, 0);
+        chunkBackFacing.assign(chunks, 0);
+        auto cullChunk = [&](unsigned int chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(blocks, chunks, chunk, begin, end);
+            begin = std::min(begin * BLOCK, count);
+            end = std::min(end * BLOCK, count);
+            size_t outside = 0, backFacing = 0, done = begin, kept = 0;
+#if DEPTH_KEYS_X86
+            if (simdLevel == SimdLevel::AVX2)
+                kept = culling::cullAVX2(soa, rows, backFaces, begin, end, visible.data(), outside, backFacing, done);
+            else if (simdLevel == SimdLevel::SSE41)
+                kept = culling::cullSSE41(soa, rows, backFaces, begin, end, visible.data(), outside, backFacing, done);
+#endif
+            kept += culling::cullScalar(soa, rows, backFaces, done, end, visible.data() + begin + kept, outside, backFacing);
+            chunkKept[chunk] = kept;
+            chunkOutside[chunk] = outside;
+            chunkBackFacing[chunk] = backFacing;
+        };
+        pool.run(chunks, cullChunk);
+
+        // close the gaps between the chunks' survivors
+        frameStats.triangles = count;
+        frameStats.outside = 0;
+        frameStats.backFacing = 0;
+        size_t total = 0;
+        for (unsigned int chunk = 0; chunk < chunks; ++chunk)
+        {
+            size_t begin, end;
+            ThreadPool::chunkRange(blocks, chunks, chunk, begin, end);
+            begin = std::min(begin * BLOCK, count);
+            if (total != begin)
+                std::copy(visible.begin() + begin, visible.begin() + begin + chunkKept[chunk], visible.begin() + total);
+            total += chunkKept[chunk];
+            frameStats.outside += chunkOutside[chunk];
+            frameStats.backFacing += chunkBackFacing[chunk];
+        }
+        visible.resize(total);
+        frameStats.visible = total;
+        frameStats.cullMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+private:
+    ThreadPool& pool;
+    bool enabled;
+    bool backFaces;
+    SimdLevel simdLevel;
+    CullStats frameStats;
+    std::vector<size_t> chunkKept;
+    std::vector<size_t> chunkOutside;
+    std::vector<size_t> chunkBackFacing;
+};
+#endif
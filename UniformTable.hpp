@@ -0,0 +1,201 @@
+#ifndef UNIFORM_TABLE_H
+#define UNIFORM_TABLE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <Hash.hpp>
+
+/* Active uniforms of a linked program, looked up by name without GL calls.
+ *
+ * reflect() asks GL once for every active uniform (glGetActiveUniform) and
+ * its location, and stores them in a flat open-addressing table keyed by the
+ * FNV-1a hash of the name. Arrays are reachable both as "name" and
+ * "name[0]"; uniforms inside blocks have no location and are left out.
+ *
+ * Name lookups are meant for setup: resolve a Uniform<T> handle once and the
+ * hot path is a single glUniform* call. Every lookup by name - through the
+ * table or GL - bumps a global counter, so a render loop can check that its
+ * steady state does none.
+ */
+template <typename T>
+struct Uniform
+{
+    GLint location;
+
+    Uniform() : location(-1) {}
+    explicit Uniform(GLint location) : location(location) {}
+
+    bool valid() const
+    {
+        return location >= 0;
+    }
+};
+
+// the GL type a Uniform<T> has to match
+template <typename T> struct UniformType;
+template <> struct UniformType<bool>      { static GLenum value() { return GL_BOOL; } };
+template <> struct UniformType<int>       { static GLenum value() { return GL_INT; } };
+template <> struct UniformType<float>     { static GLenum value() { return GL_FLOAT; } };
+template <> struct UniformType<glm::vec2> { static GLenum value() { return GL_FLOAT_VEC2; } };
+template <> struct UniformType<glm::vec3> { static GLenum value() { return GL_FLOAT_VEC3; } };
+template <> struct UniformType<glm::vec4> { static GLenum value() { return GL_FLOAT_VEC4; } };
+template <> struct UniformType<glm::mat3> { static GLenum value() { return GL_FLOAT_MAT3; } };
+template <> struct UniformType<glm::mat4> { static GLenum value() { return GL_FLOAT_MAT4; } };
+
+inline uint64_t uniformNameHash(const char* name)
+{
+    return fnv1a64(name, std::strlen(name));
+}
+
+/* A uniform name with its hash. String literals convert to it implicitly;
+ * declared constexpr, the compiler does the hashing:
+ *
+ *     constexpr UniformName MODEL("model");
+ *     shader.set(MODEL, matrix);   // a table probe, no hashing, no allocation
+ */
+struct UniformName
+{
+    const char* text;
+    uint64_t hash;
+
+    constexpr UniformName(const char* text) : text(text), hash(fnv1a64String(text)) {}
+};
+
+class UniformTable
+{
+public:
+    struct Entry
+    {
+        uint64_t hash;
+        GLint location;
+        GLenum type;
+        GLint size;          // array length, 1 for plain uniforms
+        std::string name;
+
+        Entry() : hash(0), location(-1), type(0), size(0) {}
+    };
+
+    UniformTable() : count(0) {}
+
+    // rebuild the table from the active uniforms of `program`
+    // ------------------------------------------------------------------------
+    void reflect(GLuint program)
+    {
+        slots.clear();
+        count = 0;
+        GLint active = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &active);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        // at most half full, arrays take two slots
+        size_t capacity = 16;
+        while (capacity < (size_t)active * 4)
+            capacity *= 2;
+        slots.assign(capacity, Entry());
+
+        std::vector<char> name(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < active; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+            std::string full(name.data(), length);
+            GLint location = glGetUniformLocation(program, full.c_str());
+            if (location < 0)
+                continue;
+            insert(full, location, type, size);
+            // "lights[0]" is also reachable as "lights"
+            size_t bracket = full.size() > 3 ? full.rfind("[0]") : std::string::npos;
+            if (bracket != std::string::npos && bracket + 3 == full.size())
+                insert(full.substr(0, bracket), location, type, size);
+        }
+    }
+
+    // the entry for `name`, or nullptr; counts as a lookup
+    const Entry* find(const char* name) const
+    {
+        return find(name, uniformNameHash(name));
+    }
+
+    const Entry* find(const UniformName& name) const
+    {
+        return find(name.text, name.hash);
+    }
+
+    // location of `name`, -1 (ignored by glUniform*) if it is not active
+    GLint location(const char* name) const
+    {
+        const Entry* entry = find(name);
+        return entry ? entry->location : -1;
+    }
+
+    GLint location(const UniformName& name) const
+    {
+        const Entry* entry = find(name);
+        return entry ? entry->location : -1;
+    }
+
+    // uniforms in the table (array aliases included)
+    size_t size() const
+    {
+        return count;
+    }
+
+    // lookups by name since the last resetLookups(), over all tables
+    static size_t lookups()
+    {
+        return lookupCounter();
+    }
+
+    static void resetLookups()
+    {
+        lookupCounter() = 0;
+    }
+
+private:
+    std::vector<Entry> slots;   // empty slots have location -1
+    size_t count;
+
+    static size_t& lookupCounter()
+    {
+        static size_t counter = 0;
+        return counter;
+    }
+
+    const Entry* find(const char* name, uint64_t hash) const
+    {
+        ++lookupCounter();
+        if (slots.empty())
+            return nullptr;
+        size_t mask = slots.size() - 1;
+        for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask)
+        {
+            const Entry& slot = slots[i];
+            if (slot.location < 0)
+                return nullptr;
+            if (slot.hash == hash && slot.name == name)
+                return &slot;
+        }
+    }
+
+    void insert(const std::string& name, GLint location, GLenum type, GLint size)
+    {
+        uint64_t hash = uniformNameHash(name.c_str());
+        size_t mask = slots.size() - 1;
+        size_t i = (size_t)hash & mask;
+        while (slots[i].location >= 0)
+            i = (i + 1) & mask;
+        slots[i].hash = hash;
+        slots[i].location = location;
+        slots[i].type = type;
+        slots[i].size = size;
+        slots[i].name = name;
+        ++count;
+    }
+};
+#endif
@@ -0,0 +1,424 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <Geometry.hpp>
+
+/* Compact vertex encodings for GPU buffers.
+ *
+ * A VertexFormat picks an encoding per attribute; encodeMesh() turns a
+ * Geometry (position, color, optionally a normal - stride 6 or 9 floats)
+ * into the interleaved bytes and the index buffer a Mesh uploads as they
+ * are:
+ *
+ *     position  Float32   12 bytes
+ *               Half       8 bytes, 3 halves + padding
+ *               Snorm16    8 bytes, 3 shorts + padding
+ *     color     Float32   12 bytes
+ *               Rgba8      4 bytes, normalized
+ *     normal    Float32   12 bytes (vertex shader feature NORMALS)
+ *               Octahedral 4 bytes, 2 snorm16 (NORMALS and
+ *                          OCTAHEDRAL_NORMALS, decoded by
+ *                          shaders/octahedral.glsl)
+ *
+ * Quantized positions are stored relative to the bounding box, mapped to
+ * [-1, 1]; EncodedMesh::decode() is the matrix that maps them back, folded
+ * into the model matrix so shaders read them like plain floats. Indices are
+ * 16-bit whenever the vertex count allows. The compact format (Snorm16,
+ * Rgba8) takes 12 bytes per vertex against the 24 of the float layout.
+ */
+enum class PositionEncoding
+{
+    Float32,
+    Half,
+    Snorm16
+};
+
+enum class ColorEncoding
+{
+    Float32,
+    Rgba8
+};
+
+enum class NormalEncoding
+{
+    None,
+    Float32,
+    Octahedral
+};
+
+// attribute locations the shaders declare
+enum VertexLocation
+{
+    POSITION_LOCATION = 0,
+    COLOR_LOCATION = 1,
+    NORMAL_LOCATION = 2
+};
+
+struct VertexAttribute
+{
+    GLuint location;
+    GLint components;
+    GLenum type;
+    GLboolean normalized;
+    unsigned int offset;      // bytes from the start of the vertex
+};
+
+struct VertexFormat
+{
+    PositionEncoding position;
+    ColorEncoding color;
+    NormalEncoding normal;
+
+    VertexFormat(PositionEncoding position = PositionEncoding::Snorm16, ColorEncoding color = ColorEncoding::Rgba8,
+                 NormalEncoding normal = NormalEncoding::Octahedral)
+        : position(position), color(color), normal(normal)
+    {
+    }
+
+    // the layout of Geometry itself
+    static VertexFormat floats()
+    {
+        return VertexFormat(PositionEncoding::Float32, ColorEncoding::Float32, NormalEncoding::Float32);
+    }
+
+    unsigned int positionSize() const
+    {
+        return position == PositionEncoding::Float32 ? 12 : 8;
+    }
+
+    unsigned int colorSize() const
+    {
+        return color == ColorEncoding::Float32 ? 12 : 4;
+    }
+
+    unsigned int normalSize() const
+    {
+        return normal == NormalEncoding::None ? 0 : normal == NormalEncoding::Float32 ? 12 : 4;
+    }
+
+    // bytes per vertex of geometry with (`normals`) or without normals
+    unsigned int stride(bool normals) const
+    {
+        return positionSize() + colorSize() + (normals ? normalSize() : 0);
+    }
+
+    // the attributes in buffer order, to be passed to glVertexAttribPointer;
+    // returns how many of `out` were filled
+    // ------------------------------------------------------------------------
+    size_t attributes(bool normals, VertexAttribute out[3]) const
+    {
+        VertexAttribute positionAttribute = { POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 0 };
+        if (position == PositionEncoding::Half)
+            positionAttribute.type = GL_HALF_FLOAT;
+        else if (position == PositionEncoding::Snorm16)
+        {
+            positionAttribute.type = GL_SHORT;
+            positionAttribute.normalized = GL_TRUE;
+        }
+        VertexAttribute colorAttribute = { COLOR_LOCATION, 3, GL_FLOAT, GL_FALSE, positionSize() };
+        if (color == ColorEncoding::Rgba8)
+        {
+            colorAttribute.components = 4;
+            colorAttribute.type = GL_UNSIGNED_BYTE;
+            colorAttribute.normalized = GL_TRUE;
+        }
+        out[0] = positionAttribute;
+        out[1] = colorAttribute;
+        if (!normals || normal == NormalEncoding::None)
+            return 2;
+        VertexAttribute normalAttribute = { NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, positionSize() + colorSize() };
+        if (normal == NormalEncoding::Octahedral)
+        {
+            normalAttribute.components = 2;
+            normalAttribute.type = GL_SHORT;
+            normalAttribute.normalized = GL_TRUE;
+        }
+        out[2] = normalAttribute;
+        return 3;
+    }
+};
+
+// scalar encodings
+// ----------------------------------------------------------------------------
+
+// IEEE 754 half, round to nearest even
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t biased = (bits >> 23) & 0xffu;
+    uint32_t mantissa = bits & 0x7fffffu;
+    if (biased == 0xffu)
+        return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+    int exponent = (int)biased - 127 + 15;
+    if (exponent >= 31)
+        return (uint16_t)(sign | 0x7c00u);
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+            return (uint16_t)sign;
+        mantissa |= 0x800000u;
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1u);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+            ++half;
+        return (uint16_t)(sign | half);
+    }
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fffu;
+    // a carry out of the mantissa correctly bumps the exponent
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        ++half;
+    return (uint16_t)half;
+}
+
+inline float halfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+    uint32_t bits;
+    if (exponent == 0x1fu)
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    else if (exponent != 0)
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    else if (mantissa == 0)
+        bits = sign;
+    else
+    {
+        // subnormal: normalize
+        exponent = 127 - 15 + 1;
+        while (!(mantissa & 0x400u))
+        {
+            mantissa <<= 1;
+            --exponent;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline int16_t floatToSnorm16(float value)
+{
+    value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+    return (int16_t)std::lround(value * 32767.0f);
+}
+
+// as GL reads a normalized GL_SHORT
+inline float snorm16ToFloat(int16_t value)
+{
+    float decoded = value / 32767.0f;
+    return decoded < -1.0f ? -1.0f : decoded;
+}
+
+inline uint8_t floatToUnorm8(float value)
+{
+    value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+    return (uint8_t)std::lround(value * 255.0f);
+}
+
+// unit vector to the octahedron, unfolded onto [-1, 1]^2
+inline glm::vec2 octahedralEncode(const glm::vec3& normal)
+{
+    float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    if (sum == 0.0f)
+        return glm::vec2(0.0f);
+    glm::vec2 p(normal.x / sum, normal.y / sum);
+    if (normal.z < 0.0f)
+    {
+        glm::vec2 folded((1.0f - std::fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+                         (1.0f - std::fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+        p = folded;
+    }
+    return p;
+}
+
+inline glm::vec3 octahedralDecode(const glm::vec2& encoded)
+{
+    glm::vec3 n(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+    float t = n.z < 0.0f ? -n.z : 0.0f;
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+// whole meshes
+// ----------------------------------------------------------------------------
+
+// one level of detail: a range of the mesh's index buffer, drawn with the
+// same vertices as the others (see MeshSimplifier.hpp)
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;          // how far the level strays from the full mesh, in its units
+    uint32_t reserved;
+};
+
+// axis-aligned bounding box of the positions, in the geometry's own units
+// whatever the encoding
+struct MeshBounds
+{
+    glm::vec3 center;
+    glm::vec3 extent;     // half the size along each axis
+
+    MeshBounds() : center(0.0f), extent(0.0f) {}
+};
+
+struct EncodedMesh
+{
+    VertexFormat format;
+    bool normals;                         // geometry had normals and the format keeps them
+    std::vector<unsigned char> vertices;  // interleaved, format.stride(normals) bytes each
+    std::vector<unsigned char> indices;   // 16- or 32-bit
+    GLenum indexType;                     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    size_t vertexCount, indexCount;
+    glm::vec3 offset, scale;              // quantized position * scale + offset
+    MeshBounds bounds;
+    std::vector<MeshLod> lods;            // finest first; empty for a single level
+
+    EncodedMesh()
+        : normals(false), indexType(GL_UNSIGNED_INT), vertexCount(0), indexCount(0), offset(0.0f), scale(1.0f)
+    {
+    }
+
+    unsigned int stride() const
+    {
+        return format.stride(normals);
+    }
+
+    // maps the stored positions back to the geometry's
+    glm::mat4 decode() const
+    {
+        return glm::scale(glm::translate(glm::mat4(1.0f), offset), scale);
+    }
+
+    // position of `vertex` as the GPU will see it, after decode()
+    glm::vec3 position(size_t vertex) const
+    {
+        const unsigned char* v = &vertices[vertex * stride()];
+        glm::vec3 p;
+        if (format.position == PositionEncoding::Float32)
+            std::memcpy(&p[0], v, 12);
+        else
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                uint16_t raw;
+                std::memcpy(&raw, v + i * 2, 2);
+                p[i] = format.position == PositionEncoding::Half ? halfToFloat(raw) : snorm16ToFloat((int16_t)raw);
+            }
+        }
+        return p * scale + offset;
+    }
+};
+
+// encode `geometry` (stride 6: position, color; 9: plus normal) in `format`
+// ----------------------------------------------------------------------------
+inline void encodeMesh(const Geometry& geometry, const VertexFormat& format, EncodedMesh& out)
+{
+    out.format = format;
+    out.normals = geometry.stride >= 9 && format.normal != NormalEncoding::None;
+    out.vertexCount = geometry.vertexCount();
+    out.indexCount = geometry.indices.size();
+    out.offset = glm::vec3(0.0f);
+    out.scale = glm::vec3(1.0f);
+    out.bounds = MeshBounds();
+    if (out.vertexCount > 0)
+    {
+        glm::vec3 low = geometry.position(0), high = low;
+        for (size_t i = 1; i < out.vertexCount; ++i)
+        {
+            low = glm::min(low, geometry.position((unsigned int)i));
+            high = glm::max(high, geometry.position((unsigned int)i));
+        }
+        out.bounds.center = (low + high) * 0.5f;
+        out.bounds.extent = (high - low) * 0.5f;
+    }
+
+    // quantized positions span [-1, 1] over the bounding box
+    if (format.position != PositionEncoding::Float32 && out.vertexCount > 0)
+    {
+        out.offset = out.bounds.center;
+        out.scale = out.bounds.extent;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (out.scale[i] <= 0.0f)
+                out.scale[i] = 1.0f;
+        }
+    }
+
+    const unsigned int stride = out.stride();
+    out.vertices.assign(out.vertexCount * stride, 0);
+    for (size_t i = 0; i < out.vertexCount; ++i)
+    {
+        const float* in = &geometry.vertices[i * geometry.stride];
+        unsigned char* v = &out.vertices[i * stride];
+        if (format.position == PositionEncoding::Float32)
+            std::memcpy(v, in, 12);
+        else
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                float relative = (in[c] - out.offset[c]) / out.scale[c];
+                uint16_t raw = format.position == PositionEncoding::Half ? floatToHalf(relative)
+                                                                         : (uint16_t)floatToSnorm16(relative);
+                std::memcpy(v + c * 2, &raw, 2);
+            }
+        }
+        v += format.positionSize();
+        if (format.color == ColorEncoding::Float32)
+            std::memcpy(v, in + 3, 12);
+        else
+        {
+            v[0] = floatToUnorm8(in[3]);
+            v[1] = floatToUnorm8(in[4]);
+            v[2] = floatToUnorm8(in[5]);
+            v[3] = 255;
+        }
+        v += format.colorSize();
+        if (!out.normals)
+            continue;
+        if (format.normal == NormalEncoding::Float32)
+            std::memcpy(v, in + 6, 12);
+        else
+        {
+            glm::vec2 encoded = octahedralEncode(glm::vec3(in[6], in[7], in[8]));
+            int16_t raw[2] = { floatToSnorm16(encoded.x), floatToSnorm16(encoded.y) };
+            std::memcpy(v, raw, 4);
+        }
+    }
+
+    // the smallest index type that addresses every vertex
+    out.indexType = out.vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    if (out.indexType == GL_UNSIGNED_INT)
+    {
+        out.indices.resize(out.indexCount * 4);
+        if (out.indexCount)
+            std::memcpy(out.indices.data(), geometry.indices.data(), out.indexCount * 4);
+    }
+    else
+    {
+        out.indices.resize(out.indexCount * 2);
+        for (size_t i = 0; i < out.indexCount; ++i)
+        {
+            uint16_t index = (uint16_t)geometry.indices[i];
+            std::memcpy(&out.indices[i * 2], &index, 2);
+        }
+    }
+}
+#endif
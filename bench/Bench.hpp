@@ -0,0 +1,46 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+/* Tiny timing helpers shared by the benchmarks. Every measurement runs the
+ * body a few times and keeps the best run, which filters out most of the
+ * scheduler and cache-warming noise without needing a framework.
+ */
+namespace bench
+{
+    inline double nowMs()
+    {
+        return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // best wall time of `runs` calls to body(), in milliseconds
+    template<class Body>
+    double bestOf(int runs, Body body)
+    {
+        double best = 1e30;
+        for (int run = 0; run < runs; ++run)
+        {
+            double start = nowMs();
+            body();
+            best = std::min(best, nowMs() - start);
+        }
+        return best;
+    }
+
+    // positional integer argument with a default
+    inline long argOr(int argc, char** argv, int index, long fallback)
+    {
+        return index < argc ? std::strtol(argv[index], nullptr, 10) : fallback;
+    }
+
+    inline void report(const char* name, double ms, size_t items, const char* unit)
+    {
+        std::printf("  %-24s %9.3f ms  %9.1f M%s/s\n", name, ms, items / (ms * 1000.0), unit);
+    }
+}
+#endif
@@ -0,0 +1,90 @@
+// Painter's depth keys: the scalar glm path the sorter used to take against
+// the SoA batch paths of DepthKeys.hpp.
+//
+//     depth_keys_bench [triangles] [runs]
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <DepthKeys.hpp>
+#include <Geometry.hpp>
+#include <RadixSort.hpp>
+
+#include "Bench.hpp"
+
+// per triangle: transform the corners with glm and keep the farthest z
+static void glmKeys(const Geometry& geometry, const glm::mat4& modelView, uint32_t* out)
+{
+    size_t count = geometry.triangleCount();
+    for (size_t i = 0; i < count; ++i)
+    {
+        float farthest = 0.0f;
+        for (int c = 0; c < 3; ++c)
+        {
+            glm::vec4 view = modelView * glm::vec4(geometry.position(geometry.indices[i * 3 + c]), 1.0f);
+            farthest = c == 0 ? view.z : std::min(farthest, view.z);
+        }
+        out[i] = floatToSortableKey(farthest);
+    }
+}
+
+static size_t mismatches(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b)
+{
+    size_t differ = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+        differ += a[i] != b[i];
+    return differ;
+}
+
+int main(int argc, char** argv)
+{
+    size_t triangles = (size_t)bench::argOr(argc, argv, 1, 1000000);
+    int runs = (int)bench::argOr(argc, argv, 2, 10);
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> coord(-10.0f, 10.0f);
+    Geometry geometry;
+    geometry.vertices.reserve(triangles * 3 * geometry.stride);
+    for (size_t i = 0; i < triangles * 3; ++i)
+    {
+        float vertex[6] = { coord(rng), coord(rng), coord(rng), 1.0f, 1.0f, 1.0f };
+        geometry.vertices.insert(geometry.vertices.end(), vertex, vertex + 6);
+        geometry.indices.push_back((unsigned int)i);
+    }
+    glm::mat4 modelView = glm::lookAt(glm::vec3(3.0f, 4.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    std::printf("depth keys, %zu triangles, best of %d (CPU: %s)\n",
+                triangles, runs, simdLevelName(detectSimdLevel()));
+
+    std::vector<uint32_t> reference(triangles), keys(triangles);
+    double ms = bench::bestOf(runs, [&]() { glmKeys(geometry, modelView, reference.data()); });
+    bench::report("glm mat4 * vec4", ms, triangles, "tri");
+
+    TriangleSoA soa;
+    ms = bench::bestOf(1, [&]() { soa.build(geometry); });
+    bench::report("SoA build (once)", ms, triangles, "tri");
+
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2 };
+    for (SimdLevel level : levels)
+    {
+        if (level > detectSimdLevel())
+        {
+            std::printf("  %-24s not supported\n", simdLevelName(level));
+            continue;
+        }
+        std::fill(keys.begin(), keys.end(), 0u);
+        ms = bench::bestOf(runs, [&]() { computeDepthKeys(soa, modelView, keys.data(), 0, triangles, level); });
+        char name[32];
+        std::snprintf(name, sizeof(name), "SoA %s", simdLevelName(level));
+        bench::report(name, ms, triangles, "tri");
+        // glm sums in a different order, so allow the odd last-bit difference
+        size_t differ = mismatches(reference, keys);
+        if (differ > triangles / 1000)
+            std::printf("  ERROR::DEPTH_KEYS_BENCH::MISMATCH: %zu keys differ from glm\n", differ);
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+// Loading OBJ and PLY meshes: a conventional loader (ifstream, getline,
+// strtof, std::unordered_map for the OBJ corners) against MeshLoader (mmap,
+// line-aligned chunks on a ThreadPool, its own number parser, lock-free
+// corner deduplication) on one thread and on all of them, and against
+// opening the binary mesh cache (MeshCache) of the same mesh.
+//
+//     mesh_loader_bench [triangles] [runs] [threads]
+//
+// Writes a sphere of about `triangles` triangles (default 1M) with normals to
+// a temporary directory as OBJ ("f a//a"), ASCII PLY and binary PLY.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+#include <MeshCache.hpp>
+#include <MeshLoader.hpp>
+
+#include "Bench.hpp"
+
+// latitude/longitude sphere; every vertex also has its normal
+static void sphere(size_t triangles, std::vector<float>& vertices, std::vector<unsigned int>& indices)
+{
+    size_t rings = (size_t)std::sqrt(triangles / 4.0) + 2, segments = rings * 2;
+    for (size_t r = 0; r <= rings; ++r)
+    {
+        double theta = 3.14159265358979 * r / rings;
+        for (size_t s = 0; s <= segments; ++s)
+        {
+            double phi = 2.0 * 3.14159265358979 * s / segments;
+            float n[3] = { (float)(std::sin(theta) * std::cos(phi)), (float)std::cos(theta),
+                           (float)(std::sin(theta) * std::sin(phi)) };
+            vertices.insert(vertices.end(), n, n + 3);
+        }
+    }
+    for (size_t r = 0; r < rings; ++r)
+    {
+        for (size_t s = 0; s < segments; ++s)
+        {
+            unsigned int a = (unsigned int)(r * (segments + 1) + s), b = a + (unsigned int)segments + 1;
+            unsigned int quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+static void writeObj(const std::string& path, const std::vector<float>& vertices, const std::vector<unsigned int>& indices)
+{
+    FILE* file = std::fopen(path.c_str(), "w");
+    for (size_t i = 0; i < vertices.size(); i += 3)
+        std::fprintf(file, "v %.6f %.6f %.6f\n", vertices[i], vertices[i + 1], vertices[i + 2]);
+    for (size_t i = 0; i < vertices.size(); i += 3)
+        std::fprintf(file, "vn %.6f %.6f %.6f\n", vertices[i], vertices[i + 1], vertices[i + 2]);
+    for (size_t i = 0; i < indices.size(); i += 3)
+        std::fprintf(file, "f %u//%u %u//%u %u//%u\n", indices[i] + 1, indices[i] + 1, indices[i + 1] + 1,
+                     indices[i + 1] + 1, indices[i + 2] + 1, indices[i + 2] + 1);
+    std::fclose(file);
+}
+
+static void writePly(const std::string& path, const std::vector<float>& vertices, const std::vector<unsigned int>& indices,
+                     bool binary)
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    std::fprintf(file, "ply\nformat %s 1.0\nelement vertex %zu\n", binary ? "binary_little_endian" : "ascii",
+                 vertices.size() / 3);
+    std::fprintf(file, "property float x\nproperty float y\nproperty float z\n"
+                       "property float nx\nproperty float ny\nproperty float nz\n");
+    std::fprintf(file, "element face %zu\nproperty list uchar int vertex_indices\nend_header\n", indices.size() / 3);
+    for (size_t i = 0; i < vertices.size(); i += 3)
+    {
+        const float v[6] = { vertices[i], vertices[i + 1], vertices[i + 2], vertices[i], vertices[i + 1], vertices[i + 2] };
+        if (binary)
+            std::fwrite(v, sizeof(v), 1, file);
+        else
+            std::fprintf(file, "%.6f %.6f %.6f %.6f %.6f %.6f\n", v[0], v[1], v[2], v[3], v[4], v[5]);
+    }
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        if (binary)
+        {
+            unsigned char count = 3;
+            std::fwrite(&count, 1, 1, file);
+            std::fwrite(&indices[i], sizeof(unsigned int), 3, file);
+        }
+        else
+            std::fprintf(file, "3 %u %u %u\n", indices[i], indices[i + 1], indices[i + 2]);
+    }
+    std::fclose(file);
+}
+
+// ---------------------------------------------------------------------------
+// the conventional OBJ loader
+
+static bool naiveObj(const std::string& path, Geometry& out)
+{
+    std::ifstream file(path.c_str());
+    std::vector<float> positions, normals;
+    std::unordered_map<std::string, unsigned int> corners;
+    out = Geometry();
+    out.stride = 9;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        const char* p = line.c_str();
+        char* next = nullptr;
+        if (line.compare(0, 2, "v ") == 0 || line.compare(0, 3, "vn ") == 0)
+        {
+            std::vector<float>& target = line[1] == 'n' ? normals : positions;
+            p += line[1] == 'n' ? 3 : 2;
+            for (int i = 0; i < 3; ++i, p = next)
+                target.push_back(std::strtof(p, &next));
+        }
+        else if (line.compare(0, 2, "f ") == 0)
+        {
+            size_t at = 2;
+            while (at < line.size())
+            {
+                size_t space = line.find(' ', at);
+                std::string corner = line.substr(at, space == std::string::npos ? std::string::npos : space - at);
+                at = space == std::string::npos ? line.size() : space + 1;
+                auto found = corners.find(corner);
+                if (found == corners.end())
+                {
+                    unsigned int position = (unsigned int)std::strtoul(corner.c_str(), &next, 10) - 1;
+                    unsigned int normal = (unsigned int)std::strtoul(next + 2, nullptr, 10) - 1;
+                    found = corners.emplace(corner, (unsigned int)out.vertexCount()).first;
+                    out.vertices.insert(out.vertices.end(), &positions[position * 3], &positions[position * 3] + 3);
+                    out.vertices.insert(out.vertices.end(), 3, MESH_DEFAULT_COLOR);
+                    out.vertices.insert(out.vertices.end(), &normals[normal * 3], &normals[normal * 3] + 3);
+                }
+                out.indices.push_back(found->second);
+            }
+        }
+    }
+    return !out.indices.empty();
+}
+
+static void row(const char* name, double ms, size_t bytes, const Geometry& geometry)
+{
+    std::printf("  %-30s %9.2f ms  %8.1f MB/s  %9zu vertices  %9zu triangles\n", name, ms, bytes / (ms * 1000.0),
+                geometry.vertexCount(), geometry.triangleCount());
+}
+
+int main(int argc, char** argv)
+{
+    size_t triangles = (size_t)bench::argOr(argc, argv, 1, 1000000);
+    int runs = (int)bench::argOr(argc, argv, 2, 3);
+    unsigned int threads = (unsigned int)bench::argOr(argc, argv, 3, std::thread::hardware_concurrency());
+
+    char pattern[] = "/tmp/mesh_loader_benchXXXXXX";
+    if (!mkdtemp(pattern))
+    {
+        std::printf("cannot create a temporary directory\n");
+        return 1;
+    }
+    std::string directory = pattern;
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    sphere(triangles, vertices, indices);
+    const std::string obj = directory + "/sphere.obj", ply = directory + "/sphere.ply",
+                      binary = directory + "/sphere_binary.ply";
+    writeObj(obj, vertices, indices);
+    writePly(ply, vertices, indices, false);
+    writePly(binary, vertices, indices, true);
+
+    ThreadPool single(1), all(threads);
+    MeshLoader singleLoader(single), loader(all);
+    std::printf("mesh loading: sphere of %zu triangles, best of %d, %u threads\n", indices.size() / 3, runs, all.size());
+
+    const struct
+    {
+        const char* format;
+        std::string path;
+    } files[] = { { "OBJ", obj }, { "ASCII PLY", ply }, { "binary PLY", binary } };
+    Geometry loaded;
+    for (const auto& file : files)
+    {
+        MappedFile mapped;
+        mapped.open(file.path);
+        size_t bytes = mapped.size();
+        mapped.close();
+        std::printf(" %s, %.1f MB\n", file.format, bytes / 1e6);
+        Geometry geometry;
+        char name[64];
+        if (file.path == obj)
+            row("ifstream + unordered_map", bench::bestOf(runs, [&]() { naiveObj(file.path, geometry); }), bytes,
+                geometry);
+        row("MeshLoader, 1 thread", bench::bestOf(runs, [&]() { singleLoader.load(file.path, geometry); }), bytes,
+            geometry);
+        std::snprintf(name, sizeof(name), "MeshLoader, %u threads", all.size());
+        row(name, bench::bestOf(runs, [&]() { loader.load(file.path, geometry); }), bytes, geometry);
+        const MeshLoadStats& stats = loader.stats();
+        std::printf("    (%u chunks, parse %.2f ms = %.1f MB/s, dedup %.2f ms)\n", stats.chunks, stats.parseMs,
+                    stats.throughput(), stats.dedupMs);
+        std::remove(file.path.c_str());
+        std::swap(loaded, geometry);
+    }
+
+    // the cache holds the GPU buffers as they are; copying the payloads
+    // stands in for glBufferData, and in debug builds open() also checksums
+    const std::string cached = directory + "/sphere.mesh";
+    EncodedMesh encoded;
+    encodeMesh(loaded, VertexFormat(), encoded);
+    MeshCache::save(cached, encoded);
+    std::vector<unsigned char> upload(encoded.vertices.size() + encoded.indices.size());
+    MeshCache cache;
+    double cacheMs = bench::bestOf(runs, [&]()
+    {
+        cache.open(cached);
+        std::memcpy(upload.data(), cache.vertices(), encoded.vertices.size());
+        std::memcpy(upload.data() + encoded.vertices.size(), cache.indices(), encoded.indices.size());
+        cache.close();
+    });
+    std::printf(" binary mesh cache, %.1f MB (%u bytes per vertex)\n", upload.size() / 1e6, encoded.stride());
+    std::printf("  %-30s %9.2f ms  %8.1f MB/s\n", "open + copy payloads", cacheMs, upload.size() / (cacheMs * 1000.0));
+    std::remove(cached.c_str());
+    rmdir(directory.c_str());
+    return 0;
+}
@@ -0,0 +1,163 @@
+// Stage timings of the CPU painter's pipeline on synthetic scenes, no window
+// or GL context needed.
+//
+//     painter_bench [maxTriangles] [runs] [threads]
+//
+// Scenes of 10k, 100k, 1M and 10M triangles (up to maxTriangles) are built
+// from a fixed seed, so numbers from different machines and commits compare.
+// Each stage is run `runs` times and the best time is reported. The overlap
+// resolver is skipped above 1M triangles, where a single frame takes seconds.
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <Geometry.hpp>
+#include <NearClipper.hpp>
+#include <OverlapResolver.hpp>
+#include <PainterSorter.hpp>
+#include <ThreadPool.hpp>
+#include <TriangleCuller.hpp>
+
+#include "Bench.hpp"
+
+// Patches of 8x8 grid quads (128 triangles sharing 81 vertices), scattered
+// with random orientation through a 100 unit box around the camera - a
+// stand-in for the many small, partly off-screen polygons of a walkthrough.
+static void makeScene(Geometry& scene, size_t triangles, unsigned int seed)
+{
+    const int GRID = 8;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f), unit(-1.0f, 1.0f), color(0.0f, 1.0f);
+    scene.vertices.clear();
+    scene.indices.clear();
+    size_t patches = (triangles + GRID * GRID * 2 - 1) / (GRID * GRID * 2);
+    scene.vertices.reserve(patches * (GRID + 1) * (GRID + 1) * scene.stride);
+    scene.indices.reserve(patches * GRID * GRID * 6);
+    for (size_t patch = 0; patch < patches && scene.triangleCount() < triangles; ++patch)
+    {
+        glm::vec3 origin(position(rng), position(rng), position(rng));
+        glm::vec3 u = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(1e-3f)) * 0.25f;
+        glm::vec3 v = glm::normalize(glm::cross(u, glm::vec3(unit(rng), unit(rng), unit(rng))) + glm::vec3(1e-3f)) * 0.25f;
+        glm::vec3 tint(color(rng), color(rng), color(rng));
+        unsigned int first = (unsigned int)scene.vertexCount();
+        for (int y = 0; y <= GRID; ++y)
+        {
+            for (int x = 0; x <= GRID; ++x)
+            {
+                glm::vec3 p = origin + u * (float)x + v * (float)y;
+                const float vertex[] = { p.x, p.y, p.z, tint.x, tint.y, tint.z };
+                scene.vertices.insert(scene.vertices.end(), vertex, vertex + 6);
+            }
+        }
+        for (int y = 0; y < GRID && scene.triangleCount() < triangles; ++y)
+        {
+            for (int x = 0; x < GRID && scene.triangleCount() < triangles; ++x)
+            {
+                unsigned int a = first + y * (GRID + 1) + x;
+                const unsigned int quad[] = { a, a + 1, a + GRID + 1, a + 1, a + GRID + 2, a + GRID + 1 };
+                scene.indices.insert(scene.indices.end(), quad, quad + (scene.triangleCount() + 1 < triangles ? 6 : 3));
+            }
+        }
+    }
+}
+
+struct StageTimes
+{
+    double cull, keys, radix, stdSort, incremental, clip, resolve, upload;
+
+    StageTimes() : cull(1e30), keys(1e30), radix(1e30), stdSort(1e30), incremental(1e30),
+                   clip(1e30), resolve(1e30), upload(1e30)
+    {
+    }
+};
+
+static void keepBest(double& best, double ms)
+{
+    best = std::min(best, ms);
+}
+
+int main(int argc, char** argv)
+{
+    size_t maxTriangles = (size_t)bench::argOr(argc, argv, 1, 10000000);
+    int runs = (int)bench::argOr(argc, argv, 2, 5);
+    unsigned int threads = (unsigned int)bench::argOr(argc, argv, 3, std::thread::hardware_concurrency());
+    const size_t sizes[] = { 10000, 100000, 1000000, 10000000 };
+    const size_t RESOLVE_LIMIT = 1000000;
+
+    ThreadPool pool(threads);
+    std::printf("painter's pipeline, best of %d, %u threads, %s depth keys\n",
+                runs, pool.size(), simdLevelName(detectSimdLevel()));
+    std::printf("%10s %9s %8s %8s %8s %9s %8s %8s %9s %8s   (ms)\n", "triangles", "visible", "cull", "keys",
+                "radix", "std::sort", "incr.", "clip", "resolve", "upload");
+
+    for (size_t triangles : sizes)
+    {
+        if (triangles > maxTriangles)
+            break;
+        Geometry scene;
+        makeScene(scene, triangles, 1234);
+
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+        glm::mat4 modelView = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+                                          glm::vec3(0.0f, 1.0f, 0.0f));
+        // the next frame of a slow pan, for the incremental sort
+        glm::mat4 nextModelView = glm::rotate(glm::mat4(1.0f), 0.0005f, glm::vec3(0.0f, 1.0f, 0.0f)) * modelView;
+
+        TriangleCuller culler(pool);
+        PainterSorter sorter(pool, SortMode::ParallelRadix);
+        PainterSorter reference(pool, SortMode::StdSort);
+        PainterSorter incremental(pool, SortMode::Incremental);
+        NearClipper clipper(pool);
+        OverlapResolver resolver;
+        resolver.setViewport(1920, 1080);
+        std::vector<uint32_t> visible;
+        std::vector<unsigned int> indices, resolved;
+        // stands in for a mapped index ring segment
+        std::vector<unsigned int> mapped(scene.indices.size());
+        StageTimes best;
+
+        for (int run = 0; run < runs; ++run)
+        {
+            const TriangleSoA& soa = sorter.triangles(scene);
+            culler.cull(soa, modelView, projection, visible);
+            keepBest(best.cull, culler.stats().cullMs);
+
+            sorter.sort(scene, modelView, &visible);
+            keepBest(best.keys, sorter.stats().keyMs);
+            keepBest(best.radix, sorter.stats().sortMs);
+
+            reference.sort(scene, modelView, &visible);
+            keepBest(best.stdSort, reference.stats().sortMs);
+
+            incremental.sort(scene, modelView, &visible);
+            incremental.sort(scene, nextModelView, &visible);
+            keepBest(best.incremental, incremental.stats().keyMs + incremental.stats().sortMs);
+
+            clipper.clip(scene, sorter.order(), projection * modelView, indices);
+            keepBest(best.clip, clipper.stats().clipMs);
+
+            if (triangles <= RESOLVE_LIMIT)
+            {
+                resolver.resolve(scene, indices, clipper.extraVertices(), modelView, projection, resolved);
+                keepBest(best.resolve, resolver.stats().resolveMs);
+            }
+
+            double start = bench::nowMs();
+            sorter.writeIndices(scene, mapped.data());
+            keepBest(best.upload, bench::nowMs() - start);
+        }
+
+        std::printf("%10zu %9zu %8.2f %8.2f %8.2f %9.2f %8.2f %8.2f ", triangles, visible.size(), best.cull,
+                    best.keys, best.radix, best.stdSort, best.incremental, best.clip);
+        if (triangles <= RESOLVE_LIMIT)
+            std::printf("%9.2f ", best.resolve);
+        else
+            std::printf("%9s ", "-");
+        std::printf("%8.2f\n", best.upload);
+    }
+    return 0;
+}
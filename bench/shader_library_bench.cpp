@@ -0,0 +1,185 @@
+// Loading a shader library with #include: the ifstream path the Shader class
+// used to take, with a naive textual include expansion, against ShaderLibrary
+// (fragments read and scanned once, stages assembled as spans). No GL needed.
+//
+//     shader_library_bench [files] [runs]
+//
+// Writes a library of `files` GLSL files (default 256) to a temporary
+// directory: 1 in 8 is a shared chunk of functions, the rest are program
+// stages including 4 to 8 of the chunks, and chunks include a common header.
+// Cold runs start from an empty ShaderLibrary, warm runs reuse it (programs
+// built later in a session, variants, reloads).
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <ShaderLibrary.hpp>
+
+#include "Bench.hpp"
+
+static std::string chunkName(int chunk)
+{
+    return "chunk" + std::to_string(chunk) + ".glsl";
+}
+
+static std::string stageName(int stage)
+{
+    return "stage" + std::to_string(stage) + (stage % 2 ? ".fs" : ".vs");
+}
+
+// some plausible GLSL, `functions` functions of a few lines each
+static std::string functions(const std::string& prefix, int functions)
+{
+    std::string text;
+    for (int i = 0; i < functions; ++i)
+    {
+        std::string name = prefix + std::to_string(i);
+        text += "vec3 " + name + "(vec3 p, float t)\n{\n"
+                "    vec3 q = fract(p * 0.3183099 + vec3(0.71, 0.113, 0.419));\n"
+                "    q *= 17.0;\n"
+                "    return fract(q.x * q.y * q.z * (q.x + q.y + q.z)) * vec3(t, 1.0 - t, 0.5);\n"
+                "}\n\n";
+    }
+    return text;
+}
+
+static void writeFile(const std::string& path, const std::string& text)
+{
+    std::ofstream file(path.c_str(), std::ios::binary);
+    file << text;
+}
+
+// ---------------------------------------------------------------------------
+// the old path: every file through ifstream -> stringstream -> std::string,
+// includes expanded by reading the included file again each time
+
+static std::string readFile(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    std::stringstream stream;
+    stream << file.rdbuf();
+    return stream.str();
+}
+
+static void expand(const std::string& directory, const std::string& name, std::string& out,
+                   std::vector<std::string>& included, size_t& reads)
+{
+    for (size_t i = 0; i < included.size(); ++i)
+    {
+        if (included[i] == name)
+            return;
+    }
+    included.push_back(name);
+    std::string text = readFile(directory + "/" + name);
+    ++reads;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        size_t quote = line.find('"');
+        if (line.compare(0, 8, "#include") == 0 && quote != std::string::npos)
+        {
+            size_t close = line.find('"', quote + 1);
+            expand(directory, line.substr(quote + 1, close - quote - 1), out, included, reads);
+        }
+        else
+            out += line + "\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int files = (int)bench::argOr(argc, argv, 1, 256);
+    int runs = (int)bench::argOr(argc, argv, 2, 5);
+    int chunks = files / 8 > 1 ? files / 8 : 1;
+    int stages = files - chunks - 1 > 1 ? files - chunks - 1 : 1;
+
+    char pattern[] = "/tmp/shader_library_benchXXXXXX";
+    if (!mkdtemp(pattern))
+    {
+        std::printf("cannot create a temporary directory\n");
+        return 1;
+    }
+    std::string directory = pattern;
+    std::mt19937 rng(1234);
+    writeFile(directory + "/common.glsl", "const float PI = 3.14159265;\n" + functions("common", 8));
+    for (int chunk = 0; chunk < chunks; ++chunk)
+        writeFile(directory + "/" + chunkName(chunk), "#include \"common.glsl\"\n" + functions("chunk" + std::to_string(chunk) + "_", 24));
+    for (int stage = 0; stage < stages; ++stage)
+    {
+        std::string text = "#version 330 core\n";
+        int includes = 4 + (int)(rng() % 5);
+        for (int i = 0; i < includes; ++i)
+            text += "#include \"" + chunkName((int)(rng() % chunks)) + "\"\n";
+        text += functions("stage" + std::to_string(stage) + "_", 4);
+        text += "void main()\n{\n}\n";
+        writeFile(directory + "/" + stageName(stage), text);
+    }
+
+    std::printf("shader library: %d files (%d stages, %d chunks + 1 header), best of %d\n", stages + chunks + 1,
+                stages, chunks, runs);
+
+    size_t reads = 0, naiveBytes = 0;
+    double naive = bench::bestOf(runs, [&]()
+    {
+        reads = naiveBytes = 0;
+        for (int stage = 0; stage < stages; ++stage)
+        {
+            std::string out;
+            std::vector<std::string> included;
+            expand(directory, stageName(stage), out, included, reads);
+            naiveBytes += out.size();
+        }
+    });
+
+    size_t spans = 0, libraryBytes = 0;
+    ShaderLibraryStats coldStats;
+    std::vector<std::string> noDefines;
+    double cold = bench::bestOf(runs, [&]()
+    {
+        ShaderLibrary library(directory.c_str());
+        ShaderSourceList sources;
+        spans = libraryBytes = 0;
+        for (int stage = 0; stage < stages; ++stage)
+        {
+            library.assemble(stageName(stage), noDefines, sources);
+            spans += sources.strings.size();
+            libraryBytes += sources.size();
+        }
+        coldStats = library.stats();
+    });
+
+    ShaderLibrary warmLibrary(directory.c_str());
+    ShaderSourceList sources;
+    for (int stage = 0; stage < stages; ++stage)
+        warmLibrary.assemble(stageName(stage), noDefines, sources);
+    double warm = bench::bestOf(runs, [&]()
+    {
+        for (int stage = 0; stage < stages; ++stage)
+            warmLibrary.assemble(stageName(stage), noDefines, sources);
+    });
+
+    std::printf("  %-28s %9.3f ms  %6zu file reads  %8.2f MB of source\n", "ifstream + textual includes", naive,
+                reads, naiveBytes / 1e6);
+    std::printf("  %-28s %9.3f ms  %6zu file reads  %8.2f MB of source in %zu spans\n", "ShaderLibrary, cold", cold,
+                coldStats.files, libraryBytes / 1e6, spans);
+    std::printf("  %-28s %9.3f ms  %6d file reads\n", "ShaderLibrary, warm", warm, 0);
+    std::printf("  (cold: %.3f ms of it loading and scanning %zu fragments, %zu requests served from the cache)\n",
+                coldStats.loadMs, coldStats.files, coldStats.reused);
+
+    // clean up the generated library
+    std::remove((directory + "/common.glsl").c_str());
+    for (int chunk = 0; chunk < chunks; ++chunk)
+        std::remove((directory + "/" + chunkName(chunk)).c_str());
+    for (int stage = 0; stage < stages; ++stage)
+        std::remove((directory + "/" + stageName(stage)).c_str());
+    rmdir(directory.c_str());
+    return 0;
+}
@@ -0,0 +1,193 @@
+// Setting a mat4 uniform 1M times through every path Shader offers: a
+// std::string name (what setFloat(const std::string&) cost when called with
+// a literal), a const char* name hashed at run time, a constexpr UniformName
+// hashed by the compiler, and a pre-resolved handle through glUniform* (with
+// the GLState bind it needs) or glProgramUniform*.
+//
+//     uniform_bench [updates] [runs]
+//
+// No GL context: the GL entry points point at stand-ins that report a
+// 16-uniform program and copy the uploaded matrix, so what is measured is
+// the CPU side of each path. Heap allocations are counted per path.
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include <GLState.hpp>
+#include <UniformTable.hpp>
+
+#include "Bench.hpp"
+
+static size_t allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    void* memory = std::malloc(size ? size : 1);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+// ---------------------------------------------------------------------------
+// stand-in GL
+
+static const char* const UNIFORM_NAMES[] = {
+    "model", "normalMatrix", "albedo", "roughness", "metallic", "emissive", "alphaCutoff", "lightCount",
+    "lights[0]", "shadowCascadeMatrix", "shadowBias", "fogColor", "fogStart", "fogEnd", "exposure", "gamma"
+};
+static const GLint UNIFORM_COUNT = sizeof(UNIFORM_NAMES) / sizeof(UNIFORM_NAMES[0]);
+
+static float uploaded[16];
+static GLuint programInUse = 0;
+
+static void APIENTRY fakeGetProgramiv(GLuint, GLenum name, GLint* value)
+{
+    *value = name == GL_ACTIVE_UNIFORMS ? UNIFORM_COUNT : 32;
+}
+
+static void APIENTRY fakeGetActiveUniform(GLuint, GLuint index, GLsizei bufferSize, GLsizei* length, GLint* size,
+                                          GLenum* type, GLchar* name)
+{
+    std::snprintf(name, (size_t)bufferSize, "%s", UNIFORM_NAMES[index]);
+    *length = (GLsizei)std::strlen(name);
+    *size = 1;
+    *type = GL_FLOAT_MAT4;
+}
+
+static GLint APIENTRY fakeGetUniformLocation(GLuint, const GLchar* name)
+{
+    for (GLint i = 0; i < UNIFORM_COUNT; ++i)
+    {
+        if (std::strcmp(UNIFORM_NAMES[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void APIENTRY fakeUseProgram(GLuint program)
+{
+    programInUse = program;
+}
+
+static void APIENTRY fakeUniformMatrix4fv(GLint, GLsizei, GLboolean, const GLfloat* value)
+{
+    std::memcpy(uploaded, value, sizeof(uploaded));
+}
+
+static void APIENTRY fakeProgramUniformMatrix4fv(GLuint, GLint, GLsizei, GLboolean, const GLfloat* value)
+{
+    std::memcpy(uploaded, value, sizeof(uploaded));
+}
+
+// ---------------------------------------------------------------------------
+
+// the signature of the old setters
+static GLint locationByString(const UniformTable& table, const std::string& name)
+{
+    return table.location(name.c_str());
+}
+
+static void report(const char* name, double ms, size_t updates, size_t allocated)
+{
+    std::printf("  %-30s %9.3f ms  %7.1f ns/update  %8zu allocations\n", name, ms, ms * 1e6 / updates, allocated);
+}
+
+int main(int argc, char** argv)
+{
+    size_t updates = (size_t)bench::argOr(argc, argv, 1, 1000000);
+    int runs = (int)bench::argOr(argc, argv, 2, 5);
+
+    glad_glGetProgramiv = fakeGetProgramiv;
+    glad_glGetActiveUniform = fakeGetActiveUniform;
+    glad_glGetUniformLocation = fakeGetUniformLocation;
+    glad_glUseProgram = fakeUseProgram;
+    glad_glUniformMatrix4fv = fakeUniformMatrix4fv;
+    glad_glProgramUniformMatrix4fv = fakeProgramUniformMatrix4fv;
+
+    const GLuint program = 1;
+    UniformTable table;
+    table.reflect(program);
+    glm::mat4 matrix(1.0f);
+    std::printf("uniform updates: %zu mat4 uploads into a %d-uniform program, best of %d\n", updates,
+                (int)UNIFORM_COUNT, runs);
+
+    // the old setters took const std::string&: a literal became a temporary
+    // string on every call, on the heap once past the small-string buffer
+    size_t before = allocations;
+    double ms = bench::bestOf(runs, [&]()
+    {
+        for (size_t i = 0; i < updates; ++i)
+        {
+            matrix[3][0] = (float)i;
+            glUniformMatrix4fv(locationByString(table, "shadowCascadeMatrix"), 1, GL_FALSE, glm::value_ptr(matrix));
+        }
+    });
+    report("std::string name", ms, updates, (allocations - before) / runs);
+
+    before = allocations;
+    ms = bench::bestOf(runs, [&]()
+    {
+        for (size_t i = 0; i < updates; ++i)
+        {
+            matrix[3][0] = (float)i;
+            glUniformMatrix4fv(table.location("shadowCascadeMatrix"), 1, GL_FALSE, glm::value_ptr(matrix));
+        }
+    });
+    report("const char* name", ms, updates, (allocations - before) / runs);
+
+    before = allocations;
+    constexpr UniformName SHADOW_CASCADE_MATRIX("shadowCascadeMatrix");
+    static_assert(SHADOW_CASCADE_MATRIX.hash == fnv1a64String("shadowCascadeMatrix"), "hashed at compile time");
+    ms = bench::bestOf(runs, [&]()
+    {
+        for (size_t i = 0; i < updates; ++i)
+        {
+            matrix[3][0] = (float)i;
+            glUniformMatrix4fv(table.location(SHADOW_CASCADE_MATRIX), 1, GL_FALSE, glm::value_ptr(matrix));
+        }
+    });
+    report("constexpr UniformName", ms, updates, (allocations - before) / runs);
+
+    Uniform<glm::mat4> handle(table.location("shadowCascadeMatrix"));
+    before = allocations;
+    ms = bench::bestOf(runs, [&]()
+    {
+        for (size_t i = 0; i < updates; ++i)
+        {
+            matrix[3][0] = (float)i;
+            GLState::current().useProgram(program);
+            glUniformMatrix4fv(handle.location, 1, GL_FALSE, glm::value_ptr(matrix));
+        }
+    });
+    report("handle, glUniform", ms, updates, (allocations - before) / runs);
+
+    before = allocations;
+    ms = bench::bestOf(runs, [&]()
+    {
+        for (size_t i = 0; i < updates; ++i)
+        {
+            matrix[3][0] = (float)i;
+            glProgramUniformMatrix4fv(program, handle.location, 1, GL_FALSE, glm::value_ptr(matrix));
+        }
+    });
+    report("handle, glProgramUniform", ms, updates, (allocations - before) / runs);
+
+    if (uploaded[12] != (float)(updates - 1) || programInUse != program)
+    {
+        std::printf("  ERROR::UNIFORM_BENCH::UPLOAD_MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
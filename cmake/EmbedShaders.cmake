@@ -0,0 +1,60 @@
+# Turns every file in SHADER_DIR into a constexpr char table in OUTPUT, so
+# the program carries its GLSL and reads no shader files at startup.
+#
+#     cmake -DSHADER_DIR=<dir> -DOUTPUT=<header> -P EmbedShaders.cmake
+#
+# The sources are written as byte lists rather than raw string literals, so
+# no shader text can end the literal early. Each table has a terminating zero
+# that its size does not count.
+
+file(GLOB SHADERS RELATIVE ${SHADER_DIR} ${SHADER_DIR}/*)
+list(SORT SHADERS)
+
+# 16 bytes per line
+set(LINE "")
+foreach(I RANGE 31)
+    string(APPEND LINE "[0-9a-f]")
+endforeach()
+
+set(TABLES "")
+set(ENTRIES "")
+foreach(NAME ${SHADERS})
+    string(MAKE_C_IDENTIFIER ${NAME} IDENTIFIER)
+    file(READ ${SHADER_DIR}/${NAME} BYTES HEX)
+    string(REGEX REPLACE "(${LINE})" "\\1\n" BYTES "${BYTES}")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1, " BYTES "${BYTES}")
+    string(REPLACE ", \n" ",\n    " BYTES "${BYTES}")
+    string(APPEND TABLES "constexpr char ${IDENTIFIER}[] = {\n    ${BYTES}0x00\n};\n\n")
+    string(APPEND ENTRIES "    { \"${NAME}\", ${IDENTIFIER}, sizeof(${IDENTIFIER}) - 1 },\n")
+endforeach()
+
+set(CONTENT "// Generated from ${SHADER_DIR} by cmake/EmbedShaders.cmake - do not edit.
+#ifndef EMBEDDED_SHADERS_H
+#define EMBEDDED_SHADERS_H
+
+#include <cstddef>
+
+struct EmbeddedShader
+{
+    const char* name;       // file name within shaders/
+    const char* source;     // zero-terminated
+    std::size_t size;
+};
+
+namespace embedded_shaders
+{
+${TABLES}constexpr EmbeddedShader table[] = {
+${ENTRIES}};
+
+constexpr std::size_t count = sizeof(table) / sizeof(table[0]);
+}
+#endif
+")
+
+# leave the header alone if nothing changed, so dependents do not rebuild
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} PREVIOUS)
+endif()
+if(NOT "${PREVIOUS}" STREQUAL "${CONTENT}")
+    file(WRITE ${OUTPUT} "${CONTENT}")
+endif()
@@ -11,18 +11,65 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <math.h>
+#include <string>
+#include <utility>
 
+#include <BspTree.hpp>
+#include <FrameUniforms.hpp>
+#include <GLState.hpp>
+#include <Geometry.hpp>
+#include <IndexRing.hpp>
+#include <LodSelector.hpp>
+#include <Mesh.hpp>
+#include <MeshCache.hpp>
+#include <MeshLoader.hpp>
+#include <MeshOptimizer.hpp>
+#include <MeshSimplifier.hpp>
+#include <PainterPipeline.hpp>
+#include <ProgramCache.hpp>
 #include <Shader.hpp>
+#include <ShaderLibrary.hpp>
+#include <ShaderVariants.hpp>
+#include <ShaderWatcher.hpp>
+#include <ThreadPool.hpp>
+#include <VertexFormat.hpp>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow *window);
+void addQuad(Geometry& scene, glm::vec3 center, glm::vec3 right, glm::vec3 up, glm::vec3 color);
 
 #define WINDOW_WIDTH 1000 
 #define WINDOW_HEIGHT 800
 
-int main()
+// Painter's algorithm ordering, switched with the P key
+SortMode sortMode = SortMode::ParallelRadix;
+// Newell-Newell-Sancha overlap resolution, switched with the N key
+bool resolveOverlaps = true;
+// Back-to-front order from the precomputed BSP tree instead of sorting, B key
+bool useBspTree = false;
+// Screen grid for the overlap tests, G key
+bool gridBinning = true;
+// Frustum culling before the sort, F key; back-face culling on top of it, C key
+// (off by default - the quads of the scene are seen from both sides)
+bool frustumCulling = true;
+bool backFaceCulling = false;
+// Shader permutations: per-vertex colors (V key) and distance fog (O key)
+bool vertexColors = true;
+bool fog = false;
+// Level of detail of the loaded mesh: -1 picked by screen-space error, else
+// forced, cycled with the L key through the mesh's meshLods levels
+int forcedLod = -1;
+size_t meshLods = 0;
+// Current framebuffer size, kept up to date by framebuffer_size_callback
+int viewportWidth = WINDOW_WIDTH;
+int viewportHeight = WINDOW_HEIGHT;
+
+int main(int argc, char** argv)
 {
     /*
      *  Note:
@@ -59,23 +106,169 @@ int main()
         return -1;
     } 
 
-    // TODO: Change it! It cannot be hardcoded!
-    Shader ourShader("/home/nebraszka/GITHUB/computer_graphics_pw/vertexShader.vs", "/home/nebraszka/GITHUB/computer_graphics_pw/frameShader.fs");
+    // The persistently mapped index ring needs glBufferStorage (GL 4.4); on
+    // older contexts it may still come from ARB_buffer_storage
+    if (!glBufferStorage && glfwExtensionSupported("GL_ARB_buffer_storage"))
+        glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+    // Program binaries are core in GL 4.1, before that ARB_get_program_binary
+    if (!glProgramBinary && glfwExtensionSupported("GL_ARB_get_program_binary"))
+    {
+        glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+        glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+        glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+    }
+    // Uniforms are set without binding the program through glProgramUniform*
+    // (GL 4.1, before that ARB_separate_shader_objects)
+    if (!glProgramUniformMatrix4fv && glfwExtensionSupported("GL_ARB_separate_shader_objects"))
+    {
+        glad_glProgramUniform1i = (PFNGLPROGRAMUNIFORM1IPROC)glfwGetProcAddress("glProgramUniform1i");
+        glad_glProgramUniform1f = (PFNGLPROGRAMUNIFORM1FPROC)glfwGetProcAddress("glProgramUniform1f");
+        glad_glProgramUniform2fv = (PFNGLPROGRAMUNIFORM2FVPROC)glfwGetProcAddress("glProgramUniform2fv");
+        glad_glProgramUniform3fv = (PFNGLPROGRAMUNIFORM3FVPROC)glfwGetProcAddress("glProgramUniform3fv");
+        glad_glProgramUniform4fv = (PFNGLPROGRAMUNIFORM4FVPROC)glfwGetProcAddress("glProgramUniform4fv");
+        glad_glProgramUniformMatrix3fv = (PFNGLPROGRAMUNIFORMMATRIX3FVPROC)glfwGetProcAddress("glProgramUniformMatrix3fv");
+        glad_glProgramUniformMatrix4fv = (PFNGLPROGRAMUNIFORMMATRIX4FVPROC)glfwGetProcAddress("glProgramUniformMatrix4fv");
+    }
+
+    // Linked programs are kept in shader_cache/, so only the first start (or
+    // the first after a shader or driver change) pays for compiling them
+    ProgramCache programCache("shader_cache");
+    // Shaders build in the background (on driver threads, where
+    // KHR_parallel_shader_compile allows) while the scene is set up; the
+    // render loop polls for them
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+        Shader::enableParallelCompile((MaxCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"),
+                                      std::thread::hardware_concurrency());
+    else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+        Shader::enableParallelCompile((MaxCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB"),
+                                      std::thread::hardware_concurrency());
+    // The program comes in variants, one per combination of features; all
+    // the keys can switch between are built up front
+    ShaderLibrary shaderLibrary;
+    // Camera, time and viewport come from one uniform buffer all programs
+    // share, written once per frame
+    Shader::bindUniformBlock("FrameUniforms", FRAME_UNIFORMS_BINDING);
+    ShaderVariants shaders(shaderLibrary, "vertexShader.vs", "frameShader.fs", &programCache);
+    const uint64_t VERTEX_COLORS = shaders.feature("VERTEX_COLORS");
+    const uint64_t FOG = shaders.feature("FOG");
+    // a loaded mesh's normals light it; the scene has none
+    const uint64_t NORMALS = shaders.feature("NORMALS");
+    const uint64_t OCTAHEDRAL_NORMALS = shaders.feature("OCTAHEDRAL_NORMALS");
+    double prewarmStart = glfwGetTime();
+    shaders.prewarm({ 0, VERTEX_COLORS, FOG, VERTEX_COLORS | FOG });
 
     // ---------------------------------------------------------------------------
 
-    float vertices[] = {
-        // positions        //colors
-        0.5f,  0.5f, 0.0f,  1.0f, 0.0f, 0.0f,  // top right
-        0.5f, -0.5f, 0.0f,  1.0f, 0.0f, 1.0f, // bottom right
-        -0.5f, -0.5f, 0.0f,  0.0f, 0.0f, 1.0f,  // bottom left
-        -0.5f,  0.5f, 0.0f,  1.0f, 1.0f, 0.0f  // top left 
-    };
-    unsigned int indices[] = {  // note that we start from 0!
-        0, 1, 3,   // first triangle
-        1, 2, 3    // second triangle
-    };  
+    /* The scene is a stack of overlapping quads at different depths.
+     * Depth testing is never enabled - hidden surfaces are removed by the
+     * painter's algorithm, i.e. by drawing the triangles back to front.
+     */
+    const glm::vec3 right(1.0f, 0.0f, 0.0f), up(0.0f, 1.0f, 0.0f);
+    Geometry scene;
+    addQuad(scene, glm::vec3( 0.0f,  0.0f,  0.0f), right, up, glm::vec3(1.0f, 0.0f, 0.0f));
+    addQuad(scene, glm::vec3( 0.3f,  0.3f, -0.4f), right, up, glm::vec3(0.0f, 1.0f, 0.0f));
+    addQuad(scene, glm::vec3(-0.3f,  0.2f, -0.8f), right, up, glm::vec3(0.0f, 0.0f, 1.0f));
+    addQuad(scene, glm::vec3( 0.1f, -0.3f, -1.2f), right, up, glm::vec3(1.0f, 1.0f, 0.0f));
+    // a slanted quad cutting through the stack - no depth order is right for it,
+    // it has to be split
+    addQuad(scene, glm::vec3( 0.0f, -0.1f, -0.6f), glm::vec3(0.6f, 0.0f, 0.0f), glm::vec3(0.0f, 0.5f, 1.4f),
+            glm::vec3(1.0f, 0.5f, 0.0f));
+
+    ThreadPool pool;
+    PainterPipeline painter(pool);
+    double statsTime = glfwGetTime();
+
+    // An OBJ or PLY file given on the command line is drawn next to the
+    // scene, depth-tested, from a Mesh in the compact vertex format; it is
+    // scaled to fit a unit box. Text files are parsed, simplified into levels
+    // of detail and optimized once and converted to a binary cache next to
+    // them (input.obj.mesh), which later starts map and upload as they are; a
+    // .mesh file (see tools/mesh_convert) is used directly.
+    Mesh model;
+    glm::mat4 modelFit(1.0f);
+    uint64_t modelFeatures = 0;
+    if (argc > 1)
+    {
+        std::string path = argv[1];
+        bool converted = path.size() > 5 && path.compare(path.size() - 5, 5, ".mesh") == 0;
+        std::string cachePath = converted ? path : path + ".mesh";
+        uint64_t stamp = converted ? 0 : MeshCache::stampOf(path);
+        double loadStart = glfwGetTime();
+        MeshCache cache;
+        if (cache.open(cachePath) && (converted || cache.header().sourceStamp == stamp) && cache.upload(model))
+            std::cout << "mesh: " << cachePath << " mapped and uploaded in " << (glfwGetTime() - loadStart) * 1000.0
+                      << " ms, ";
+        else if (!converted)
+        {
+            MeshLoader loader(pool);
+            Geometry geometry;
+            EncodedMesh encoded;
+            // the mesh is drawn in a fixed order, so its triangles and
+            // vertices are reordered for the vertex cache once, here, with
+            // every level of detail
+            MeshSimplifier simplifier;
+            MeshOptimizer optimizer;
+            std::vector<MeshLod> lods;
+            if (loader.load(path, geometry))
+            {
+                simplifier.build(geometry, lods);
+                optimizer.optimize(geometry, lods);
+                encodeMesh(geometry, VertexFormat(), encoded);
+                encoded.lods = lods;
+            }
+            if (encoded.indexCount && model.create(encoded))
+            {
+                MeshCache::save(cachePath, encoded, stamp);
+                const MeshLoadStats& loaded = loader.stats();
+                const MeshOptimizeStats& optimized = optimizer.stats();
+                std::cout << "mesh: " << path << " parsed in " << loaded.totalMs << " ms (" << loaded.throughput()
+                          << " MB/s, " << loaded.chunks << " chunks), vertex cache ACMR " << optimized.before.acmr
+                          << " -> " << optimized.after.acmr << ", ATVR " << optimized.before.atvr << " -> "
+                          << optimized.after.atvr << " (" << optimized.cacheMs + optimized.fetchMs << " ms), "
+                          << simplifier.stats().levels << " levels of detail in " << simplifier.stats().buildMs
+                          << " ms, cached as " << cachePath << ", ";
+            }
+        }
+        // centered on its bounding box, the longest side scaled to 1
+        if (model.isCreated())
+        {
+            const MeshBounds& bounds = model.bounds();
+            float largest = std::max(bounds.extent.x, std::max(bounds.extent.y, bounds.extent.z));
+            modelFit = glm::scale(glm::mat4(1.0f), glm::vec3(largest > 0.0f ? 0.5f / largest : 1.0f));
+            modelFit = glm::translate(modelFit, -bounds.center);
+            std::cout << model.stats().vertices << " vertices, " << model.stats().triangles << " triangles, "
+                      << model.stats().bytes << " bytes on the GPU" << std::endl;
+            meshLods = model.lodCount();
+            if (model.normalEncoding() != NormalEncoding::None)
+                modelFeatures = NORMALS | (model.normalEncoding() == NormalEncoding::Octahedral ? OCTAHEDRAL_NORMALS : 0);
+            shaders.prewarm({ modelFeatures, modelFeatures | VERTEX_COLORS, modelFeatures | FOG,
+                              modelFeatures | VERTEX_COLORS | FOG });
+            for (size_t i = 0; i < model.lodCount(); ++i)
+                std::cout << "mesh: lod " << i << ", " << model.lod(i).indexCount / 3 << " triangles, error "
+                          << model.lod(i).error << std::endl;
+        }
+    }
+
+    // The scene is static, so its BSP tree is built once and kept on disk
+    BspTree bspTree;
+    if (!bspTree.load("scene.bsp") || !bspTree.builtFrom(scene))
+    {
+        bspTree.build(scene);
+        bspTree.save("scene.bsp");
+        std::cout << "bsp: built in " << bspTree.stats().buildMs << " ms, ";
+    }
+    else
+        std::cout << "bsp: loaded scene.bsp, ";
+    std::cout << bspTree.stats().nodes << " nodes, " << bspTree.stats().splits << " splits, "
+              << bspTree.stats().triangles << " triangles, depth " << bspTree.stats().depth << std::endl;
+    std::vector<unsigned int> bspIndices;
+    // vertices currently in the VBO - the BSP tree has its own set (with split vertices)
+    const Geometry* uploaded = &scene;
+
     unsigned int VBO, VAO, EBO;
+    // buffer sizes in elements; polygon splitting can make a frame need more
+    size_t vboCapacity = scene.vertices.size();
+    size_t eboCapacity = scene.indices.size();
 
     glGenVertexArrays(1, &VAO); 
     glGenBuffers(1, &VBO);
@@ -88,8 +281,12 @@ int main()
      * we can just bind the corresponding VAO
      * 
      * Source: https://learnopengl.com/Getting-started/Hello-Triangle
+     *
+     * Binds and state changes go through GLState, which drops the ones that
+     * would not change anything.
      */
-    glBindVertexArray(VAO);
+    GLState& glState = GLState::current();
+    glState.bindVertexArray(VAO);
 
     /* Loading the vertices into Vertex Buffer Objects (VBO)
      *
@@ -101,33 +298,60 @@ int main()
      * without having to send data one vertex at a time.
      * 
      * Source: https://learnopengl.com/Getting-started/Hello-Triangle
+     *
+     * Vertices created by splitting polygons are appended every frame,
+     * hence GL_DYNAMIC_DRAW.
      */
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vboCapacity * sizeof(float), scene.vertices.data(), GL_DYNAMIC_DRAW);
 
     /* An EBO (element buffer objects) is a buffer, 
      * just like a vertex buffer object, that stores indices 
      * that OpenGL uses to decide what vertices to draw. 
+     * The painter's algorithm rewrites the index order every frame,
+     * hence GL_DYNAMIC_DRAW.
      */
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, eboCapacity * sizeof(unsigned int), scene.indices.data(), GL_DYNAMIC_DRAW);
+
+    /* Where buffer storage is available the EBO is replaced by a persistently
+     * mapped, triple-buffered ring: the pipeline writes each frame's indices
+     * straight into it instead of re-specifying the buffer.
+     */
+    IndexRing indexRing;
+    bool useIndexRing = indexRing.create(scene.indices.size());
+    if (!useIndexRing)
+        glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    std::cout << "indices: " << (useIndexRing ? "persistently mapped ring" : "glBufferSubData") << std::endl;
+    // a ring that fails to grow is released by map(): from then on the
+    // indices go through the EBO, which the VAO has to point at again
+    auto fallBackToEbo = [&]()
+    {
+        useIndexRing = false;
+        glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        std::cout << "indices: index ring could not grow, back to glBufferSubData" << std::endl;
+    };
 
-    // Set the vertex attributes pointers
-    //  position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    //  color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3* sizeof(float)));
-    glEnableVertexAttribArray(1);
+    // Set the vertex attributes pointers: position and color as floats, the
+    // layout of Geometry. The painter rewrites this buffer every frame, so it
+    // stays uncompressed; static meshes use Mesh and a compact VertexFormat
+    VertexAttribute attributes[3];
+    size_t attributeCount = VertexFormat::floats().attributes(false, attributes);
+    for (size_t i = 0; i < attributeCount; ++i)
+    {
+        glVertexAttribPointer(attributes[i].location, attributes[i].components, attributes[i].type,
+                              attributes[i].normalized, scene.stride * sizeof(float), (void*)(size_t)attributes[i].offset);
+        glEnableVertexAttribArray(attributes[i].location);
+    }
 
     /* note that this is allowed, 
      * the call to glVertexAttribPointer registered VBO
      * as the vertex attribute's bound vertex buffer object
      * so afterwards we can safely unbind
      */
-    glBindBuffer(GL_ARRAY_BUFFER, 0); 
-    glBindVertexArray(0);  
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+    glState.bindVertexArray(0);
     
     /*
      *  Note:
@@ -139,18 +363,93 @@ int main()
 
     // On window resize
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback); 
+    glfwSetKeyCallback(window, key_callback);
 
     // Wireframe mode activated
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    // Uniforms are resolved once per program, when a variant is first drawn
+    // with or has been reloaded; the frame itself does no lookups by name
+    Uniform<glm::mat4> modelUniform;
+    Shader* boundShader = NULL;
+    unsigned int boundGeneration = 0;
+    Uniform<glm::mat4> meshModelUniform;
+    Uniform<glm::mat3> normalMatrixUniform;
+    Shader* boundMeshShader = NULL;
+    unsigned int boundMeshGeneration = 0;
+    bool shadersReady = false;
+
+    // Shader sources read from SHADER_OVERRIDE_DIR (includes too) are watched
+    // in the background; a saved change is rebuilt while the old program
+    // keeps drawing, and swapped in once linked. Embedded sources never change.
+    ShaderWatcher shaderWatcher;
+    for (const std::string& file : shaders.sourceFiles())
+        shaderWatcher.watch(file);
+    if (!shaders.sourceFiles().empty())
+        shaderWatcher.start();
+    std::vector<ShaderChange> shaderChanges;
+    std::chrono::steady_clock::time_point shaderChanged;
+
+    FrameUniformBuffer frameUniforms;
+    frameUniforms.create();
+    std::cout << "frame uniforms: " << (frameUniforms.isMapped() ? "persistently mapped ring" : "glBufferSubData")
+              << std::endl;
+    FrameUniformData frameData;
+    // frame times per level of detail of the loaded mesh since the start,
+    // printed with the stats
+    LodSelector lodSelector;
+    std::vector<double> lodFrameMs(model.lodCount(), 0.0);
+    std::vector<size_t> lodFrames(model.lodCount(), 0);
+    size_t drawnLod = model.lodCount();
+    double previousTime = glfwGetTime();
+
     // Show window
     while(!glfwWindowShouldClose(window))
     {
+        UniformTable::resetLookups();
+        glState.resetStats();
         processInput(window);
 
         // Rendering
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT); 
+        // nothing to draw with until the prewarmed variants are built
+        if (!shadersReady)
+        {
+            if (!shaders.ready())
+            {
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+                continue;
+            }
+            shadersReady = true;
+            VariantStats variantStats = shaders.stats();
+            std::cout << "shader: " << variantStats.variants << " variants ready "
+                      << (glfwGetTime() - prewarmStart) * 1000.0 << " ms after the start of the build, "
+                      << variantStats.fromCache << " from the binary cache (" << (variantStats.fromCache ? "warm" : "cold")
+                      << " start), " << variantStats.buildMs << " ms build time in total, "
+                      << (Shader::parallelCompileEnabled() ? "parallel" : "serial") << " compile" << std::endl;
+        }
+        if (shaderWatcher.poll(shaderChanges))
+        {
+            for (ShaderChange& change : shaderChanges)
+                shaderLibrary.update(change.path, std::move(change.source));
+            shaderChanged = shaderChanges.front().detected;
+            shaders.reload();
+        }
+        if (shaders.updateReloads())
+        {
+            double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderChanged).count();
+            std::cout << "shader: reloaded " << latency << " ms after the change" << std::endl;
+        }
+        const uint64_t features = (vertexColors ? VERTEX_COLORS : 0) | (fog ? FOG : 0);
+        Shader& ourShader = shaders.get(features);
+        if (&ourShader != boundShader || ourShader.generation() != boundGeneration)
+        {
+            modelUniform = ourShader.uniform<glm::mat4>("model");
+            boundShader = &ourShader;
+            boundGeneration = ourShader.generation();
+        }
         // Change uniform color
         // float timeValue = glfwGetTime();
         // float greenValue = (sin(timeValue) / 2.0f) + 0.8f;
@@ -169,18 +468,216 @@ int main()
         // Rotation
         trans = glm::rotate(trans, (float)glfwGetTime(), glm::vec3(1.0f, 0.0f, 1.0f));
 
-        unsigned int transformLoc = glGetUniformLocation(ourShader.ID, "transform");
-        glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(trans));
+        // Virtual camera
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        float aspect = viewportHeight > 0 ? (float)viewportWidth / (float)viewportHeight : 1.0f;
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 100.0f);
+
+        double time = glfwGetTime();
+        frameData.view = view;
+        frameData.projection = projection;
+        frameData.viewProjection = projection * view;
+        frameData.viewport = glm::vec4((float)viewportWidth, (float)viewportHeight,
+                                       viewportWidth > 0 ? 1.0f / viewportWidth : 0.0f,
+                                       viewportHeight > 0 ? 1.0f / viewportHeight : 0.0f);
+        frameData.time = (float)time;
+        frameData.deltaTime = (float)(time - previousTime);
+        previousTime = time;
+        frameUniforms.update(frameData);
+
+        ourShader.set(modelUniform, trans);
+
+        // Hidden surfaces are removed by the draw order alone, so depth testing
+        // and blending stay off; asking every frame costs nothing, the state
+        // cache drops the calls, and the same holds for the VAO bind
+        glState.disable(GL_DEPTH_TEST);
+        glState.disable(GL_BLEND);
+        glState.bindVertexArray(VAO);
+
+        // Painter's algorithm - order triangles back to front, either by
+        // sorting (and splitting where needed) or by walking the BSP tree.
+        // With the index ring the indices go straight into mapped memory.
+        static const std::vector<float> noVertices;
+        const Geometry* drawGeometry = &scene;
+        const std::vector<float>* splitVertices = &noVertices;
+        const std::vector<unsigned int>* drawIndices = &bspIndices;
+        size_t indexCount = 0;
+        if (useBspTree)
+        {
+            bspTree.traverse(view * trans, bspIndices);
+            drawGeometry = &bspTree.splitGeometry();
+            indexCount = bspIndices.size();
+            unsigned int* out = useIndexRing ? indexRing.map(indexCount) : NULL;
+            if (out)
+                std::copy(bspIndices.begin(), bspIndices.end(), out);
+            else if (useIndexRing)
+                fallBackToEbo();
+        }
+        else
+        {
+            painter.culler.setEnabled(frustumCulling);
+            painter.culler.setBackFaceCulling(backFaceCulling);
+            painter.sorter.setMode(sortMode);
+            painter.resolver.setEnabled(resolveOverlaps);
+            painter.resolver.setGridBinning(gridBinning);
+            painter.setViewport(viewportWidth, viewportHeight);
+            bool mapped = true;
+            if (useIndexRing)
+                indexCount = painter.run(scene, view * trans, projection, [&indexRing, &mapped](size_t count)
+                {
+                    unsigned int* out = indexRing.map(count);
+                    mapped = out != NULL;
+                    return out;
+                });
+            // this frame's indices went nowhere: sort again into
+            // painter.indices() for the EBO
+            if (!mapped)
+                fallBackToEbo();
+            if (!useIndexRing)
+            {
+                painter.run(scene, view * trans, projection);
+                indexCount = painter.indices().size();
+            }
+            splitVertices = &painter.extraVertices();
+            drawIndices = &painter.indices();
+        }
+
+        // Split vertices go right behind the geometry's own vertices
+        const std::vector<float>& baseVertices = drawGeometry->vertices;
+        glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (baseVertices.size() + splitVertices->size() > vboCapacity)
+        {
+            vboCapacity = (baseVertices.size() + splitVertices->size()) * 2;
+            glBufferData(GL_ARRAY_BUFFER, vboCapacity * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+            uploaded = NULL;
+        }
+        if (uploaded != drawGeometry)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, baseVertices.size() * sizeof(float), baseVertices.data());
+            uploaded = drawGeometry;
+        }
+        if (!splitVertices->empty())
+            glBufferSubData(GL_ARRAY_BUFFER, baseVertices.size() * sizeof(float),
+                            splitVertices->size() * sizeof(float), splitVertices->data());
         
         // Render triangles
-        glBindVertexArray(VAO); // seeing as we only have a single VAO there's no need to bind it every time, but we'll do so to keep things a bit more organized
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        if (useIndexRing)
+        {
+            glDrawElements(GL_TRIANGLES, (GLsizei)indexCount, GL_UNSIGNED_INT, indexRing.offset());
+            indexRing.fence();
+        }
+        else
+        {
+            if (drawIndices->size() > eboCapacity)
+            {
+                eboCapacity = drawIndices->size() * 2;
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, eboCapacity * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+            }
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, drawIndices->size() * sizeof(unsigned int), drawIndices->data());
+            glDrawElements(GL_TRIANGLES, (GLsizei)indexCount, GL_UNSIGNED_INT, 0);
+        }
+        // the loaded mesh is not part of the painter's scene; it is drawn
+        // after it with the depth buffer
+        if (model.isCreated())
+        {
+            glClear(GL_DEPTH_BUFFER_BIT);
+            glState.enable(GL_DEPTH_TEST);
+            size_t level = lodSelector.select(model, trans * modelFit, view, projection, (float)viewportHeight);
+            if (forcedLod >= 0)
+                level = (size_t)forcedLod;
+            Shader& meshShader = shaders.get(features | modelFeatures);
+            if (&meshShader != boundMeshShader || meshShader.generation() != boundMeshGeneration)
+            {
+                meshModelUniform = meshShader.uniform<glm::mat4>("model");
+                if (modelFeatures)
+                    normalMatrixUniform = meshShader.uniform<glm::mat3>("normalMatrix");
+                boundMeshShader = &meshShader;
+                boundMeshGeneration = meshShader.generation();
+            }
+            meshShader.use();
+            meshShader.set(meshModelUniform, trans * modelFit * model.decode());
+            // rotation and a uniform scale: no inverse transpose needed, the
+            // shader normalizes
+            if (modelFeatures)
+                meshShader.set(normalMatrixUniform, glm::mat3(view * trans * modelFit));
+            model.drawLod(level);
+            // the time since the last frame is charged to the level drawn then
+            if (drawnLod < lodFrames.size())
+            {
+                lodFrameMs[drawnLod] += frameData.deltaTime * 1000.0;
+                ++lodFrames[drawnLod];
+            }
+            drawnLod = level;
+        }
+        frameUniforms.fence();
+
+        size_t frameLookups = UniformTable::lookups();
+        GLStateStats frameState = glState.stats();
+        if (model.isCreated() && glfwGetTime() - statsTime >= 1.0)
+        {
+            std::cout << "mesh: lod " << drawnLod << " of " << model.lodCount();
+            if (forcedLod >= 0)
+                std::cout << " (forced)";
+            else
+                std::cout << " (" << lodSelector.pixelError() << " px error)";
+            std::cout << ", " << model.lod(drawnLod).indexCount / 3 << " triangles; frame time per lod:";
+            for (size_t i = 0; i < model.lodCount(); ++i)
+            {
+                std::cout << " " << i << ": " << model.lod(i).indexCount / 3 << " triangles ";
+                if (lodFrames[i])
+                    std::cout << lodFrameMs[i] / lodFrames[i] << " ms";
+                else
+                    std::cout << "-";
+            }
+            std::cout << std::endl;
+        }
+        if (glfwGetTime() - statsTime >= 1.0 && useBspTree)
+        {
+            std::cout << "bsp: " << bspTree.stats().triangles << " triangles, traversal "
+                      << bspTree.stats().traverseMs << " ms, " << frameLookups << " uniform lookups per frame, gl state "
+                      << frameState.issued << " calls issued, " << frameState.skipped << " skipped" << std::endl;
+            statsTime = glfwGetTime();
+        }
+        else if (glfwGetTime() - statsTime >= 1.0)
+        {
+            const PainterStats& stats = painter.sorter.stats();
+            const ResolverStats& resolved = painter.resolver.stats();
+            const CullStats& culled = painter.culler.stats();
+            std::cout << "painter: ";
+            if (painter.culler.isEnabled())
+                std::cout << "culled " << culled.cullRatio() * 100.0 << "% in " << culled.cullMs << " ms ("
+                          << culled.outside << " outside, " << culled.backFacing << " back-facing), ";
+            std::cout << sortModeName(painter.sorter.mode()) << ", " << stats.triangles << " triangles, "
+                      << "keys (" << simdLevelName(painter.sorter.simd()) << ") " << stats.keyMs << " ms, sort " << stats.sortMs << " ms";
+            if (painter.sorter.mode() == SortMode::Incremental)
+                std::cout << " (" << stats.fastPaths << " repaired, " << stats.fullResorts << " full resorts)";
+            if (painter.clipper.isEnabled() && painter.clipper.stats().clipped)
+                std::cout << ", near-clipped " << painter.clipper.stats().clipped << " in "
+                          << painter.clipper.stats().clipMs << " ms";
+            if (painter.resolver.isEnabled())
+                std::cout << ", overlaps " << resolved.resolveMs << " ms (" << resolved.comparisons << " tests, "
+                          << resolved.moves << " moves, " << resolved.splits << " splits)";
+            if (painter.resolver.isEnabled() && painter.resolver.gridBinning())
+                std::cout << ", grid " << resolved.gridColumns << "x" << resolved.gridRows << " ("
+                          << resolved.occupiedCells << " cells used, " << resolved.averageOccupancy() << " avg, "
+                          << resolved.maxOccupancy << " max per cell)";
+            if (useIndexRing)
+                std::cout << ", index ring " << indexRing.stats().stalls << " stalls (" << indexRing.stats().stallMs
+                          << " ms waited, " << indexRing.stats().grows << " grows)";
+            std::cout << ", " << frameLookups << " uniform lookups per frame, gl state " << frameState.issued
+                      << " calls issued, " << frameState.skipped << " skipped" << std::endl;
+            statsTime = glfwGetTime();
+        }
         
         // There are 2 buffers - back and front buffer
         glfwSwapBuffers(window);
         glfwPollEvents();    
     }
 
+    shaderWatcher.stop();
+    model.release();
+    indexRing.release();
+    frameUniforms.release();
     glfwTerminate();
     return 0;
 }
@@ -189,6 +686,8 @@ int main()
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    viewportWidth = width;
+    viewportHeight = height;
 }  
 
 // Control input
@@ -196,4 +695,89 @@ void processInput(GLFWwindow *window)
 {
     if(glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
+}
+
+// Single key presses (toggles)
+void key_callback(GLFWwindow* /*window*/, int key, int /*scancode*/, int action, int /*mods*/)
+{
+    if (action != GLFW_PRESS)
+        return;
+    if (key == GLFW_KEY_P)
+    {
+        // Unsorted -> std::sort -> parallel radix -> incremental -> Unsorted ...
+        sortMode = (SortMode)(((int)sortMode + 1) % 4);
+        std::cout << "painter: sort mode " << sortModeName(sortMode) << std::endl;
+    }
+    if (key == GLFW_KEY_B)
+    {
+        useBspTree = !useBspTree;
+        std::cout << "painter: ordering by " << (useBspTree ? "BSP tree" : "depth sort") << std::endl;
+    }
+    if (key == GLFW_KEY_G)
+    {
+        gridBinning = !gridBinning;
+        std::cout << "painter: screen grid binning " << (gridBinning ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_F)
+    {
+        frustumCulling = !frustumCulling;
+        std::cout << "painter: frustum culling " << (frustumCulling ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_C)
+    {
+        backFaceCulling = !backFaceCulling;
+        std::cout << "painter: back-face culling " << (backFaceCulling ? "on" : "off")
+                  << (frustumCulling ? "" : " (needs frustum culling on)") << std::endl;
+    }
+    if (key == GLFW_KEY_V)
+    {
+        vertexColors = !vertexColors;
+        std::cout << "shader: vertex colors " << (vertexColors ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_O)
+    {
+        fog = !fog;
+        std::cout << "shader: fog " << (fog ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_L)
+    {
+        // automatic -> 0 -> 1 -> ... -> automatic
+        forcedLod = forcedLod + 1 < (int)meshLods ? forcedLod + 1 : -1;
+        if (forcedLod < 0)
+            std::cout << "mesh: level of detail by screen-space error" << std::endl;
+        else
+            std::cout << "mesh: level of detail " << forcedLod << std::endl;
+    }
+    if (key == GLFW_KEY_N)
+    {
+        resolveOverlaps = !resolveOverlaps;
+        std::cout << "painter: overlap resolution " << (resolveOverlaps ? "on" : "off") << std::endl;
+    }
+}
+
+// Append a quad (two triangles) spanned by the `right` and `up` edges
+void addQuad(Geometry& scene, glm::vec3 center, glm::vec3 right, glm::vec3 up, glm::vec3 color)
+{
+    const float corners[4][2] = {
+        { 0.5f,  0.5f},  // top right
+        { 0.5f, -0.5f},  // bottom right
+        {-0.5f, -0.5f},  // bottom left
+        {-0.5f,  0.5f}   // top left
+    };
+    unsigned int first = (unsigned int)scene.vertexCount();
+    for (int i = 0; i < 4; ++i)
+    {
+        glm::vec3 position = center + right * corners[i][0] + up * corners[i][1];
+        const float vertex[] = {
+            position.x, position.y, position.z,
+            color.x, color.y, color.z
+        };
+        scene.vertices.insert(scene.vertices.end(), vertex, vertex + 6);
+    }
+    const unsigned int quad[] = {
+        first + 0, first + 1, first + 3,   // first triangle
+        first + 1, first + 2, first + 3    // second triangle
+    };
+    scene.indices.insert(scene.indices.end(), quad, quad + 6);
+    scene.changed();
 }
\ No newline at end of file
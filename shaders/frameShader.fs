@@ -0,0 +1,21 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 ourColor;
+#ifdef FOG
+in float viewDepth;
+
+// fades into the clear color between these view distances
+const vec3 fogColor = vec3(0.2, 0.3, 0.3);
+const float fogStart = 2.0;
+const float fogEnd = 5.0;
+#endif
+
+void main()
+{
+    vec3 color = ourColor;
+#ifdef FOG
+    color = mix(color, fogColor, clamp((viewDepth - fogStart) / (fogEnd - fogStart), 0.0, 1.0));
+#endif
+    FragColor = vec4(color, 1.0f);
+}
@@ -0,0 +1,11 @@
+// per-frame data shared by every program, written once a frame; std140, in
+// step with FrameUniformData in FrameUniforms.hpp
+layout (std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 viewport;      // width, height, 1 / width, 1 / height
+    float time;         // seconds since the start
+    float deltaTime;    // seconds since the previous frame
+};
@@ -0,0 +1,9 @@
+// normals stored as 2 snorm16 on the unfolded octahedron (NormalEncoding::
+// Octahedral in VertexFormat.hpp), read as a normalized vec2
+vec3 octahedralDecode(vec2 encoded)
+{
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
@@ -0,0 +1,48 @@
+#version 330 core
+#include "frame_uniforms.glsl"
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+#ifdef NORMALS
+#ifdef OCTAHEDRAL_NORMALS
+#include "octahedral.glsl"
+layout (location = 2) in vec2 aNormal;
+#else
+layout (location = 2) in vec3 aNormal;
+#endif
+#endif
+
+out vec3 ourColor;
+#ifdef FOG
+out float viewDepth;
+#endif
+
+uniform mat4 model;
+#ifdef NORMALS
+// model to view space for normals: the model matrix without the position
+// decode, which the normals never went through
+uniform mat3 normalMatrix;
+#endif
+
+void main()
+{
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
+#ifdef VERTEX_COLORS
+    ourColor = aColor;
+#else
+    ourColor = vec3(0.8);
+#endif
+#ifdef NORMALS
+#ifdef OCTAHEDRAL_NORMALS
+    vec3 normal = octahedralDecode(aNormal);
+#else
+    vec3 normal = aNormal;
+#endif
+    // a headlight at the eye, both sides lit
+    ourColor *= 0.3 + 0.7 * abs(normalize(normalMatrix * normal).z);
+#endif
+#ifdef FOG
+    // w of a perspective projection is the distance along the view axis
+    viewDepth = gl_Position.w;
+#endif
+}
@@ -0,0 +1,129 @@
+// MeshCache::open on corrupt headers: every file here must be rejected in
+// every build, before a payload pointer is handed out - sizes and offsets
+// near 2^64 included, where unchecked sums wrap around.
+//
+//     mesh_cache_test
+//
+// Exits with the number of failed checks.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <MeshCache.hpp>
+
+static std::string directory;
+static int failures = 0;
+
+static std::vector<char> readAll(const std::string& path)
+{
+    std::vector<char> contents;
+    FILE* file = std::fopen(path.c_str(), "rb");
+    char buffer[4096];
+    size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        contents.insert(contents.end(), buffer, buffer + read);
+    std::fclose(file);
+    return contents;
+}
+
+// `contents` opens, or not, as `expected`
+static void check(const char* name, const std::vector<char>& contents, bool expected)
+{
+    std::string path = directory + "/" + name;
+    FILE* file = std::fopen(path.c_str(), "wb");
+    std::fwrite(contents.data(), 1, contents.size(), file);
+    std::fclose(file);
+    MeshCache cache;
+    bool opened = cache.open(path);
+    if (opened != expected)
+        ++failures;
+    std::printf("%s %s\n", opened == expected ? "ok  " : "FAIL", name);
+    cache.close();
+    std::remove(path.c_str());
+}
+
+// `valid` with the header field at `offset` set to `value`
+template <typename T>
+static std::vector<char> patched(const std::vector<char>& valid, size_t offset, T value)
+{
+    std::vector<char> contents = valid;
+    std::memcpy(&contents[offset], &value, sizeof(value));
+    return contents;
+}
+
+int main()
+{
+    char pattern[] = "/tmp/mesh_cache_testXXXXXX";
+    if (!mkdtemp(pattern))
+    {
+        std::printf("cannot create a temporary directory\n");
+        return 1;
+    }
+    directory = pattern;
+
+    // a 4x4 grid of quads
+    Geometry grid;
+    for (int y = 0; y <= 4; ++y)
+    {
+        for (int x = 0; x <= 4; ++x)
+        {
+            const float vertex[] = { (float)x, (float)y, 0.0f, 1.0f, 1.0f, 1.0f };
+            grid.vertices.insert(grid.vertices.end(), vertex, vertex + 6);
+        }
+    }
+    for (unsigned int y = 0; y < 4; ++y)
+    {
+        for (unsigned int x = 0; x < 4; ++x)
+        {
+            unsigned int v = y * 5 + x;
+            const unsigned int quad[] = { v, v + 1, v + 5, v + 1, v + 6, v + 5 };
+            grid.indices.insert(grid.indices.end(), quad, quad + 6);
+        }
+    }
+    EncodedMesh encoded;
+    encodeMesh(grid, VertexFormat(), encoded);
+    const std::string path = directory + "/grid.mesh";
+    MeshCache::save(path, encoded);
+    const std::vector<char> valid = readAll(path);
+    std::remove(path.c_str());
+    MeshCacheHeader header;
+    std::memcpy(&header, valid.data(), sizeof(header));
+
+    check("valid.mesh", valid, true);
+    std::vector<char> truncated(valid.begin(), valid.end() - 1);
+    check("truncated.mesh", truncated, false);
+
+    // offset + bytes wrapping past 2^64 back into the file, the counts
+    // consistent with the bytes
+    const uint64_t wrap = ~uint64_t(0) - 63;
+    const uint64_t indexSize = header.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    std::vector<char> wrapped = patched(valid, offsetof(MeshCacheHeader, indexOffset), wrap);
+    wrapped = patched(wrapped, offsetof(MeshCacheHeader, indexBytes), (uint64_t)64);
+    wrapped = patched(wrapped, offsetof(MeshCacheHeader, indexCount), 64 / indexSize);
+    wrapped = patched(wrapped, offsetof(MeshCacheHeader, lodCount), (uint32_t)0);
+    check("index_offset_wraps.mesh", wrapped, false);
+    wrapped = patched(valid, offsetof(MeshCacheHeader, vertexOffset), wrap);
+    wrapped = patched(wrapped, offsetof(MeshCacheHeader, vertexBytes), (uint64_t)64 / header.stride * header.stride);
+    wrapped = patched(wrapped, offsetof(MeshCacheHeader, vertexCount), (uint64_t)64 / header.stride);
+    check("vertex_offset_wraps.mesh", wrapped, false);
+    // count * size wrapping around to the stored byte count
+    uint64_t wrappedCount = header.vertexCount + (uint64_t(1) << 63) / (header.stride & -header.stride) * 2;
+    check("vertex_count_wraps.mesh", patched(valid, offsetof(MeshCacheHeader, vertexCount), wrappedCount), false);
+    check("index_count_wraps.mesh",
+          patched(valid, offsetof(MeshCacheHeader, indexCount), header.indexCount + (uint64_t(1) << 63) / indexSize * 2),
+          false);
+    check("huge_index_bytes.mesh",
+          patched(valid, offsetof(MeshCacheHeader, indexBytes), ~uint64_t(0)), false);
+    check("overlapping_payloads.mesh",
+          patched(valid, offsetof(MeshCacheHeader, indexOffset), header.vertexOffset), false);
+
+    rmdir(directory.c_str());
+    std::printf("%d failed\n", failures);
+    return failures;
+}
@@ -0,0 +1,154 @@
+// MeshLoader on malformed input: every file here must be rejected with
+// load() returning false - no crash, no std::bad_alloc - while the valid
+// files next to them still load. Counts, list lengths and indices come
+// from files that may be large and untrusted.
+//
+//     mesh_loader_test
+//
+// Exits with the number of failed checks.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include <MeshLoader.hpp>
+#include <ThreadPool.hpp>
+
+static std::string directory;
+static int failures = 0;
+
+static std::string write(const char* name, const std::string& contents)
+{
+    std::string path = directory + "/" + name;
+    FILE* file = std::fopen(path.c_str(), "wb");
+    std::fwrite(contents.data(), 1, contents.size(), file);
+    std::fclose(file);
+    return path;
+}
+
+template <typename T>
+static void append(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// `name` loads, or not, as `expected`; a loaded mesh has `triangles` triangles
+static void check(MeshLoader& loader, const char* name, const std::string& contents, bool expected,
+                  size_t triangles = 0)
+{
+    std::string path = write(name, contents);
+    Geometry geometry;
+    bool loaded = loader.load(path, geometry);
+    bool passed = loaded == expected && (!loaded || geometry.triangleCount() == triangles);
+    if (!passed)
+        ++failures;
+    std::printf("%s %s\n", passed ? "ok  " : "FAIL", name);
+    std::remove(path.c_str());
+}
+
+static std::string plyHeader(const char* format, const char* vertices, const char* faces,
+                             const char* countType = "uchar", const char* indexType = "int")
+{
+    return std::string("ply\nformat ") + format + " 1.0\nelement vertex " + vertices +
+           "\nproperty float x\nproperty float y\nproperty float z\nelement face " + faces + "\nproperty list " +
+           countType + " " + indexType + " vertex_indices\nend_header\n";
+}
+
+// three vertices, then `faces` faces of three indices each
+static std::string binaryBody(uint32_t faces, uint32_t lastIndex = 2)
+{
+    std::string body;
+    for (int i = 0; i < 9; ++i)
+        append(body, (float)(i % 3 == i / 3));
+    for (uint32_t f = 0; f < faces; ++f)
+    {
+        append(body, (uint8_t)3);
+        append(body, (int32_t)0);
+        append(body, (int32_t)1);
+        append(body, (int32_t)lastIndex);
+    }
+    return body;
+}
+
+int main()
+{
+    char pattern[] = "/tmp/mesh_loader_testXXXXXX";
+    if (!mkdtemp(pattern))
+    {
+        std::printf("cannot create a temporary directory\n");
+        return 1;
+    }
+    directory = pattern;
+    ThreadPool pool;
+    MeshLoader loader(pool);
+
+    const std::string asciiBody = "1 0 0\n0 1 0\n0 0 1\n3 0 1 2\n";
+    check(loader, "valid.ply", plyHeader("ascii", "3", "1") + asciiBody, true, 1);
+    check(loader, "valid_binary.ply", plyHeader("binary_little_endian", "3", "2") + binaryBody(2), true, 2);
+    check(loader, "valid.obj", "v 1 0 0\nv 0 1 0\nv 0 0 1\nf 1 2 3\n", true, 1);
+
+    // counts the body cannot hold, before anything is allocated for them
+    check(loader, "huge_vertex_count.ply", "ply\nformat ascii 1.0\nelement vertex 99999999999999999\nend_header\n",
+          false);
+    check(loader, "huge_vertex_count_binary.ply",
+          plyHeader("binary_little_endian", "99999999999999999", "1") + binaryBody(1), false);
+    check(loader, "huge_face_count.ply", plyHeader("ascii", "3", "18446744073709551615") + asciiBody, false);
+    check(loader, "negative_count.ply", plyHeader("ascii", "-1", "1") + asciiBody, false);
+
+    // truncated ASCII: fewer lines than the elements declare
+    check(loader, "truncated_ascii.ply", plyHeader("ascii", "4", "2") + "1 0 0\n", false);
+
+    // truncated binary: inside the vertices, inside a face, a list that
+    // claims more indices than the file has
+    std::string binary = plyHeader("binary_little_endian", "3", "2") + binaryBody(2);
+    check(loader, "truncated_vertices.ply", binary.substr(0, binary.size() - 2 * 13 - 20), false);
+    check(loader, "truncated_face.ply", binary.substr(0, binary.size() - 5), false);
+    std::string longList = plyHeader("binary_little_endian", "3", "1", "uint") + binaryBody(0);
+    append(longList, (uint32_t)0xffffffffu);
+    append(longList, (int32_t)0);
+    check(loader, "huge_list_count.ply", longList, false);
+    std::string floatCount = plyHeader("binary_little_endian", "3", "1", "float") + binaryBody(0);
+    append(floatCount, -3.0f);
+    check(loader, "negative_list_count.ply", floatCount, false);
+
+    // indices out of range
+    check(loader, "index_out_of_range.ply", plyHeader("ascii", "3", "1") + "1 0 0\n0 1 0\n0 0 1\n3 0 1 3\n", false);
+    check(loader, "negative_index.ply", plyHeader("ascii", "3", "1") + "1 0 0\n0 1 0\n0 0 1\n3 0 1 -1\n", false);
+    check(loader, "index_out_of_range_binary.ply",
+          plyHeader("binary_little_endian", "3", "1") + binaryBody(1, 3), false);
+    check(loader, "negative_index_binary.ply",
+          plyHeader("binary_little_endian", "3", "1") + binaryBody(1, (uint32_t)-1), false);
+    check(loader, "index_out_of_range.obj", "v 1 0 0\nv 0 1 0\nv 0 0 1\nf 1 2 4\n", false);
+    check(loader, "relative_index_out_of_range.obj", "v 1 0 0\nv 0 1 0\nv 0 0 1\nf -1 -2 -4\n", false);
+    check(loader, "zero_index.obj", "v 1 0 0\nv 0 1 0\nv 0 0 1\nf 0 1 2\n", false);
+    // indices past 32 bits, which must not wrap around into range
+    check(loader, "index_wraps.obj", "v 1 0 0\nv 0 1 0\nv 0 0 1\nf 1 2 4294967298\n", false);
+    check(loader, "normal_index_wraps.obj", "v 1 0 0\nv 0 1 0\nv 0 0 1\nvn 0 0 1\nf 1//1 2//1 3//4294967297\n",
+          false);
+    check(loader, "relative_index_wraps.obj", "v 1 0 0\nv 0 1 0\nv 0 0 1\nf -1 -2 -4294967297\n", false);
+    check(loader, "index_overflows.obj", "v 1 0 0\nv 0 1 0\nv 0 0 1\nf 1 2 99999999999999999999999999\n", false);
+
+    // corners without a normal next to corners with one get a unit normal
+    std::string mixed = write("mixed_normals.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nvn 0 0 1\n"
+                                                   "f 1//1 2//1 3//1\nf 2 4 3\n");
+    Geometry geometry;
+    bool unit = loader.load(mixed, geometry) && geometry.stride == 9;
+    for (size_t v = 0; unit && v < geometry.vertexCount(); ++v)
+    {
+        const float* n = &geometry.vertices[v * geometry.stride + 6];
+        unit = std::fabs(n[0] * n[0] + n[1] * n[1] + n[2] * n[2] - 1.0f) < 1e-5f;
+    }
+    if (!unit)
+        ++failures;
+    std::printf("%s mixed_normals.obj\n", unit ? "ok  " : "FAIL");
+    std::remove(mixed.c_str());
+
+    rmdir(directory.c_str());
+    std::printf("%d failed\n", failures);
+    return failures;
+}
@@ -0,0 +1,67 @@
+// MeshOptimizer::analyze against index streams whose FIFO cache misses can
+// be counted by hand, and optimize() on a grid: it must keep every triangle
+// and not make the cache figures worse.
+//
+//     mesh_optimizer_test
+//
+// Exits with the number of failed checks.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <MeshOptimizer.hpp>
+
+static int failures = 0;
+
+static void check(const char* name, double value, double expected)
+{
+    bool passed = std::fabs(value - expected) < 1e-9;
+    if (!passed)
+        ++failures;
+    std::printf("%s %s: %g (expected %g)\n", passed ? "ok  " : "FAIL", name, value, expected);
+}
+
+int main()
+{
+    // the same triangle twice: three misses in a cache of three, six in a
+    // cache of two (each load evicts the vertex needed next)
+    const unsigned int twice[] = { 0, 1, 2, 0, 1, 2 };
+    check("acmr, 3 entries", MeshOptimizer::analyze(twice, 6, 3, 3).acmr, 1.5);
+    check("atvr, 3 entries", MeshOptimizer::analyze(twice, 6, 3, 3).atvr, 1.0);
+    check("acmr, 2 entries", MeshOptimizer::analyze(twice, 6, 3, 2).acmr, 3.0);
+    // 0 stays loaded while exactly cacheSize - 1 other vertices come in
+    const unsigned int reuse[] = { 0, 1, 2, 3, 4, 0 };
+    check("acmr, reused at the edge", MeshOptimizer::analyze(reuse, 6, 5, 5).acmr, 2.5);
+    check("acmr, evicted just before", MeshOptimizer::analyze(reuse, 6, 5, 4).acmr, 3.0);
+
+    // a 32x32 grid of quads, drawn row by row
+    const unsigned int size = 32;
+    Geometry grid;
+    for (unsigned int y = 0; y <= size; ++y)
+    {
+        for (unsigned int x = 0; x <= size; ++x)
+        {
+            const float vertex[] = { (float)x, (float)y, 0.0f, 1.0f, 1.0f, 1.0f };
+            grid.vertices.insert(grid.vertices.end(), vertex, vertex + 6);
+        }
+    }
+    for (unsigned int y = 0; y < size; ++y)
+    {
+        for (unsigned int x = 0; x < size; ++x)
+        {
+            unsigned int v = y * (size + 1) + x;
+            const unsigned int quad[] = { v, v + 1, v + size + 1, v + 1, v + size + 2, v + size + 1 };
+            grid.indices.insert(grid.indices.end(), quad, quad + 6);
+        }
+    }
+    MeshOptimizer optimizer;
+    optimizer.optimize(grid);
+    const MeshOptimizeStats& stats = optimizer.stats();
+    check("grid triangles kept", (double)grid.triangleCount(), 2.0 * size * size);
+    check("grid acmr not worse", stats.after.acmr <= stats.before.acmr, 1.0);
+
+    std::printf("%d failed\n", failures);
+    return failures;
+}
@@ -0,0 +1,93 @@
+// Converts an OBJ or PLY mesh to the binary mesh cache (MeshCache.hpp), the
+// file the program maps instead of parsing text at startup. The mesh is
+// simplified into levels of detail (MeshSimplifier.hpp), and triangles and
+// vertices are reordered for the vertex cache (MeshOptimizer.hpp).
+//
+//     mesh_convert input.obj|input.ply output.mesh [compact|half|float]
+//
+// compact (the default) stores Snorm16 positions, Rgba8 colors and
+// octahedral normals, half uses half floats for the positions, float keeps
+// the 32-bit layout of Geometry.
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <MeshCache.hpp>
+#include <MeshLoader.hpp>
+#include <MeshOptimizer.hpp>
+#include <MeshSimplifier.hpp>
+#include <ThreadPool.hpp>
+#include <VertexFormat.hpp>
+
+static double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "usage: " << argv[0] << " input.obj|input.ply output.mesh [compact|half|float]" << std::endl;
+        return 1;
+    }
+    VertexFormat format;
+    if (argc > 3 && std::strcmp(argv[3], "half") == 0)
+        format.position = PositionEncoding::Half;
+    else if (argc > 3 && std::strcmp(argv[3], "float") == 0)
+        format = VertexFormat::floats();
+    else if (argc > 3 && std::strcmp(argv[3], "compact") != 0)
+    {
+        std::cout << "ERROR::MESH_CONVERT::UNKNOWN_FORMAT: " << argv[3] << std::endl;
+        return 1;
+    }
+
+    ThreadPool pool;
+    MeshLoader loader(pool);
+    Geometry geometry;
+    if (!loader.load(argv[1], geometry))
+        return 1;
+    const MeshLoadStats& loaded = loader.stats();
+    std::cout << argv[1] << ": " << loaded.vertices << " vertices, " << loaded.triangles << " triangles, "
+              << loaded.bytes << " bytes, parsed in " << loaded.totalMs << " ms" << std::endl;
+
+    MeshSimplifier simplifier;
+    std::vector<MeshLod> lods;
+    simplifier.build(geometry, lods);
+    std::cout << simplifier.stats().levels << " levels of detail, " << simplifier.stats().collapses
+              << " edge collapses in " << simplifier.stats().buildMs << " ms" << std::endl;
+    for (size_t i = 0; i < lods.size(); ++i)
+        std::cout << "  lod " << i << ": " << lods[i].indexCount / 3 << " triangles, error " << lods[i].error
+                  << std::endl;
+
+    MeshOptimizer optimizer;
+    optimizer.optimize(geometry, lods);
+    const MeshOptimizeStats& optimized = optimizer.stats();
+    std::cout << "vertex cache (" << VERTEX_CACHE_SIZE << " entries): ACMR " << optimized.before.acmr << " -> "
+              << optimized.after.acmr << ", ATVR " << optimized.before.atvr << " -> " << optimized.after.atvr
+              << ", triangles reordered in " << optimized.cacheMs << " ms, vertices in " << optimized.fetchMs << " ms"
+              << std::endl;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    EncodedMesh encoded;
+    encodeMesh(geometry, format, encoded);
+    encoded.lods = lods;
+    if (!MeshCache::save(argv[2], encoded, MeshCache::stampOf(argv[1])))
+        return 1;
+    double convertMs = msSince(start);
+
+    // read it back the way the program does
+    start = std::chrono::steady_clock::now();
+    MeshCache cache;
+    if (!cache.open(argv[2]))
+        return 1;
+    const MeshCacheHeader& header = cache.header();
+    std::cout << argv[2] << ": " << header.stride << " bytes per vertex, "
+              << (header.indexType == GL_UNSIGNED_SHORT ? 16 : 32) << "-bit indices, "
+              << header.indexOffset + header.indexBytes << " bytes, written in " << convertMs << " ms, opened in "
+              << msSince(start) << " ms" << std::endl;
+    return 0;
+}